@@ -0,0 +1,72 @@
+#!/bin/bash
+
+# Checks that a sharded run produces the same fused maps as an unsharded one: writes a
+# synthetic scene, fuses it in one process, then plans it in shards, fuses every shard in its
+# own process, verifies the shards and compares every fused map byte for byte.
+#
+# usage: ./check_shards.sh [<num-shards> [<build-path>]]
+
+NUM_SHARDS=${1:-3}
+BUILD_DIR=${2:-../src/build/}
+FUSION_EXE=${BUILD_DIR}/depth_fusion
+BENCH_EXE=${BUILD_DIR}/fusion_bench
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf ${WORK_DIR}" EXIT
+
+DATA_DIR=${WORK_DIR}/data/
+SCENE=synthetic
+ARGS="5 0.0 0.0 0.005 --threads 2"
+
+# synthetic scene: Depths/synthetic/, Confs/synthetic/ and Cameras/ under the data root
+$BENCH_EXE --generate-only --dir ${DATA_DIR} --views 12 --width 160 --height 128 || exit 1
+
+# unsharded reference run
+$FUSION_EXE ${DATA_DIR} ${WORK_DIR}/full/ ${SCENE} ${ARGS} > ${WORK_DIR}/full.log 2>&1 || { cat ${WORK_DIR}/full.log; exit 1; }
+
+# sharded run: plan, one process per shard, verify
+$FUSION_EXE ${DATA_DIR} ${WORK_DIR}/sharded/ ${SCENE} ${ARGS} --plan-shards ${NUM_SHARDS} || exit 1
+NUM_SHARDS=$(grep -c "^shard " ${WORK_DIR}/sharded/shards.txt)
+
+PIDS=()
+for (( K=0; K<${NUM_SHARDS}; K++ ))
+do
+	$FUSION_EXE ${DATA_DIR} ${WORK_DIR}/sharded/ ${SCENE} ${ARGS} --shard ${K} > ${WORK_DIR}/shard_${K}.log 2>&1 &
+	PIDS+=($!)
+done
+
+FAILED=0
+for (( K=0; K<${NUM_SHARDS}; K++ ))
+do
+	if ! wait ${PIDS[$K]}; then
+		echo "Shard ${K} failed:"
+		cat ${WORK_DIR}/shard_${K}.log
+		FAILED=1
+	fi
+done
+
+$FUSION_EXE ${DATA_DIR} ${WORK_DIR}/sharded/ ${SCENE} ${ARGS} --verify || FAILED=1
+
+# the fused maps of both runs must be identical
+NUM_MAPS=0
+for MAP in ${WORK_DIR}/full/depths/*_depth.pfm ${WORK_DIR}/full/confs/*_conf.pfm
+do
+	NAME=${MAP#${WORK_DIR}/full/}
+	if ! cmp -s ${MAP} ${WORK_DIR}/sharded/${NAME}; then
+		echo "${NAME} differs between the sharded and the unsharded run"
+		FAILED=1
+	fi
+	NUM_MAPS=$(( NUM_MAPS + 1 ))
+done
+
+if [ ${NUM_MAPS} -eq 0 ]; then
+	echo "The unsharded run wrote no fused maps"
+	FAILED=1
+fi
+
+if [ ${FAILED} -eq 0 ]; then
+	echo "PASSED: ${NUM_MAPS} fused maps identical across ${NUM_SHARDS} shards"
+else
+	echo "FAILED"
+fi
+exit ${FAILED}
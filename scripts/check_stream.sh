@@ -0,0 +1,133 @@
+#!/bin/bash
+
+# Checks the stream mode on a synthetic scene written by fusion_bench:
+#  - frames sent one at a time are answered in stream order, each as soon as the last frame
+#    of its window (num-views frames, lookahead of them after the frame) has arrived, and
+#    not before;
+#  - stdout carries the replies only;
+#  - a stream read at once with a maximum lag drops frames (but never the last one), and the
+#    same stream without it drops none.
+#
+# usage: ./check_stream.sh [<build-path>]
+
+BUILD_DIR=${1:-../src/build/}
+FUSION_EXE=${BUILD_DIR}/depth_fusion
+BENCH_EXE=${BUILD_DIR}/fusion_bench
+
+WORK_DIR=$(mktemp -d)
+trap "rm -rf ${WORK_DIR}" EXIT
+
+DATA_DIR=${WORK_DIR}/data/
+NUM_FRAMES=12
+NUM_VIEWS=4
+ARGS="${NUM_VIEWS} 0.0 0.0 0.005 --threads 2"
+FAILED=0
+
+fail() {
+	echo "$1"
+	FAILED=1
+}
+
+$BENCH_EXE --generate-only --dir ${DATA_DIR} --views ${NUM_FRAMES} --width 320 --height 256 > /dev/null || exit 1
+
+frame() {
+	local INDEX=$(printf "%08d" $1)
+	echo "frame f$1 ${DATA_DIR}Depths/synthetic/${INDEX}_depth.pfm ${DATA_DIR}Confs/synthetic/${INDEX}_conf.pfm ${DATA_DIR}Cameras/${INDEX}_cam.txt"
+}
+
+# last frame of the window of a frame (as in stream_window())
+window_end() {
+	local START=$(( $1 - (NUM_VIEWS-1-$2) ))
+	echo $(( (START > 0 ? START : 0) + NUM_VIEWS-1 ))
+}
+
+# frames sent one at a time: after frame k, exactly the frames whose window ends at k are
+# answered (and every remaining frame once the stream ends)
+for LOOKAHEAD in 0 1 $(( NUM_VIEWS-1 ))
+do
+	coproc FUSION { $FUSION_EXE - ${WORK_DIR}/stream_${LOOKAHEAD}/ stream ${ARGS} --stream - --stream-lookahead ${LOOKAHEAD} 2> ${WORK_DIR}/stream_${LOOKAHEAD}.log; }
+	PID=${FUSION_PID}
+
+	# own copies of the pipes, which outlive the coprocess
+	exec {OUT}<&${FUSION[0]} {IN}>&${FUSION[1]}
+	eval "exec ${FUSION[0]}<&- ${FUSION[1]}>&-"
+
+	NEXT=0
+	for (( K=0; K<${NUM_FRAMES}; K++ ))
+	do
+		frame ${K} >&${IN}
+		LAST=$(( K == NUM_FRAMES-1 ))
+		if [ ${LAST} -eq 1 ]; then
+			echo "end" >&${IN}
+			exec {IN}>&-
+			IN=
+		fi
+
+		while [ ${NEXT} -lt ${NUM_FRAMES} ] && { [ ${LAST} -eq 1 ] || [ $(window_end ${NEXT} ${LOOKAHEAD}) -le ${K} ]; }
+		do
+			if ! read -t 60 -r REPLY <&${OUT}; then
+				fail "lookahead ${LOOKAHEAD}: no reply for frame ${NEXT} after frame ${K}"
+				break 2
+			fi
+			if [ "$(echo ${REPLY} | cut -d' ' -f1-3)" != "fused ${NEXT} f${NEXT}" ]; then
+				fail "lookahead ${LOOKAHEAD}: expected 'fused ${NEXT} f${NEXT}', got '${REPLY}'"
+				break 2
+			fi
+			NEXT=$(( NEXT+1 ))
+		done
+
+		# nothing else may be answered before the next frame arrives
+		if [ ${LAST} -eq 0 ] && read -t 0.5 -r REPLY <&${OUT}; then
+			fail "lookahead ${LOOKAHEAD}: '${REPLY}' answered before frame $(( K+1 )) arrived"
+			break
+		fi
+	done
+
+	[ -n "${IN}" ] && exec {IN}>&-
+	exec {OUT}<&-
+	if [ ${FAILED} -ne 0 ]; then
+		kill ${PID} 2> /dev/null
+		cat ${WORK_DIR}/stream_${LOOKAHEAD}.log
+		break
+	fi
+	wait ${PID} || { fail "lookahead ${LOOKAHEAD}: the stream failed"; cat ${WORK_DIR}/stream_${LOOKAHEAD}.log; break; }
+	echo "Lookahead ${LOOKAHEAD}: ${NEXT} frames answered in order, each once its window was complete"
+done
+
+# a whole stream read at once, with and without a maximum lag
+for (( K=0; K<${NUM_FRAMES}; K++ ))
+do
+	frame ${K}
+done > ${WORK_DIR}/frames.txt
+
+for MAX_LAG in 0 1
+do
+	$FUSION_EXE - ${WORK_DIR}/lag_${MAX_LAG}/ stream ${ARGS} --stream ${WORK_DIR}/frames.txt --stream-max-lag ${MAX_LAG} \
+		> ${WORK_DIR}/lag_${MAX_LAG}.replies 2> ${WORK_DIR}/lag_${MAX_LAG}.log || fail "max lag ${MAX_LAG}: the stream failed"
+
+	if grep -qvE "^(fused|dropped) " ${WORK_DIR}/lag_${MAX_LAG}.replies; then
+		fail "max lag ${MAX_LAG}: stdout holds more than the replies"
+	fi
+	if [ "$(cut -d' ' -f2 ${WORK_DIR}/lag_${MAX_LAG}.replies | tr '\n' ' ')" != "$(seq -s' ' 0 $(( NUM_FRAMES-1 ))) " ]; then
+		fail "max lag ${MAX_LAG}: the frames are not answered once each, in order"
+	fi
+
+	DROPPED=$(grep -c "^dropped " ${WORK_DIR}/lag_${MAX_LAG}.replies)
+	if [ ${MAX_LAG} -eq 0 ] && [ ${DROPPED} -ne 0 ]; then
+		fail "max lag 0: ${DROPPED} frames dropped"
+	fi
+	if [ ${MAX_LAG} -gt 0 ] && [ ${DROPPED} -eq 0 ]; then
+		fail "max lag ${MAX_LAG}: no frame dropped"
+	fi
+	if [ ${MAX_LAG} -gt 0 ] && ! tail -n 1 ${WORK_DIR}/lag_${MAX_LAG}.replies | grep -q "^fused "; then
+		fail "max lag ${MAX_LAG}: the last frame was dropped"
+	fi
+	echo "Max lag ${MAX_LAG}: ${DROPPED} of ${NUM_FRAMES} frames dropped"
+done
+
+if [ ${FAILED} -eq 0 ]; then
+	echo "PASSED"
+else
+	echo "FAILED"
+fi
+exit ${FAILED}
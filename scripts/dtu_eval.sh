@@ -21,26 +21,18 @@ run() {
 
 	SCANS=(1 4 9 10 11 12 13 15 23 24 29 32 33 34 48 49 62 75 77 110 114 118)
 
+	# list every scan in a manifest, fused by a single process
+	MANIFEST=${OUTPUT_DIR}scans.txt
+	> ${MANIFEST}
 	for SCAN in ${SCANS[@]}
 	do
-		# run netowrk for each scan
-		echo "Running conventional fusion on scan ${SCAN}"
 		printf -v curr_scan_num "%03d" $SCAN
-		SCAN_DIR=scan${curr_scan_num}/
-
-		if [ ! -d  ${OUTPUT_DIR}${SCAN_DIR} ]; then
-			mkdir -p ${OUTPUT_DIR}${SCAN_DIR};
-		fi
-		if [ ! -d  "${OUTPUT_DIR}${SCAN_DIR}depths/" ]; then
-			mkdir -p "${OUTPUT_DIR}${SCAN_DIR}depths/";
-		fi
-		if [ ! -d  "${OUTPUT_DIR}${SCAN_DIR}confs/" ]; then
-			mkdir -p "${OUTPUT_DIR}${SCAN_DIR}confs/";
-		fi
-
-		# run depth fusion
-		$FUSION_EXE ${DATA_DIR} ${OUTPUT_DIR}${SCAN_DIR} ${SCAN_DIR} 5 0.0 0.0 0.005
+		echo "scan${curr_scan_num}/" >> ${MANIFEST}
 	done
+
+	# run depth fusion (outputs go to ${OUTPUT_DIR}scanXXX/)
+	echo "Running conventional fusion on ${#SCANS[@]} scans"
+	$FUSION_EXE ${DATA_DIR} ${OUTPUT_DIR} - 5 0.0 0.0 0.005 --batch ${MANIFEST}
 }
 
 
@@ -2,6 +2,8 @@ import numpy as np
 import sys
 import os
 import re
+import struct
+import zlib
 import cv2
 import matplotlib.pyplot as plt
 
@@ -30,15 +32,27 @@ def main():
         gt_path = "/media/nate/Data/BlendedMVS/{}/gt_depth/".format(scan_dir)
         depth_path = os.path.join(data_path,scan_dir,"depths")
         conf_path = os.path.join(data_path,scan_dir,"confs")
+        archive_path = os.path.join(data_path,scan_dir,"fused_views.far")
         #gt_path = os.path.join(gt_depth_path,scan_dir)
 
-        depth_files = os.listdir(depth_path)
-        depth_files.sort()
-        depth_files = [d for d in depth_files if d[-3:]=="pfm"]
+        # fused maps written with --archive: read each view straight from the archive
+        if os.path.exists(archive_path):
+            index = read_archive_index(archive_path)
+            depth_files = archive_views(index)
+            conf_files = depth_files
+            load_depth = lambda v: load_archive_map(archive_path, index, v, ARCHIVE_DEPTH)
+            load_conf = lambda v: load_archive_map(archive_path, index, v, ARCHIVE_CONF)
+        else:
+            depth_files = os.listdir(depth_path)
+            depth_files.sort()
+            depth_files = [d for d in depth_files if d[-3:]=="pfm"]
+
+            conf_files = os.listdir(conf_path)
+            conf_files.sort()
+            conf_files = [c for c in conf_files if c[-3:]=="pfm"]
 
-        conf_files = os.listdir(conf_path)
-        conf_files.sort()
-        conf_files = [c for c in conf_files if c[-3:]=="pfm"]
+            load_depth = lambda d: load_pfm(os.path.join(depth_path, d))
+            load_conf = lambda c: load_pfm(os.path.join(conf_path, c))
 
         gt_depth_files = os.listdir(gt_path)
         gt_depth_files.sort()
@@ -52,8 +66,8 @@ def main():
         total_percs = np.zeros((4,))
 
         for (d,c,g) in zip(depth_files,conf_files,gt_depth_files):
-            depth = load_pfm(os.path.join(depth_path, d))
-            conf = load_pfm(os.path.join(conf_path, c))
+            depth = load_depth(d)
+            conf = load_conf(c)
             gt_depth = load_pfm(os.path.join(gt_path, g))
             #gt_depth = mask_depth_image(gt_depth, 427, 935)
             mean_abs_error, pe, num_gt = error_stats(depth,gt_depth,view_num)
@@ -173,6 +187,71 @@ def load_pfm(pfm_file):
     return data
 
 
+# fused-view archive (see src/output_archive.h)
+ARCHIVE_DEPTH = 0
+ARCHIVE_CONF = 1
+ARCHIVE_HEADER = struct.Struct('<8sIIQ')
+ARCHIVE_CHUNK = struct.Struct('<IiIiiIQQ')
+ARCHIVE_ENTRY = struct.Struct('<IiIiiIQQQ')
+ARCHIVE_CHUNK_MAGIC = 0x4B4E4843
+ARCHIVE_INDEX_MAGIC = 0x58444E49
+
+def read_archive_index(archive_file):
+    """ map (view, kind) to (offset, rows, cols, codec, stored_bytes) of the last chunk of each map """
+    index = {}
+    size = os.path.getsize(archive_file)
+    with open(archive_file,'rb') as f:
+        if size < ARCHIVE_HEADER.size:
+            raise Exception('Not a fused-view archive.')
+        magic, version, _, index_offset = ARCHIVE_HEADER.unpack(f.read(ARCHIVE_HEADER.size))
+        if magic != b'FUSEARC1' or version != 1:
+            raise Exception('Not a fused-view archive.')
+
+        if index_offset != 0:
+            # the entry count and the payloads are checked against the file before they are used
+            if index_offset + 8 > size:
+                raise Exception('Corrupt archive index.')
+            f.seek(index_offset)
+            index_magic, count = struct.unpack('<II', f.read(8))
+            if index_magic != ARCHIVE_INDEX_MAGIC or count * ARCHIVE_ENTRY.size > size - index_offset - 8:
+                raise Exception('Corrupt archive index.')
+            for _ in range(count):
+                _, view, kind, rows, cols, codec, _, stored, offset = ARCHIVE_ENTRY.unpack(f.read(ARCHIVE_ENTRY.size))
+                if rows < 0 or cols < 0 or offset < ARCHIVE_HEADER.size or offset + stored > index_offset:
+                    raise Exception('Corrupt archive index.')
+                index[(view, kind)] = (offset, rows, cols, codec, stored)
+        else:
+            # archive of an interrupted run: walk the chunk headers
+            offset = ARCHIVE_HEADER.size
+            while offset + ARCHIVE_CHUNK.size <= size:
+                f.seek(offset)
+                chunk_magic, view, kind, rows, cols, codec, _, stored = ARCHIVE_CHUNK.unpack(f.read(ARCHIVE_CHUNK.size))
+                payload = offset + ARCHIVE_CHUNK.size
+                if chunk_magic != ARCHIVE_CHUNK_MAGIC or payload + stored > size or rows < 0 or cols < 0:
+                    break
+                index[(view, kind)] = (payload, rows, cols, codec, stored)
+                offset = payload + stored
+    return index
+
+def archive_views(index):
+    """ views with both a depth and a confidence map, in increasing order """
+    return sorted(v for (v, k) in index if k == ARCHIVE_DEPTH and (v, ARCHIVE_CONF) in index)
+
+def load_archive_map(archive_file, index, view, kind):
+    """ read and decompress one map, without touching the rest of the archive """
+    offset, rows, cols, codec, stored = index[(view, kind)]
+    with open(archive_file,'rb') as f:
+        f.seek(offset)
+        payload = f.read(stored)
+
+    if codec == 0:
+        return np.frombuffer(payload, '<f4').reshape(rows, cols)
+
+    # the float bytes are stored as four byte planes
+    planes = np.frombuffer(zlib.decompress(payload), np.uint8).reshape(4, rows*cols)
+    return np.ascontiguousarray(planes.T).view('<f4').reshape(rows, cols)
+
+
 def compute_auc(fused_depth, fused_conf, gt_depth, view_num):
     height, width = fused_depth.shape
 
@@ -0,0 +1,52 @@
+#!/bin/bash
+
+# Fuses one scene in shards: the coordinator writes the work manifest, every shard is fused by
+# its own process (local processes standing in for the nodes of a cluster) and a final step
+# verifies that every view is complete.
+#
+# The final step also merges the outputs of the shards into those of the scene: with --archive,
+# the shard archives (fused_views_shard<k>.far) are combined into fused_views.far, which is the
+# archive scripts/evaluate.py reads; with --merge-voxel, merged.ply is built from the fused maps
+# of every view (the merged_shard<k>.ply clouds of the workers are kept).
+#
+# usage: ./shard_fusion.sh <data-root-path> <output-path> <scene> [<num-shards> [<threads-per-shard> [<fusion-options>...]]]
+
+if [ $# -lt 3 ]; then
+	echo "usage: $0 <data-root-path> <output-path> <scene> [<num-shards> [<threads-per-shard> [<fusion-options>...]]]"
+	exit 1
+fi
+
+DATA_DIR=$1
+OUTPUT_DIR=$2
+SCENE=$3
+NUM_SHARDS=${4:-4}
+THREADS=${5:-$(( $(nproc) / NUM_SHARDS > 0 ? $(nproc) / NUM_SHARDS : 1 ))}
+
+BUILD_DIR=../src/build/
+FUSION_EXE=${BUILD_DIR}depth_fusion
+ARGS="${DATA_DIR} ${OUTPUT_DIR} ${SCENE} 5 0.0 0.0 0.005 --threads ${THREADS} ${@:6}"
+
+# plan the shards
+$FUSION_EXE ${ARGS} --plan-shards ${NUM_SHARDS} || exit 1
+NUM_SHARDS=$(grep -c "^shard " ${OUTPUT_DIR}/shards.txt)
+
+# fuse every shard in its own process
+PIDS=()
+for (( K=0; K<${NUM_SHARDS}; K++ ))
+do
+	$FUSION_EXE ${ARGS} --shard ${K} > ${OUTPUT_DIR}/shard_${K}.log 2>&1 &
+	PIDS+=($!)
+done
+
+FAILED=0
+for (( K=0; K<${NUM_SHARDS}; K++ ))
+do
+	if ! wait ${PIDS[$K]}; then
+		echo "Shard ${K} failed (see ${OUTPUT_DIR}/shard_${K}.log)"
+		FAILED=1
+	fi
+done
+
+# check that every view is complete and merge the outputs of the shards
+$FUSION_EXE ${ARGS} --verify || exit 1
+exit ${FAILED}
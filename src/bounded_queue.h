@@ -0,0 +1,81 @@
+#ifndef _BOUNDED_QUEUE_H_
+#define _BOUNDED_QUEUE_H_
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+using namespace std;
+
+/*
+ * Blocking multi-producer, multi-consumer FIFO queue with a fixed capacity.
+ *
+ * push() blocks while the queue is full and reports whether it had to wait, so that
+ * producers can tell when the consumers (e.g. storage) are the bottleneck. After close(),
+ * pop() drains the remaining items and then returns false.
+ */
+template <typename T>
+class BoundedQueue {
+    public:
+        BoundedQueue(const size_t capacity) :
+            capacity(capacity > 0 ? capacity : 1),
+            closed(false)
+        {}
+
+        // returns true if the caller was blocked by a full queue
+        bool push(T item) {
+            unique_lock<mutex> guard(lock);
+            bool blocked = false;
+
+            while (items.size() >= capacity && !closed) {
+                blocked = true;
+                not_full.wait(guard);
+            }
+
+            items.push_back(std::move(item));
+            not_empty.notify_one();
+
+            return blocked;
+        }
+
+        // returns false once the queue is closed and empty
+        bool pop(T &item) {
+            unique_lock<mutex> guard(lock);
+
+            while (items.empty() && !closed) {
+                not_empty.wait(guard);
+            }
+
+            if (items.empty()) {
+                return false;
+            }
+
+            item = std::move(items.front());
+            items.pop_front();
+            not_full.notify_one();
+
+            return true;
+        }
+
+        void close() {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+            not_empty.notify_all();
+            not_full.notify_all();
+        }
+
+        size_t size() const {
+            lock_guard<mutex> guard(lock);
+            return items.size();
+        }
+
+    private:
+        const size_t capacity;
+        bool closed;
+        deque<T> items;
+        mutable mutex lock;
+        condition_variable not_empty;
+        condition_variable not_full;
+};
+
+#endif
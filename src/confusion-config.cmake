@@ -0,0 +1,8 @@
+# package configuration of libconfusion, installed with the library
+include( CMakeFindDependencyMacro )
+
+find_dependency( OpenCV )
+find_dependency( OpenMP )
+find_dependency( ZLIB )
+
+include( "${CMAKE_CURRENT_LIST_DIR}/confusion-targets.cmake" )
@@ -0,0 +1,211 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <atomic>
+
+#include "geometry.h"
+#include "consensus.h"
+
+/*
+ * @brief Computes the free-space violation penalty of an initial depth estimate
+ *
+ * The initial estimate of pixel (r,c), taken from rendered view initial_d, is projected into
+ * supporting view d; the penalty is the original confidence of the pixel it lands on.
+ *
+ * @param args          - The consensus inputs
+ * @param r             - The row of the pixel
+ * @param c             - The column of the pixel
+ * @param initial_d     - The view the initial estimate was taken from
+ * @param d             - The supporting view that sees past the initial estimate
+ * @param initial_f     - The initial depth estimate
+ *
+ * @return Returns the confidence to be subtracted (0 if the projection falls outside the image)
+ *
+ */
+float free_space_penalty(const ConsensusArgs &args, const int r, const int c, const int initial_d, const int d, const float initial_f) {
+    const size_t k = (size_t) initial_d*args.num_views + d;
+    const float *col_term = args.col_terms + (k*args.cols + c)*3;
+    const float *row_term = args.row_terms + (k*args.rows + r)*3;
+    const float *offset = args.offsets + k*3;
+    const Size size(args.cols, args.rows);
+
+    // project the initial estimate into the supporting view
+    const Vec3f x_2(
+            initial_f*(col_term[0] + row_term[0]) + offset[0],
+            initial_f*(col_term[1] + row_term[1]) + offset[1],
+            initial_f*(col_term[2] + row_term[2]) + offset[2]);
+
+    int r_p, c_p;
+    float proj_depth;
+
+    // ignore if pixel projection falls outside the image
+    if (!to_pixel(x_2, size, r_p, c_p, proj_depth)) {
+        return 0.0f;
+    }
+
+    return args.support_conf[d][(size_t) r_p*args.cols + c_p];
+}
+
+/*
+ * @brief Fuses a span of pixels of a reference view, one pixel at a time
+ *
+ * This is the reference implementation; the SIMD kernels must produce the same output.
+ *
+ * @param args          - The consensus inputs
+ * @param r             - The row of the span
+ * @param c_start       - The first column of the span
+ * @param c_end         - One past the last column of the span
+ * @param counts        - The vote counters to be updated
+ *
+ */
+void consensus_span_scalar(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts) {
+    const int num_views = args.num_views;
+
+    for (int c=c_start; c<c_end; ++c) {
+        const size_t p = (size_t) r*args.cols + c;
+        float f = 0.0;
+        float initial_f = 0.0;
+        float C = 0.0;
+        int initial_d = 0;
+
+        // take most confident pixel as initial depth estimate
+        for (int d=0; d<num_views; ++d) {
+            if (args.conf[d*args.plane + p] > C) {
+                f = args.depth[d*args.plane + p];
+                C = args.conf[d*args.plane + p];
+                initial_f = f;
+                initial_d = d;
+            }
+        }
+
+        // Set support region as fraction of initial depth estimate
+        float epsilon = args.support_ratio * initial_f;
+
+        for (int d=0; d<num_views; ++d) {
+            // skip computation if this iteration is the initial depth map
+            if (d == initial_d) {
+                continue;
+            }
+
+            // grab current depth and confidence values
+            float curr_depth = args.depth[d*args.plane + p];
+            float curr_conf = args.conf[d*args.plane + p];
+
+            // if depth is within the support region of the initial depth
+            if (abs(curr_depth - initial_f) < epsilon) {
+                if((C + curr_conf) != 0) {
+                    f = ((f*C) + (curr_depth*curr_conf)) / (C + curr_conf);
+                }
+                C += curr_conf;
+                ++counts.support;
+            }
+            // if depth is closer than initial estimate (occlusion)
+            else if(curr_depth < initial_f) {
+                C -= curr_conf;
+                ++counts.occlusion;
+            }
+            // if depth is farther than initial estimate (free-space violation)
+            else if(curr_depth > initial_f) {
+                C -= free_space_penalty(args, r, c, initial_d, d, initial_f);
+                ++counts.free_space;
+            }
+        }
+
+        // bound confidence to interval (0-1)
+        // 5 views could all have max contributions 1.0/-1.0, making the max value of C = 5.0/-5.0 for the given pixel
+        // TODO: could be a better way to squeeze the confidence value to avoid the effect of outliers... Sigmoid?
+        C += num_views;
+        C /= (2*num_views);
+
+        // set the values for the confidence and depth estimates at the current pixel
+        args.fused_map[p] = f;
+        args.fused_conf[p] = C;
+    }
+}
+
+// kernel used by fuse_views (resolved on first use unless selected explicitly)
+static atomic<ConsensusKernel> active_kernel(NULL);
+
+/*
+ * @brief Selects the consensus kernel
+ *
+ * 'auto' picks the widest kernel the CPU supports. The SIMD kernels are only available
+ * in x86-64 builds.
+ *
+ * @param name          - The kernel: 'auto', 'scalar', 'avx2' or 'avx512'
+ *
+ * @return Returns false if the kernel is unknown or not supported by this build or CPU
+ *
+ */
+bool select_consensus_kernel(const char *name) {
+    ConsensusKernel kernel = NULL;
+
+    if (strcmp(name, "scalar") == 0) {
+        kernel = consensus_span_scalar;
+    }
+#ifdef FUSION_SIMD_X86
+    else if (strcmp(name, "avx512") == 0) {
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = consensus_span_avx512;
+        }
+    } else if (strcmp(name, "avx2") == 0) {
+        if (__builtin_cpu_supports("avx2")) {
+            kernel = consensus_span_avx2;
+        }
+    } else if (strcmp(name, "auto") == 0) {
+        if (__builtin_cpu_supports("avx512f")) {
+            kernel = consensus_span_avx512;
+        } else if (__builtin_cpu_supports("avx2")) {
+            kernel = consensus_span_avx2;
+        } else {
+            kernel = consensus_span_scalar;
+        }
+    }
+#else
+    else if (strcmp(name, "auto") == 0) {
+        kernel = consensus_span_scalar;
+    }
+#endif
+
+    if (kernel == NULL) {
+        return false;
+    }
+
+    active_kernel = kernel;
+    return true;
+}
+
+/*
+ * @brief Returns the selected consensus kernel
+ *
+ */
+ConsensusKernel consensus_kernel() {
+    ConsensusKernel kernel = active_kernel;
+
+    if (kernel == NULL) {
+        select_consensus_kernel("auto");
+        kernel = active_kernel;
+    }
+
+    return kernel;
+}
+
+/*
+ * @brief Returns the name of the selected consensus kernel
+ *
+ */
+const char *consensus_kernel_name() {
+    ConsensusKernel kernel = consensus_kernel();
+
+#ifdef FUSION_SIMD_X86
+    if (kernel == consensus_span_avx512) {
+        return "avx512";
+    }
+    if (kernel == consensus_span_avx2) {
+        return "avx2";
+    }
+#endif
+
+    return "scalar";
+}
@@ -0,0 +1,52 @@
+#ifndef _CONSENSUS_H_
+#define _CONSENSUS_H_
+
+#include <stddef.h>
+
+// This header is shared with the SIMD kernels, which are compiled with ISA-specific flags;
+// it must not pull in OpenCV or the standard containers, whose inline code would otherwise be
+// emitted with those flags. It only declares plain structures and functions.
+
+// structure to hold the inputs and outputs of the consensus of a single reference view
+struct ConsensusArgs {
+    const float *depth;             // rendered depth maps, stacked view-major: [view][row][col]
+    const float *conf;              // rendered confidence maps, stacked like the depth maps
+    size_t plane;                   // floats per stacked view (rows*cols)
+    int num_views;
+    int rows;
+    int cols;
+    float support_ratio;
+    const float *const *support_conf;   // original confidence map of every supporting view (continuous), in the order of views[index]
+    const float *col_terms;         // ray tables of every ordered pair of supporting views (pair i*num_views+j, see RayTables in depth_fusion.h)
+    const float *row_terms;
+    const float *offsets;
+    float *fused_map;               // continuous output maps
+    float *fused_conf;
+};
+
+// structure to hold the votes cast by the supporting views during the consensus
+struct ConsensusCounts {
+    size_t support = 0;
+    size_t occlusion = 0;
+    size_t free_space = 0;
+};
+
+// consensus kernel: fuses the pixels [c_start, c_end) of row r and adds its votes to counts
+typedef void (*ConsensusKernel)(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts);
+
+// kernels
+void consensus_span_scalar(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts);
+#ifdef FUSION_SIMD_X86
+void consensus_span_avx2(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts);
+void consensus_span_avx512(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts);
+#endif
+
+// free-space violation penalty of the initial estimate of pixel (r,c) in supporting view d
+float free_space_penalty(const ConsensusArgs &args, const int r, const int c, const int initial_d, const int d, const float initial_f);
+
+// kernel selection ("auto", "scalar", "avx2" or "avx512")
+bool select_consensus_kernel(const char *name);
+ConsensusKernel consensus_kernel();
+const char *consensus_kernel_name();
+
+#endif
@@ -0,0 +1,46 @@
+// compiled with -mavx2 (see CMakeLists.txt); only called after a runtime CPU check
+#include <immintrin.h>
+
+#include "consensus.h"
+#include "consensus_simd.h"
+
+// 8-lane operations for the width-generic consensus kernel
+struct Avx2Ops {
+    enum { WIDTH = 8 };
+    typedef __m256 F;
+    typedef __m256 M;
+
+    static inline F load(const float *p) { return _mm256_loadu_ps(p); }
+    static inline void store(float *p, const F a) { _mm256_storeu_ps(p, a); }
+    static inline F set1(const float a) { return _mm256_set1_ps(a); }
+
+    static inline F add(const F a, const F b) { return _mm256_add_ps(a, b); }
+    static inline F sub(const F a, const F b) { return _mm256_sub_ps(a, b); }
+    static inline F mul(const F a, const F b) { return _mm256_mul_ps(a, b); }
+    static inline F div(const F a, const F b) { return _mm256_div_ps(a, b); }
+    static inline F abs(const F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+    // comparisons follow the C++ operators (ordered, except for != which is true for NaN)
+    static inline M lt(const F a, const F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+    static inline M gt(const F a, const F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static inline M neq(const F a, const F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+
+    static inline M and_(const M a, const M b) { return _mm256_and_ps(a, b); }
+    static inline M andnot(const M a, const M b) { return _mm256_andnot_ps(a, b); }     // ~a & b
+    static inline F select(const M m, const F a, const F b) { return _mm256_blendv_ps(b, a, m); }
+    static inline int bits(const M m) { return _mm256_movemask_ps(m); }
+};
+
+/*
+ * @brief Fuses a span of pixels of a reference view, 8 pixels at a time (AVX2)
+ *
+ * @param args          - The consensus inputs
+ * @param r             - The row of the span
+ * @param c_start       - The first column of the span
+ * @param c_end         - One past the last column of the span
+ * @param counts        - The vote counters to be updated
+ *
+ */
+void consensus_span_avx2(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts) {
+    consensus_span_simd<Avx2Ops>(args, r, c_start, c_end, counts);
+}
@@ -0,0 +1,46 @@
+// compiled with -mavx512f (see CMakeLists.txt); only called after a runtime CPU check
+#include <immintrin.h>
+
+#include "consensus.h"
+#include "consensus_simd.h"
+
+// 16-lane operations for the width-generic consensus kernel
+struct Avx512Ops {
+    enum { WIDTH = 16 };
+    typedef __m512 F;
+    typedef __mmask16 M;
+
+    static inline F load(const float *p) { return _mm512_loadu_ps(p); }
+    static inline void store(float *p, const F a) { _mm512_storeu_ps(p, a); }
+    static inline F set1(const float a) { return _mm512_set1_ps(a); }
+
+    static inline F add(const F a, const F b) { return _mm512_add_ps(a, b); }
+    static inline F sub(const F a, const F b) { return _mm512_sub_ps(a, b); }
+    static inline F mul(const F a, const F b) { return _mm512_mul_ps(a, b); }
+    static inline F div(const F a, const F b) { return _mm512_div_ps(a, b); }
+    static inline F abs(const F a) { return _mm512_abs_ps(a); }
+
+    // comparisons follow the C++ operators (ordered, except for != which is true for NaN)
+    static inline M lt(const F a, const F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+    static inline M gt(const F a, const F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static inline M neq(const F a, const F b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+
+    static inline M and_(const M a, const M b) { return a & b; }
+    static inline M andnot(const M a, const M b) { return ~a & b; }     // ~a & b
+    static inline F select(const M m, const F a, const F b) { return _mm512_mask_blend_ps(m, b, a); }
+    static inline int bits(const M m) { return (int) m; }
+};
+
+/*
+ * @brief Fuses a span of pixels of a reference view, 16 pixels at a time (AVX-512)
+ *
+ * @param args          - The consensus inputs
+ * @param r             - The row of the span
+ * @param c_start       - The first column of the span
+ * @param c_end         - One past the last column of the span
+ * @param counts        - The vote counters to be updated
+ *
+ */
+void consensus_span_avx512(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts) {
+    consensus_span_simd<Avx512Ops>(args, r, c_start, c_end, counts);
+}
@@ -0,0 +1,111 @@
+#ifndef _CONSENSUS_SIMD_H_
+#define _CONSENSUS_SIMD_H_
+
+#include "consensus.h"
+
+/*
+ * Width-generic consensus kernel, instantiated once per instruction set.
+ *
+ * V provides the vector type F, the mask type M, the lane count WIDTH and the operations
+ * below. Every lane carries out exactly the floating-point operations of the scalar kernel,
+ * in the same order, so the outputs match it. The view stack is laid out view-major, so the
+ * same W consecutive pixels of every view are a single unaligned load.
+ *
+ * The free-space check (a data-dependent projection into a different view per lane) is
+ * left to free_space_penalty() for the lanes that need it; it runs between the view
+ * iterations, exactly where the scalar kernel applies it.
+ *
+ * Only to be included by the kernel translation units.
+ */
+template <class V>
+static void consensus_span_simd(const ConsensusArgs &args, const int r, const int c_start, const int c_end, ConsensusCounts &counts) {
+    typedef typename V::F F;
+    typedef typename V::M M;
+
+    const int W = V::WIDTH;
+    const int num_views = args.num_views;
+    const size_t row = (size_t) r*args.cols;
+
+    const F zero = V::set1(0.0f);
+    const F ratio = V::set1(args.support_ratio);
+    const F views_f = V::set1((float) num_views);
+    const F views_2 = V::set1((float) (2*num_views));
+
+    int c = c_start;
+    for (; c + W <= c_end; c += W) {
+        const size_t p = row + c;
+        F f = zero;
+        F C = zero;
+        F initial_d = zero;
+
+        // take most confident pixel as initial depth estimate
+        for (int d=0; d<num_views; ++d) {
+            const F depth = V::load(args.depth + d*args.plane + p);
+            const F conf = V::load(args.conf + d*args.plane + p);
+            const M better = V::gt(conf, C);
+
+            f = V::select(better, depth, f);
+            C = V::select(better, conf, C);
+            initial_d = V::select(better, V::set1((float) d), initial_d);
+        }
+
+        const F initial_f = f;
+        const F epsilon = V::mul(ratio, initial_f);
+
+        for (int d=0; d<num_views; ++d) {
+            const F depth = V::load(args.depth + d*args.plane + p);
+            const F conf = V::load(args.conf + d*args.plane + p);
+
+            // lanes whose initial estimate came from another view
+            const M other = V::neq(initial_d, V::set1((float) d));
+
+            // support: weighted average of the depths, accumulation of the confidences
+            const M support = V::and_(other, V::lt(V::abs(V::sub(depth, initial_f)), epsilon));
+            const F denom = V::add(C, conf);
+            const F average = V::div(V::add(V::mul(f, C), V::mul(depth, conf)), denom);
+            f = V::select(V::and_(support, V::neq(denom, zero)), average, f);
+            C = V::select(support, denom, C);
+            counts.support += __builtin_popcount(V::bits(support));
+
+            // occlusion
+            const M rest = V::andnot(support, other);
+            const M occluded = V::and_(rest, V::lt(depth, initial_f));
+            C = V::select(occluded, V::sub(C, conf), C);
+            counts.occlusion += __builtin_popcount(V::bits(occluded));
+
+            // free-space violation
+            int violated = V::bits(V::and_(rest, V::gt(depth, initial_f)));
+            if (violated != 0) {
+                counts.free_space += __builtin_popcount(violated);
+
+                float C_lanes[W];
+                float f_lanes[W];
+                float d_lanes[W];
+                V::store(C_lanes, C);
+                V::store(f_lanes, initial_f);
+                V::store(d_lanes, initial_d);
+
+                while (violated != 0) {
+                    const int lane = __builtin_ctz(violated);
+                    C_lanes[lane] -= free_space_penalty(args, r, c + lane, (int) d_lanes[lane], d, f_lanes[lane]);
+                    violated &= violated - 1;
+                }
+
+                C = V::load(C_lanes);
+            }
+        }
+
+        // bound confidence to interval (0-1)
+        C = V::div(V::add(C, views_f), views_2);
+
+        V::store(args.fused_map + p, f);
+        V::store(args.fused_conf + p, C);
+    }
+
+    // remaining pixels of the span
+    if (c < c_end) {
+        consensus_span_scalar(args, r, c, c_end, counts);
+    }
+}
+
+#endif
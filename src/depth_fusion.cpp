@@ -10,259 +10,521 @@
 #include <iomanip>
 #include <omp.h>
 #include <fstream>
+#include <chrono>
 
 #include "util.h"
 #include "depth_fusion.h"
+#include "geometry.h"
+#include "zbuffer.h"
+#include "render_cache.h"
+#include "consensus.h"
+#include "fusion_stats.h"
+#include "tiled_render.h"
+#include "map_precision.h"
+
+// edge length (in pixels) of the tiles the fusion consensus is scheduled in
+#define FUSION_TILE_SIZE 64
 
 /*
- * @brief Performs depth map fusion using the confidence-based notion of a depth estimate
+ * @brief Renders the pixels of a supporting view into the reference view
  *
- * @param depth_maps        - The container holding the depth maps to be fused.
- * @param fused_map		    - The reference to the output fused depth map.
- * @param conf_maps 	    - The container holding the confidence maps needed for the fusion process.
- * @param fused_conf	    - The reference to the output fused confidence map.
+ * @param depth_map         - The depth map of the supporting view.
+ * @param conf_map          - The confidence map of the supporting view.
+ * @param quant             - The quantization of a 16-bit depth map (NULL for floating-point maps).
+ * @param T                 - The supporting-to-reference reprojection transform.
+ * @param conf_pre_filt     - Pixels with confidence less than this value are not rendered.
+ * @param zbuffer           - The depth buffer of the reference view.
+ * @param stats             - The render counters to be updated.
+ *
+ */
+static void render_pixels(const Mat &depth_map, const Mat &conf_map, const DepthQuant *quant, const Matx34f &T, const float conf_pre_filt, ZBuffer &zbuffer, ViewStats &stats) {
+    const Size size = depth_map.size();
+    const int rows = size.height;
+    const int cols = size.width;
+
+    size_t pre_filtered = 0;
+    size_t out_of_frame = 0;
+    size_t writes = 0;
+    size_t overwrites = 0;
+    size_t rejects = 0;
+
+#pragma omp parallel
+{
+    vector<float> depth_buffer(cols);
+    vector<float> conf_buffer(cols);
+
+    #pragma omp for reduction(+:pre_filtered,out_of_frame,writes,overwrites,rejects)
+    for (int r=0; r<rows; ++r) {
+        // rows held in reduced precision are widened on the fly
+        const float *depth_row = widen_row(depth_map, quant, r, 0, cols, depth_buffer.data());
+        const float *conf_row = widen_row(conf_map, NULL, r, 0, cols, conf_buffer.data());
+
+        for (int c=0; c<cols; ++c) {
+            float depth = depth_row[c];
+            float conf = conf_row[c];
+
+            if(conf < conf_pre_filt) {
+                ++pre_filtered;
+                continue;
+            }
+
+            // calculate pixel location and projection depth in reference image
+            int r_p, c_p;
+            float proj_depth;
+
+            // ignore if pixel projection falls outside the image
+            if (!to_pixel(transform_pixel(T, c, r, depth), size, r_p, c_p, proj_depth)) {
+                ++out_of_frame;
+                continue;
+            }
+
+            // keep the closer (smaller) projection depth; concurrent writers are resolved by the z-buffer
+            switch (zbuffer.update(r_p, c_p, proj_depth, conf)) {
+                case ZBUFFER_INVALID:       ++out_of_frame; break;
+                case ZBUFFER_REJECTED:      ++rejects; break;
+                case ZBUFFER_WRITTEN:       ++writes; break;
+                case ZBUFFER_OVERWRITTEN:   ++overwrites; break;
+            }
+        }
+    }
+} //omp parallel
+
+    stats.source_pixels += (size_t) rows*cols;
+    stats.pre_filtered += pre_filtered;
+    stats.out_of_frame += out_of_frame;
+    stats.zbuffer_writes += writes;
+    stats.zbuffer_overwrites += overwrites;
+    stats.zbuffer_rejects += rejects;
+}
+
+/*
+ * @brief Renders the back-projected points of a supporting view into the reference view
+ *
+ * @param source            - The world points (and confidences) of the supporting view.
+ * @param T                 - The world-to-reference projection transform.
+ * @param zbuffer           - The depth buffer of the reference view.
+ * @param stats             - The render counters to be updated (pre-filtered pixels are not part of the source).
+ *
+ */
+static void render_points(const SourcePoints &source, const Matx34f &T, ZBuffer &zbuffer, ViewStats &stats) {
+    const Size size = zbuffer.get_size();
+    const long count = (long) source.points.size();
+
+    size_t out_of_frame = 0;
+    size_t writes = 0;
+    size_t overwrites = 0;
+    size_t rejects = 0;
+
+    #pragma omp parallel for reduction(+:out_of_frame,writes,overwrites,rejects)
+    for (long i=0; i<count; ++i) {
+        const Vec4f &X = source.points[i];
+
+        // calculate pixel location and projection depth in reference image
+        int r_p, c_p;
+        float proj_depth;
+
+        // ignore if pixel projection falls outside the image
+        if (!to_pixel(transform_point(T, X[0], X[1], X[2]), size, r_p, c_p, proj_depth)) {
+            ++out_of_frame;
+            continue;
+        }
+
+        switch (zbuffer.update(r_p, c_p, proj_depth, X[3])) {
+            case ZBUFFER_INVALID:       ++out_of_frame; break;
+            case ZBUFFER_REJECTED:      ++rejects; break;
+            case ZBUFFER_WRITTEN:       ++writes; break;
+            case ZBUFFER_OVERWRITTEN:   ++overwrites; break;
+        }
+    }
+
+    stats.out_of_frame += out_of_frame;
+    stats.zbuffer_writes += writes;
+    stats.zbuffer_overwrites += overwrites;
+    stats.zbuffer_rejects += rejects;
+}
+
+/*
+ * @brief Returns the quantization of the depth map of a view (NULL unless the maps are held as 16-bit codes)
+ *
+ */
+static inline const DepthQuant *view_quant(const vector<DepthQuant> *depth_quant, const int v) {
+    return (depth_quant != NULL && v < (int) depth_quant->size()) ? &(*depth_quant)[v] : NULL;
+}
+
+/*
+ * @brief Returns the given maps as a single view-major stack ([view][row][col])
+ *
+ * Maps that already are consecutive planes of one continuous buffer (as produced by
+ * render_views) are returned without a copy; otherwise they are copied into a new stack.
+ *
+ * @param maps              - The maps to be stacked, all of the given size.
+ * @param size              - The size of every map.
+ *
+ */
+static Mat stack_views(const vector<Mat> &maps, const Size &size) {
+    const int num_views = maps.size();
+    const size_t plane = (size_t) size.area();
+    bool stacked = true;
+
+    for (int d=0; d<num_views && stacked; ++d) {
+        stacked = maps[d].isContinuous() && maps[d].ptr<float>(0) == maps[0].ptr<float>(0) + d*plane;
+    }
+
+    if (stacked) {
+        return Mat(num_views*size.height, size.width, CV_32F, (void *) maps[0].ptr<float>(0));
+    }
+
+    Mat stack(num_views*size.height, size.width, CV_32F);
+    for (int d=0; d<num_views; ++d) {
+        Mat slice = stack.rowRange(d*size.height, (d+1)*size.height);
+        maps[d].copyTo(slice);
+    }
+
+    return stack;
+}
+
+/*
+ * @brief Returns the memory held by the buffers of a scratch set
+ *
+ */
+size_t FusionScratch::bytes() const {
+    size_t total = (depth_stack.total() + conf_stack.total() + support_conf.total()) * sizeof(float);
+
+    if (zbuffer) {
+        total += (size_t) zbuffer->get_size().area() * sizeof(uint64_t);
+    }
+    total += pair_T.capacity() * sizeof(Matx34f);
+    total += (rays.col_terms.capacity() + rays.row_terms.capacity() + rays.offsets.capacity()) * sizeof(float);
+    total += bins.bytes();
+
+    return total;
+}
+
+/*
+ * @brief Renders the supporting views of a reference view into the reference view
+ *
+ * @param depth_maps        - The container (indexed by view) holding the depth maps of the supporting views.
+ * @param conf_maps 	    - The container (indexed by view) holding the confidence maps of the supporting views.
+ *                              The maps may be held in reduced precision (see map_precision.h).
+ * @param depth_quant       - The quantization of the 16-bit depth maps, indexed by view (may be NULL for floating-point maps).
  * @param K			        - The container holding the intrinsics for each camera view.
- * @param P			        - The container holding the extrinsics for each cmaera view.
- * @param views			    - The container holding the supporting views for the current view.
- * 				                This is a 2D vector with 'total_views' rows and 'num_views' columns.
- * 				                For example: if we are fusing view #5, 
- * 				                then views[5] is a list of the best supporting views to fuse for view #5.
- * @param index			    - The current view we are fusing.
- * @param data_path		    - The path to the root folder for our data. Used to store the point clouds after fusion.
+ * @param P			        - The container holding the extrinsics for each camera view.
+ * @param views			    - The container holding the supporting views for each reference view.
+ * @param index			    - The reference view.
  * @param conf_pre_filt     - The pre-fusion confidence filter.
- * 				                Pixels with confidence less than this value will not be considered for fusion consensus.
- * @param conf_post_filt    - The post-fusion confidence filter.
- * 				                Pixels with confidence less than this value will become 'holes' in the output fusion map.
- * @param support_ratio		    - The support ratio used to assess whether a depth supports the initial depth estimate.
- * 				                This value is a decimal value indicating the ratio between the support region and the current depth estimate.
- * 				                For example: DTU depth values range from about [450mm-950mm], so a value of 0.01 would produce support regions [4.5mm-9.5mm].
+ * 				                Pixels with confidence less than this value are not rendered.
+ * @param render_tile       - The tile size of the tiled renderer (0 scatters every sample straight into the z-buffer).
+ * @param cache             - The cache of back-projected supporting views (NULL renders every supporting view from its pixels).
+ * @param depth_refs        - The container to be populated with the rendered depth maps, in the order of views[index].
+ * @param conf_refs         - The container to be populated with the rendered confidence maps, in the order of views[index].
+ * @param stats             - The statistics to be updated with the render time and counters (may be NULL).
+ * @param scratch           - The buffers to render into, reused if they fit (NULL allocates new buffers).
  *
  */
-void confidence_fusion(
+void render_views(
 		const vector<Mat> &depth_maps,
-		Mat &fused_map,
 		const vector<Mat> &conf_maps,
-		Mat &fused_conf,
-		const vector<Mat> &images,
+		const vector<DepthQuant> *depth_quant,
 		const vector<Mat> &K,
 		const vector<Mat> &P,
 		const vector<vector<int>> &views,
 		const int index,
-		const string data_path,
 		const float conf_pre_filt,
-		const float conf_post_filt,
-		const float support_ratio)
+		const int render_tile,
+		RenderCache *cache,
+		vector<Mat> &depth_refs,
+		vector<Mat> &conf_refs,
+		ViewStats *stats,
+		FusionScratch *scratch)
 {
-    int num_views = views[index].size();
-    Size size = depth_maps[0].size();
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    ViewStats counts;
+    Size size = depth_maps[index].size();
 
     //cout << "\tRendering depth maps into reference view..." << endl;
-    // calculate reference camera center
-    Mat R_ref = P[index](Rect(0,0,3,3));
-    Mat t_ref = P[index](Rect(3,0,1,3));
-    Mat C_ref = -R_ref.t()*t_ref;
+    depth_refs.clear();
+    conf_refs.clear();
+
+    // the rendered views are planes of a single view-major stack, so that the consensus
+    // kernels read the same pixels of every view with unit stride
+    const int num_views = views[index].size();
+    FusionScratch local;
+    FusionScratch &buffers = (scratch != NULL) ? *scratch : local;
+    if (buffers.depth_stack.rows != num_views*size.height || buffers.depth_stack.cols != size.width) {
+        buffers.depth_stack.create(num_views*size.height, size.width, CV_32F);
+        buffers.conf_stack.create(num_views*size.height, size.width, CV_32F);
+        buffers.allocations += 2;
+    }
 
-    vector<Mat> depth_refs;
-    vector<Mat> conf_refs;
-    const int rows = size.height;
-    const int cols = size.width;
+    // depth buffer shared by the supporting views, cleared before each one is rendered
+    if (!buffers.zbuffer || buffers.zbuffer->get_size() != size) {
+        buffers.zbuffer.reset(new ZBuffer(size));
+        ++buffers.allocations;
+    }
+    ZBuffer &zbuffer = *buffers.zbuffer;
 
     // for each supporting view of the current index (reference view)
-    for (auto d : views[index]) {
-		if(d == index) {
-			// push the current view
-			depth_refs.push_back(depth_maps[index]);
-			conf_refs.push_back(conf_maps[index]);
-			continue;
-		}
-        Mat depth_ref = Mat::zeros(size, CV_32F);
-        Mat conf_ref = Mat::zeros(size, CV_32F);
-
-#pragma omp parallel num_threads(12)
-{
-        #pragma omp for collapse(2)
-        for (int r=0; r<rows; ++r) {
-            for (int c=0; c<cols; ++c) {
-                float depth = depth_maps[d].at<float>(r,c);
-                float conf = conf_maps[d].at<float>(r,c);
-
-                if(conf < conf_pre_filt) {
-                    continue;
-                }
+    for (int i=0; i<num_views; ++i) {
+        const int d = views[index][i];
+        Mat depth_ref = buffers.depth_stack.rowRange(i*size.height, (i+1)*size.height);
+        Mat conf_ref = buffers.conf_stack.rowRange(i*size.height, (i+1)*size.height);
 
-                // compute 3D world coord of back projection
-                Mat x_1(4,1,CV_32F);
-                x_1.at<float>(0,0) = depth * c;
-                x_1.at<float>(1,0) = depth * r;
-                x_1.at<float>(2,0) = depth;
-                x_1.at<float>(3,0) = 1;
-
-                Mat cam_coords = K[d].inv() * x_1;
-                Mat X_world = P[d].inv() * cam_coords;
-                X_world.at<float>(0,0) = X_world.at<float>(0,0) / X_world.at<float>(0,3);
-                X_world.at<float>(0,1) = X_world.at<float>(0,1) / X_world.at<float>(0,3);
-                X_world.at<float>(0,2) = X_world.at<float>(0,2) / X_world.at<float>(0,3);
-                X_world.at<float>(0,3) = X_world.at<float>(0,3) / X_world.at<float>(0,3);
-
-                // calculate pixel location in reference image
-                Mat x_2 = K[index] * P[index] * X_world;
-
-                x_2.at<float>(0,0) = x_2.at<float>(0,0)/x_2.at<float>(2,0);
-                x_2.at<float>(1,0) = x_2.at<float>(1,0)/x_2.at<float>(2,0);
-                x_2.at<float>(2,0) = x_2.at<float>(2,0)/x_2.at<float>(2,0);
-
-                // take the floor to get the row and column pixel locations
-                int c_p = (int) floor(x_2.at<float>(0,0));
-                int r_p = (int) floor(x_2.at<float>(1,0));
-                
-                // ignore if pixel projection falls outside the image
-                if (c_p < 0 || c_p >= size.width || r_p < 0 || r_p >= size.height) {
-                    continue;
-                }
-
-                // calculate the projection depth from reference image plane
-                Mat diff = Mat::zeros(3,1,CV_32F);
-                diff.at<float>(0,0) = X_world.at<float>(0,0) - C_ref.at<float>(0,0);
-                diff.at<float>(0,1) = X_world.at<float>(0,1) - C_ref.at<float>(0,1);
-                diff.at<float>(0,2) = X_world.at<float>(0,2) - C_ref.at<float>(0,2);
-                diff=R_ref*diff;
-
-                float proj_depth = diff.at<float>(0,2);
-
-                /* 
-                 * Keep the closer (smaller) projection depth.
-                 * A previous projection could have already populated the current pixel.
-                 * If it is 0, no previous projection to this pixel was seen.
-                 * Otherwise, we need to overwrite only if the current estimate is closer (smaller value).
-                 */
-                if (depth_ref.at<float>(r_p,c_p) > 0) {
-                    if(depth_ref.at<float>(r_p,c_p) > proj_depth) {
-                        depth_ref.at<float>(r_p,c_p) = proj_depth;
-                        conf_ref.at<float>(r_p,c_p) = conf;
-                    }
+		if(d == index) {
+			// copy the current view (widened if it is held in reduced precision)
+			widen_map(depth_maps[index], view_quant(depth_quant, index), depth_ref);
+			widen_map(conf_maps[index], NULL, conf_ref);
+		} else {
+            zbuffer.clear();
+
+            if (cache != NULL) {
+                // render the cached world points of the supporting view
+                shared_ptr<const SourcePoints> source = cache->acquire(d, depth_maps[d], conf_maps[d], view_quant(depth_quant, d), K[d], P[d], conf_pre_filt);
+                counts.source_pixels += (size_t) depth_maps[d].total();
+                counts.pre_filtered += (size_t) depth_maps[d].total() - source->points.size();
+
+                if (render_tile > 0) {
+                    render_points_tiled(*source, projection_transform(K[index], P[index]), render_tile, zbuffer, counts, buffers.bins);
                 } else {
-                    depth_ref.at<float>(r_p,c_p) = proj_depth;
-                    conf_ref.at<float>(r_p,c_p) = conf;
+                    render_points(*source, projection_transform(K[index], P[index]), zbuffer, counts);
                 }
+            } else if (render_tile > 0) {
+                // render the supporting view from its pixels, binned by reference tile
+                render_pixels_tiled(depth_maps[d], conf_maps[d], view_quant(depth_quant, d), reprojection_transform(K[d], P[d], K[index], P[index]), conf_pre_filt, render_tile, zbuffer, counts, buffers.bins);
+            } else {
+                // render the supporting view directly from its pixels
+                render_pixels(depth_maps[d], conf_maps[d], view_quant(depth_quant, d), reprojection_transform(K[d], P[d], K[index], P[index]), conf_pre_filt, zbuffer, counts);
             }
+
+            // resolve straight into the plane of the stack
+            zbuffer.resolve(depth_ref, conf_ref);
         }
-} //omp parallel
 
         depth_refs.push_back(depth_ref);
         conf_refs.push_back(conf_ref);
     }
 
-    // Fuse depth maps
-    float f;
-    float initial_f;
-    float C;
-    int initial_d;
+    if (stats != NULL) {
+        counts.render_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        stats->add(counts);
+    }
+}
 
-    //cout << "\tFusing depth maps..." << endl;
+/*
+ * @brief Builds the ray tables of the transforms between every ordered pair of supporting views
+ *
+ * The tables hold, for every pair, the column and row terms of the ray of each pixel, so that
+ * a pixel is reprojected with three additions and three multiply-adds instead of the full
+ * 3x4 transform. Pairs of a view with itself are never used and are left empty.
+ *
+ * @param pair_T        - The 3x4 row-major transforms ([i*num_views+j]*12)
+ * @param num_views     - The number of supporting views
+ * @param rows          - The number of rows of the reference view
+ * @param cols          - The number of columns of the reference view
+ * @param tables        - The tables to be populated
+ *
+ */
+static void build_ray_tables(const float *pair_T, const int num_views, const int rows, const int cols, RayTables *tables) {
+    const int num_pairs = num_views*num_views;
 
-    for (int r=0; r<rows; ++r) {
-        for (int c=0; c<cols; ++c) {
-            f = 0.0;
-            initial_f = 0.0;
-            C = 0.0;
-            initial_d = 0;
-
-            // take most confident pixel as initial depth estimate
-			for (int d=0; d<num_views; ++d) {
-                if (conf_refs[d].at<float>(r,c) > C) {
-                    f = depth_refs[d].at<float>(r,c);
-                    C = conf_refs[d].at<float>(r,c);
-                    initial_f = f;
-                    initial_d = d;
-                }
-            }
+    tables->col_terms.assign((size_t) num_pairs*cols*3, 0.0f);
+    tables->row_terms.assign((size_t) num_pairs*rows*3, 0.0f);
+    tables->offsets.assign((size_t) num_pairs*3, 0.0f);
 
-			// get the appropriate absolute index from the views vector
-			int abs_initial_d = views[index][initial_d];
+    for (int i=0; i<num_views; ++i) {
+        for (int j=0; j<num_views; ++j) {
+            if (i == j) {
+                continue;
+            }
 
-            // Set support region as fraction of initial depth estimate
-            float epsilon = support_ratio * initial_f;
+            const size_t k = (size_t) i*num_views + j;
+            const Matx34f T(pair_T + k*12);
+            float *col_terms = &tables->col_terms[k*cols*3];
+            float *row_terms = &tables->row_terms[k*rows*3];
 
-			for (int d=0; d<num_views; ++d) {
-                // skip computation if this iteration is the initial depth map
-                if (d == initial_d) {
-                    continue;
+            for (int c=0; c<cols; ++c) {
+                for (int a=0; a<3; ++a) {
+                    col_terms[c*3 + a] = T(a,0)*c;
                 }
+            }
 
-				// get the appropriate absolute index from the views vector
-				int abs_d = views[index][d];
-
-                // grab current depth and confidence values
-                float curr_depth = depth_refs[d].at<float>(r,c);
-                float curr_conf = conf_refs[d].at<float>(r,c);
-
-                // if confidence is below the threshold, do not have this pixel contribute
-                // TODO: run tests to see how this affects estimation
-                //if (curr_conf < 0.1) {
-                //    continue;
-                //}
-
-                // if depth is within the support region of the initial depth
-                if (abs(curr_depth - initial_f) < epsilon) {
-                    if((C + curr_conf) != 0) {
-                        f = ((f*C) + (curr_depth*curr_conf)) / (C + curr_conf);
-                    }
-                    C += curr_conf;
-                } 
-                // if depth is closer than initial estimate (occlusion)
-                else if(curr_depth < initial_f) {
-                    C -= curr_conf;
-                }
-                // if depth is farther than initial estimate (free-space violation)
-                else if(curr_depth > initial_f) {
-                    // compute 3D world coord of back projection
-                    Mat x_1(4,1,CV_32F);
-                    x_1.at<float>(0,0) = initial_f * c;
-                    x_1.at<float>(1,0) = initial_f * r;
-                    x_1.at<float>(2,0) = initial_f;
-                    x_1.at<float>(3,0) = 1;
-
-                    Mat cam_coords = K[abs_initial_d].inv() * x_1;
-                    Mat X_world = P[abs_initial_d].inv() * cam_coords;
-                    X_world.at<float>(0,0) = X_world.at<float>(0,0) / X_world.at<float>(0,3);
-                    X_world.at<float>(0,1) = X_world.at<float>(0,1) / X_world.at<float>(0,3);
-                    X_world.at<float>(0,2) = X_world.at<float>(0,2) / X_world.at<float>(0,3);
-                    X_world.at<float>(0,3) = X_world.at<float>(0,3) / X_world.at<float>(0,3);
-
-                    // calculate pixel location in reference image
-                    Mat x_2 = K[abs_d] * P[abs_d] * X_world;
-
-                    x_2.at<float>(0,0) = x_2.at<float>(0,0)/x_2.at<float>(2,0);
-                    x_2.at<float>(1,0) = x_2.at<float>(1,0)/x_2.at<float>(2,0);
-                    x_2.at<float>(2,0) = x_2.at<float>(2,0)/x_2.at<float>(2,0);
-
-                    // take the floor to get the row and column pixel locations
-                    int c_p = (int) floor(x_2.at<float>(0,0));
-                    int r_p = (int) floor(x_2.at<float>(1,0));
-                    
-                    // ignore if pixel projection falls outside the image
-                    if (c_p >= 0 && c_p < size.width && r_p >= 0 && r_p < size.height) {
-                        C -= conf_maps[abs_d].at<float>(r_p,c_p);
-                    }
+            for (int r=0; r<rows; ++r) {
+                for (int a=0; a<3; ++a) {
+                    row_terms[r*3 + a] = T(a,1)*r + T(a,2);
                 }
             }
 
-            // bound confidence to interval (0-1)
-            // 5 views could all have max contributions 1.0/-1.0, making the max value of C = 5.0/-5.0 for the given pixel
-            // TODO: could be a better way to squeeze the confidence value to avoid the effect of outliers... Sigmoid?
-            C += num_views;
-            C /= (2*num_views);
+            for (int a=0; a<3; ++a) {
+                tables->offsets[k*3 + a] = T(a,3);
+            }
+        }
+    }
+}
+
+/*
+ * @brief Fuses the rendered supporting views of a reference view (confidence-based consensus)
+ *
+ * @param depth_refs        - The rendered depth maps, in the order of views[index].
+ * @param conf_refs         - The rendered confidence maps, in the order of views[index].
+ * @param conf_maps 	    - The container (indexed by view) holding the confidence maps of the supporting views.
+ * 				                Used by the free-space violation check (widened first if held in reduced precision).
+ * @param K			        - The container holding the intrinsics for each camera view.
+ * @param P			        - The container holding the extrinsics for each camera view.
+ * @param views			    - The container holding the supporting views for each reference view.
+ * @param index			    - The reference view.
+ * @param conf_post_filt    - The post-fusion confidence filter.
+ * 				                Pixels with confidence less than this value will become 'holes' in the output fusion map.
+ * @param support_ratio		- The support ratio used to assess whether a depth supports the initial depth estimate.
+ * @param fused_map		    - The reference to the output fused depth map.
+ * @param fused_conf	    - The reference to the output fused confidence map.
+ * @param stats             - The statistics to be updated with the consensus time and counters (may be NULL).
+ * @param scratch           - The buffers of the pair transforms, ray tables and widened confidence maps, reused if they fit (may be NULL).
+ *
+ */
+void fuse_views(
+		const vector<Mat> &depth_refs,
+		const vector<Mat> &conf_refs,
+		const vector<Mat> &conf_maps,
+		const vector<Mat> &K,
+		const vector<Mat> &P,
+		const vector<vector<int>> &views,
+		const int index,
+		const float conf_post_filt,
+		const float support_ratio,
+		Mat &fused_map,
+		Mat &fused_conf,
+		ViewStats *stats,
+		FusionScratch *scratch)
+{
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int num_views = views[index].size();
+    Size size = depth_refs[0].size();
+    const int rows = size.height;
+    const int cols = size.width;
+
+    FusionScratch local;
+    FusionScratch &buffers = (scratch != NULL) ? *scratch : local;
 
-            // drop any estimates that do not meet the minimum confidence value
-            if (C <= conf_post_filt) {
-                //f = -1.0;
-                C = -1.0;
+    // transforms between every ordered pair of views, used by the free-space violation check
+    vector<Matx34f> &pair_T = buffers.pair_T;
+    pair_T.resize(num_views*num_views);
+    for (int i=0; i<num_views; ++i) {
+        for (int j=0; j<num_views; ++j) {
+            if (i == j) {
+                continue;
             }
+            int abs_i = views[index][i];
+            int abs_j = views[index][j];
+            pair_T[i*num_views + j] = reprojection_transform(K[abs_i], P[abs_i], K[abs_j], P[abs_j]);
+        }
+    }
 
-            // set the values for the confidence and depth estimates at the current pixel
-            fused_map.at<float>(r,c) = f;
-            fused_conf.at<float>(r,c) = C;
+    // per-pair ray tables, so that each free-space check is a few multiply-adds and one lookup
+    RayTables &rays = buffers.rays;
+    build_ray_tables(pair_T[0].val, num_views, rows, cols, &rays);
+
+    // the rendered views as a view-major stack (already stacked when they come from render_views)
+    Mat depth_stack = stack_views(depth_refs, size);
+    Mat conf_stack = stack_views(conf_refs, size);
+
+    // original confidence maps of the supporting views, used by the free-space violation check;
+    // the kernels gather from them at random, so maps held in reduced precision are widened first
+    vector<const float *> support_conf(num_views);
+    for (int d=0; d<num_views; ++d) {
+        const Mat &conf_map = conf_maps[views[index][d]];
+
+        if (conf_map.type() == CV_32F) {
+            support_conf[d] = conf_map.ptr<float>(0);
+            continue;
         }
+
+        if (buffers.support_conf.rows != num_views*rows || buffers.support_conf.cols != cols) {
+            buffers.support_conf.create(num_views*rows, cols, CV_32F);
+            ++buffers.allocations;
+        }
+        Mat plane = buffers.support_conf.rowRange(d*rows, (d+1)*rows);
+        widen_map(conf_map, NULL, plane);
+        support_conf[d] = plane.ptr<float>(0);
+    }
+
+    fused_map.create(size, CV_32F);
+    fused_conf.create(size, CV_32F);
+
+    ConsensusArgs args;
+    args.depth = depth_stack.ptr<float>(0);
+    args.conf = conf_stack.ptr<float>(0);
+    args.plane = (size_t) rows*cols;
+    args.num_views = num_views;
+    args.rows = rows;
+    args.cols = cols;
+    args.support_ratio = support_ratio;
+    args.support_conf = support_conf.data();
+    args.col_terms = rays.col_terms.data();
+    args.row_terms = rays.row_terms.data();
+    args.offsets = rays.offsets.data();
+    args.fused_map = fused_map.ptr<float>(0);
+    args.fused_conf = fused_conf.ptr<float>(0);
+
+    // scalar, AVX2 or AVX-512 kernel, selected at startup
+    const ConsensusKernel kernel = consensus_kernel();
+
+    // Fuse depth maps
+    //cout << "\tFusing depth maps..." << endl;
+
+    // split the reference view into tiles; the cost of a tile depends on how many
+    // free-space violations it holds, so tiles are handed out dynamically
+    const int tile_rows = (rows + FUSION_TILE_SIZE - 1) / FUSION_TILE_SIZE;
+    const int tile_cols = (cols + FUSION_TILE_SIZE - 1) / FUSION_TILE_SIZE;
+    const int num_tiles = tile_rows * tile_cols;
+
+    size_t support_votes = 0;
+    size_t occlusion_votes = 0;
+    size_t free_space_votes = 0;
+
+#pragma omp parallel for schedule(dynamic) reduction(+:support_votes,occlusion_votes,free_space_votes)
+    for (int t=0; t<num_tiles; ++t) {
+        const int r_start = (t / tile_cols) * FUSION_TILE_SIZE;
+        const int c_start = (t % tile_cols) * FUSION_TILE_SIZE;
+        const int r_end = min(r_start + FUSION_TILE_SIZE, rows);
+        const int c_end = min(c_start + FUSION_TILE_SIZE, cols);
+        ConsensusCounts counts;
+
+        for (int r=r_start; r<r_end; ++r) {
+            kernel(args, r, c_start, c_end, counts);
+        }
+
+        support_votes += counts.support;
+        occlusion_votes += counts.occlusion;
+        free_space_votes += counts.free_space;
+    }
+
+    chrono::steady_clock::time_point post_start = chrono::steady_clock::now();
+
+    // drop any estimates that do not meet the minimum confidence value
+    size_t post_filtered = 0;
+
+#pragma omp parallel for reduction(+:post_filtered)
+    for (int r=0; r<rows; ++r) {
+        float *conf_row = fused_conf.ptr<float>(r);
+
+        for (int c=0; c<cols; ++c) {
+            if (conf_row[c] <= conf_post_filt) {
+                //fused_map.at<float>(r,c) = -1.0;
+                conf_row[c] = -1.0;
+                ++post_filtered;
+            }
+        }
+    }
+
+    if (stats != NULL) {
+        chrono::steady_clock::time_point end = chrono::steady_clock::now();
+
+        stats->consensus_sec += chrono::duration<double>(post_start - start).count();
+        stats->post_filter_sec += chrono::duration<double>(end - post_start).count();
+        stats->support_votes += support_votes;
+        stats->occlusion_votes += occlusion_votes;
+        stats->free_space_votes += free_space_votes;
+        stats->post_filtered += post_filtered;
+        stats->fused_pixels += (size_t) rows*cols - post_filtered;
     }
 
     //	// hole-filling parameters
@@ -299,105 +561,60 @@ void confidence_fusion(
     //	}
 
     //	fused_map = smoothed_map;
+}
+
+/*
+ * @brief Performs depth map fusion using the confidence-based notion of a depth estimate
+ *
+ * @param depth_maps        - The container holding the depth maps to be fused.
+ * @param fused_map		    - The reference to the output fused depth map.
+ * @param conf_maps 	    - The container holding the confidence maps needed for the fusion process.
+ * @param fused_conf	    - The reference to the output fused confidence map.
+ * @param K			        - The container holding the intrinsics for each camera view.
+ * @param P			        - The container holding the extrinsics for each cmaera view.
+ * @param views			    - The container holding the supporting views for the current view.
+ * 				                This is a 2D vector with 'total_views' rows and 'num_views' columns.
+ * 				                For example: if we are fusing view #5, 
+ * 				                then views[5] is a list of the best supporting views to fuse for view #5.
+ * @param index			    - The current view we are fusing.
+ * @param data_path		    - The path to the root folder for our data. Used to store the point clouds after fusion.
+ * @param conf_pre_filt     - The pre-fusion confidence filter.
+ * 				                Pixels with confidence less than this value will not be considered for fusion consensus.
+ * @param conf_post_filt    - The post-fusion confidence filter.
+ * 				                Pixels with confidence less than this value will become 'holes' in the output fusion map.
+ * @param support_ratio		    - The support ratio used to assess whether a depth supports the initial depth estimate.
+ * 				                This value is a decimal value indicating the ratio between the support region and the current depth estimate.
+ * 				                For example: DTU depth values range from about [450mm-950mm], so a value of 0.01 would produce support regions [4.5mm-9.5mm].
+ * @param cache             - The cache of back-projected supporting views (NULL renders every supporting view from its pixels).
+ *
+ */
+void confidence_fusion(
+		const vector<Mat> &depth_maps,
+		Mat &fused_map,
+		const vector<Mat> &conf_maps,
+		Mat &fused_conf,
+		const vector<Mat> &images,
+		const vector<Mat> &K,
+		const vector<Mat> &P,
+		const vector<vector<int>> &views,
+		const int index,
+		const string data_path,
+		const float conf_pre_filt,
+		const float conf_post_filt,
+		const float support_ratio,
+		RenderCache *cache)
+{
+    vector<Mat> depth_refs;
+    vector<Mat> conf_refs;
+
+    render_views(depth_maps, conf_maps, NULL, K, P, views, index, conf_pre_filt, 0, cache, depth_refs, conf_refs, NULL, NULL);
+    fuse_views(depth_refs, conf_refs, conf_maps, K, P, views, index, conf_post_filt, support_ratio, fused_map, fused_conf, NULL, NULL);
 
 	// pad the index string for filenames
 	std::string index_str = to_string(index);
 	pad(index_str, 4, '0');
 
 	// write ply files
-	//write_ply(fused_map, K[index], P[index], data_path+"post_fusion_points/" + index_str + "_points.ply", images[index]);
-	//write_ply(depth_maps[index], K[index], P[index], data_path+"pre_fusion_points/" + index_str + "_points.ply", images[index]);
-}
-
-int main(int argc, char **argv) {
-    // check for proper command-line usage
-    if (argc != 8) {
-        fprintf(stderr, "Error: usage %s <data-root-path> <output-path> <scene> <num-views> <conf-pre-filt> <conf-post-filt> <epsilon>\n", argv[0]);
-        exit(EXIT_FAILURE);
-    }
-
-    // read in command-line args
-    string data_path = argv[1];
-    string output_path = argv[2];
-	string scene = argv[3];
-    int num_views = atoi(argv[4]);
-    float conf_pre_filt = atof(argv[5]);
-    float conf_post_filt = atof(argv[6]);
-    float support_ratio = atof(argv[7]);
-
-    size_t str_len = data_path.length();
-
-    // string formatting to add '/' to data_path if it is missing from the input
-    if (data_path[str_len-1] != '/') {
-        data_path += "/";
-    }
-    if (output_path[str_len-1] != '/') {
-        output_path += "/";
-    }
-	string depth_path = data_path + "Depths/" + scene + "/";
-	string conf_path = data_path + "Confs/" + scene + "/";
-	string cam_path = data_path + "Cameras/";
-
-	string out_depth_path = output_path + "depths/";
-	string out_conf_path = output_path + "confs/";
-    
-    vector<Mat> depth_maps;
-    vector<Mat> conf_maps;
-    vector<Mat> images;
-    vector<Mat> K;
-    vector<Mat> P;
-    Bounds bounds;
-    vector<vector<int>> views;
-    
-    // load maps, views, K's, P's, bounds
-    printf("Loading data...\n");
-    load_depth_maps(&depth_maps, depth_path);
-    load_conf_maps(&conf_maps, conf_path);
-	//load_images(&images, img_path);
-    load_views(&views, num_views, cam_path);
-    load_camera_params(&K, &P, &bounds, cam_path);
-
-    int depth_map_count = depth_maps.size();
-    Size size = depth_maps[0].size();
-
-    // create containers to be populated with fusion output
-    Mat fused_map = Mat::zeros(size, CV_32F);
-    Mat fused_conf = Mat::zeros(size, CV_32F);
-
-    // starting and ending index used to select which views to produce fused maps for (default is all views).
-    int start_ind = 0;
-    int end_ind = depth_map_count;
-
-    for (int i=start_ind; i<end_ind; ++i) {
-        //printf("Running confidence-based fusion for depth map %d/%d...\n",(i+1)-start_ind,end_ind-start_ind);
-
-        confidence_fusion(
-                depth_maps,
-		        fused_map,
-        		conf_maps,
-		        fused_conf,
-				images,
-	            K,
-	            P,
-	            views,
-	            i,
-	            data_path,
-	            conf_pre_filt,
-	            conf_post_filt,
-	            support_ratio);
-
-        // pad the index string for filenames
-        std::string index_str = to_string(i);
-        pad(index_str, 8, '0');
-
-	    // save the depth and confidence map outputs in .pfm format
-        save_pfm(fused_map, out_depth_path + index_str + "_depth.pfm");
-        save_pfm(fused_conf, out_conf_path + index_str + "_conf.pfm");
-
-        // save the depth and confidence map outputs in .png output for visual display
-        display_depth(fused_map, out_depth_path + index_str + "_depth_disp.png");
-        display_conf(fused_conf, out_conf_path + index_str + "_conf_disp.png");
-    }
-
-    return EXIT_SUCCESS;
+	//write_ply(fused_map, K[index], P[index], data_path+"post_fusion_points/" + index_str + "_points.ply", images[index], Mat());
+	//write_ply(depth_maps[index], K[index], P[index], data_path+"pre_fusion_points/" + index_str + "_points.ply", images[index], Mat());
 }
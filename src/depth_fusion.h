@@ -1,11 +1,59 @@
 #ifndef _DEPTH_FUSION_H_
 #define _DEPTH_FUSION_H_
 
+#include "opencv2/core/core.hpp"
+
+#include <memory>
+#include <string>
 #include <vector>
 
-using namespace std;
-using namespace cv;
+#include "consensus.h"
+#include "zbuffer.h"
+#include "tiled_render.h"
+#include "map_precision.h"
+
+
+class RenderCache;
+struct ViewStats;
+
+// structure to hold the fusion parameters shared by every reference view
+struct FusionParams {
+    float conf_pre_filt;
+    float conf_post_filt;
+    float support_ratio;
+    int render_tile;            // tile size of the tiled renderer (0 = scatter every sample straight into the z-buffer)
+};
+
+// structure to hold the separable ray tables of every ordered pair of supporting views
+//
+// The pair transform T maps the homogeneous point (c*f, r*f, f, 1) to f*ray(c,r) + T(:,3), where
+// ray(c,r) = T(:,0)*c + T(:,1)*r + T(:,2) is split into a column term and a row term.
+struct RayTables {
+    std::vector<float> col_terms;   // [pair][col][3]: T(:,0)*c
+    std::vector<float> row_terms;   // [pair][row][3]: T(:,1)*r + T(:,2)
+    std::vector<float> offsets;     // [pair][3]: T(:,3)
+};
+
+// structure to hold the scratch buffers of the render and consensus passes, so that they can be
+// reused across reference views of the same size (the rendered views live in the stacks until
+// the next render_views call with the same scratch)
+struct FusionScratch {
+    cv::Mat depth_stack;
+    cv::Mat conf_stack;
+    cv::Mat support_conf;       // confidence maps of the supporting views widened from reduced precision
+    std::unique_ptr<ZBuffer> zbuffer;
+    std::vector<cv::Matx34f> pair_T;
+    RayTables rays;
+    RenderBins bins;
+    size_t allocations = 0;     // stacks and z-buffers (re)allocated in this scratch
+
+    size_t bytes() const;
+};
+
+// fusion stages
+void render_views(const std::vector<cv::Mat> &depth_maps, const std::vector<cv::Mat> &conf_maps, const std::vector<DepthQuant> *depth_quant, const std::vector<cv::Mat> &K, const std::vector<cv::Mat> &P, const std::vector<std::vector<int>> &views, const int index, const float conf_pre_filt, const int render_tile, RenderCache *cache, std::vector<cv::Mat> &depth_refs, std::vector<cv::Mat> &conf_refs, ViewStats *stats, FusionScratch *scratch);
+void fuse_views(const std::vector<cv::Mat> &depth_refs, const std::vector<cv::Mat> &conf_refs, const std::vector<cv::Mat> &conf_maps, const std::vector<cv::Mat> &K, const std::vector<cv::Mat> &P, const std::vector<std::vector<int>> &views, const int index, const float conf_post_filt, const float support_ratio, cv::Mat &fused_map, cv::Mat &fused_conf, ViewStats *stats, FusionScratch *scratch);
 
-void confidence_fusion(const vector<Mat> &depth_maps, Mat &fused_map, const vector<Mat> &conf_maps, Mat &fused_conf, const vector<Mat> &images, const vector<Mat> &K, const vector<Mat> &P, const vector<vector<int>> &views, const int index, const string data_path);
+void confidence_fusion(const std::vector<cv::Mat> &depth_maps, cv::Mat &fused_map, const std::vector<cv::Mat> &conf_maps, cv::Mat &fused_conf, const std::vector<cv::Mat> &images, const std::vector<cv::Mat> &K, const std::vector<cv::Mat> &P, const std::vector<std::vector<int>> &views, const int index, const std::string data_path, const float conf_pre_filt, const float conf_post_filt, const float support_ratio, RenderCache *cache);
 
 #endif
@@ -0,0 +1,80 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <vector>
+
+#include <confusion/fusion_engine.h>
+
+// the names of the example shadow cv::Size and cv::Mat; the installed headers must not bring
+// either namespace into scope, or these uses become ambiguous
+struct Size {
+    int rows;
+    int cols;
+};
+
+struct Mat {
+    std::vector<float> data;
+};
+
+/*
+ * @brief Fuses a view with two supporting views seen from the same camera, from plain buffers
+ *
+ * Every view holds a fronto-parallel plane at the same depth, so the fused depth map must hold
+ * that depth wherever the post-filter keeps a pixel.
+ *
+ */
+int main() {
+    const Size size = { 48, 64 };
+    const float depth = 500.0f;
+    const int total_views = 3;
+
+    // 4x4 row-major cameras, as in the camera files
+    const float K[16] = {
+        80.0f, 0.0f, 32.0f, 0.0f,
+        0.0f, 80.0f, 24.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f };
+    const float P[16] = {
+        1.0f, 0.0f, 0.0f, 0.0f,
+        0.0f, 1.0f, 0.0f, 0.0f,
+        0.0f, 0.0f, 1.0f, 0.0f,
+        0.0f, 0.0f, 0.0f, 1.0f };
+
+    std::vector<Mat> depth_maps(total_views);
+    std::vector<Mat> conf_maps(total_views);
+
+    FusionParams params = { 0.1f, 0.5f, 0.01f, 64 };
+    FusionEngine engine(params, size.rows, size.cols);
+
+    for (int v=0; v<total_views; ++v) {
+        depth_maps[v].data.assign(size.rows * size.cols, depth);
+        conf_maps[v].data.assign(size.rows * size.cols, 0.9f);
+
+        if (!engine.set_view(v, depth_maps[v].data.data(), conf_maps[v].data.data(), K, P)) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    Mat fused_depth;
+    Mat fused_conf;
+    fused_depth.data.resize(size.rows * size.cols);
+    fused_conf.data.resize(size.rows * size.cols);
+
+    const std::vector<int> support = { 1, 2 };
+    if (!engine.fuse(0, support, fused_depth.data.data(), fused_conf.data.data(), NULL)) {
+        return EXIT_FAILURE;
+    }
+
+    size_t kept = 0;
+    float max_error = 0.0f;
+    for (size_t i=0; i<fused_depth.data.size(); ++i) {
+        if (fused_depth.data[i] > 0.0f) {
+            ++kept;
+            max_error = fmax(max_error, fabs(fused_depth.data[i] - depth));
+        }
+    }
+
+    printf("Fused %zu of %zu pixels, largest depth error %g\n", kept, fused_depth.data.size(), max_error);
+
+    return (kept > 0 && max_error < 1e-3f * depth) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,630 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <ftw.h>
+#include <sys/resource.h>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <omp.h>
+
+#include "util.h"
+#include "depth_fusion.h"
+#include "consensus.h"
+#include "scene_loader.h"
+#include "synthetic_scene.h"
+#include "ply_writer.h"
+#include "map_precision.h"
+
+// structure to hold the configuration of a benchmark run
+struct BenchOptions {
+    SyntheticSceneParams scene;
+    int num_views;          // views fused per reference view (including the reference view)
+    int reps;               // repetitions of every stage (the fastest is reported)
+    int num_threads;        // OpenMP threads (0 = all available cores)
+    int render_tile;        // tile size of the tiled render stage
+    float conf_pre_filt;
+    float conf_post_filt;
+    float support_ratio;
+    string dir;             // where the scene is written (empty = temporary directory)
+    string json_path;       // where the results are written as JSON (empty = none, '-' = stdout)
+    bool generate_only;     // only write the scene (for runs of depth_fusion on it)
+};
+
+// structure to hold the error of fusing from maps held in reduced precision
+struct PrecisionResult {
+    string name;
+    double map_mb;              // memory held by the maps of every view
+    PrecisionError encode;      // error of the reduced-precision maps
+    double depth_diff_mean;     // fused depth difference, where both fusions produced a depth
+    float depth_diff_max;
+    double changed_pct;         // fused pixels that gained or lost their depth
+};
+
+// largest difference between the outputs of a SIMD kernel and of the scalar kernel, relative
+// to the scalar output (the kernels carry out the same operations, so they should match exactly)
+#define KERNEL_TOLERANCE 1e-5f
+
+// structure to hold the difference between the outputs of a consensus kernel and of the scalar kernel
+struct KernelResult {
+    string name;
+    int width;
+    int height;
+    float depth_diff_max;       // largest fused depth difference
+    float conf_diff_max;        // largest fused confidence difference
+    size_t changed;             // pixels whose fused depth or confidence differs beyond KERNEL_TOLERANCE
+};
+
+// structure to hold the measurements of a single stage
+struct StageResult {
+    string name;
+    int reps;
+    double min_sec;
+    double mean_sec;
+    double pixels;          // pixels processed by one repetition
+    double rss_mb;          // resident memory after the stage
+    double peak_rss_mb;     // peak resident memory of the process so far
+};
+
+/*
+ * @brief Prints the command-line usage and exits
+ *
+ * @param exe           - The name of the executable
+ *
+ */
+static void usage(const char *exe) {
+    fprintf(stderr, "Error: usage %s [options]\n", exe);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --width <n>          width of the synthetic views (default: 640)\n");
+    fprintf(stderr, "  --height <n>         height of the synthetic views (default: 512)\n");
+    fprintf(stderr, "  --views <n>          number of views in the synthetic scene (default: 16)\n");
+    fprintf(stderr, "  --num-views <n>      views fused per reference view, including it (default: 5)\n");
+    fprintf(stderr, "  --reps <n>           repetitions of every stage (default: 3)\n");
+    fprintf(stderr, "  --threads <n>        number of threads (default: all cores)\n");
+    fprintf(stderr, "  --render-tile <px>   tile size of the tiled render stage (default: 64)\n");
+    fprintf(stderr, "  --seed <n>           seed of the synthetic scene (default: 1)\n");
+    fprintf(stderr, "  --dir <path>         directory the scene is written to (default: a temporary directory, removed afterwards)\n");
+    fprintf(stderr, "  --json <path>        write the results as JSON to the file ('-' for stdout)\n");
+    fprintf(stderr, "  --generate-only      only write the scene (requires --dir)\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * @brief Parses the command-line arguments of a benchmark run
+ *
+ * @param argc          - The number of command-line arguments
+ * @param argv          - The command-line arguments
+ * @param opts          - The container to be populated with the parsed options
+ *
+ */
+static void parse_bench_options(int argc, char **argv, BenchOptions *opts) {
+    opts->scene = default_scene_params();
+    opts->num_views = 5;
+    opts->reps = 3;
+    opts->num_threads = 0;
+    opts->render_tile = 64;
+    opts->conf_pre_filt = 0.1f;
+    opts->conf_post_filt = 0.8f;
+    opts->support_ratio = 0.01f;
+    opts->generate_only = false;
+
+    for (int i=1; i<argc; ++i) {
+        if (strcmp(argv[i], "--width") == 0 && i+1 < argc) {
+            opts->scene.width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--height") == 0 && i+1 < argc) {
+            opts->scene.height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--views") == 0 && i+1 < argc) {
+            opts->scene.total_views = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--num-views") == 0 && i+1 < argc) {
+            opts->num_views = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--reps") == 0 && i+1 < argc) {
+            opts->reps = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            opts->num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render-tile") == 0 && i+1 < argc) {
+            opts->render_tile = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seed") == 0 && i+1 < argc) {
+            opts->scene.seed = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--dir") == 0 && i+1 < argc) {
+            opts->dir = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i+1 < argc) {
+            opts->json_path = argv[++i];
+        } else if (strcmp(argv[i], "--generate-only") == 0) {
+            opts->generate_only = true;
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", argv[i]);
+            usage(argv[0]);
+        }
+    }
+
+    if (opts->scene.width < 1 || opts->scene.height < 1 || opts->scene.total_views < 2 ||
+            opts->num_views < 2 || opts->num_views > opts->scene.total_views || opts->reps < 1 || opts->num_threads < 0 || opts->render_tile < 1) {
+        fprintf(stderr, "Error: invalid scene size, view count or repetitions.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->generate_only && opts->dir.empty()) {
+        fprintf(stderr, "Error: --generate-only requires --dir.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (!opts->dir.empty() && opts->dir[opts->dir.length()-1] != '/') {
+        opts->dir += "/";
+    }
+
+    // the fused views must be listed in pair.txt
+    opts->scene.pair_views = max(opts->scene.pair_views, opts->num_views - 1);
+}
+
+/*
+ * @brief Returns the current and the peak resident memory of the process (MB)
+ *
+ */
+static void memory_usage(double &rss_mb, double &peak_rss_mb) {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    peak_rss_mb = usage.ru_maxrss / 1024.0;
+
+    long pages = 0;
+    FILE *statm = fopen("/proc/self/statm", "r");
+    if (statm != NULL) {
+        if (fscanf(statm, "%*s %ld", &pages) != 1) {
+            pages = 0;
+        }
+        fclose(statm);
+    }
+    rss_mb = (double) pages * sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+/*
+ * @brief Times a stage over the configured number of repetitions
+ *
+ * @param report        - The stream the measurements are printed to
+ * @param name          - The name of the stage
+ * @param reps          - The number of repetitions
+ * @param pixels        - The number of pixels processed by one repetition
+ * @param stage         - The stage to be timed
+ *
+ * @return Returns the measurements of the stage
+ *
+ */
+template <class Stage>
+static StageResult time_stage(FILE *report, const string name, const int reps, const double pixels, Stage stage) {
+    StageResult result;
+    result.name = name;
+    result.reps = reps;
+    result.pixels = pixels;
+    result.min_sec = 0.0;
+    result.mean_sec = 0.0;
+
+    for (int i=0; i<reps; ++i) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        stage();
+        const double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+        result.min_sec = (i == 0) ? sec : min(result.min_sec, sec);
+        result.mean_sec += sec / reps;
+    }
+
+    memory_usage(result.rss_mb, result.peak_rss_mb);
+
+    fprintf(report, "%-20s %10.4f s %10.4f s %12.2f Mpix/s %10.1f MB %10.1f MB\n",
+            result.name.c_str(), result.min_sec, result.mean_sec, pixels / result.min_sec / 1e6, result.rss_mb, result.peak_rss_mb);
+
+    return result;
+}
+
+/*
+ * @brief Writes the results of a benchmark run as JSON
+ *
+ * @param opts          - The configuration of the run
+ * @param results       - The measurements of every stage
+ * @param kernels       - The differences of every SIMD kernel from the scalar kernel
+ * @param precisions    - The errors of the reduced-precision maps
+ *
+ */
+static void write_json(const BenchOptions &opts, const vector<StageResult> &results, const vector<KernelResult> &kernels, const vector<PrecisionResult> &precisions) {
+    FILE *fp = (opts.json_path == "-") ? stdout : fopen(opts.json_path.c_str(), "w");
+
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not open file %s.\n", opts.json_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    fprintf(fp, "{\n");
+    fprintf(fp, "  \"config\": {\"width\": %d, \"height\": %d, \"views\": %d, \"num_views\": %d, \"reps\": %d, \"threads\": %d, \"kernel\": \"%s\"},\n",
+            opts.scene.width, opts.scene.height, opts.scene.total_views, opts.num_views, opts.reps, omp_get_max_threads(), consensus_kernel_name());
+    fprintf(fp, "  \"stages\": [\n");
+    for (size_t i=0; i<results.size(); ++i) {
+        const StageResult &s = results[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"reps\": %d, \"min_sec\": %.6f, \"mean_sec\": %.6f, \"pixels\": %.0f, \"pixels_per_sec\": %.1f, \"rss_mb\": %.1f, \"peak_rss_mb\": %.1f}%s\n",
+                s.name.c_str(), s.reps, s.min_sec, s.mean_sec, s.pixels, s.pixels / s.min_sec, s.rss_mb, s.peak_rss_mb,
+                (i+1 < results.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"kernels\": [\n");
+    for (size_t i=0; i<kernels.size(); ++i) {
+        const KernelResult &k = kernels[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"width\": %d, \"height\": %d, \"depth_diff_max\": %.6g, \"conf_diff_max\": %.6g, \"changed\": %zu}%s\n",
+                k.name.c_str(), k.width, k.height, k.depth_diff_max, k.conf_diff_max, k.changed,
+                (i+1 < kernels.size()) ? "," : "");
+    }
+    fprintf(fp, "  ],\n");
+    fprintf(fp, "  \"precisions\": [\n");
+    for (size_t i=0; i<precisions.size(); ++i) {
+        const PrecisionResult &p = precisions[i];
+        fprintf(fp, "    {\"name\": \"%s\", \"map_mb\": %.1f, \"depth_error_mean\": %.6g, \"depth_error_max\": %.6g, \"depth_clipped\": %zu, "
+                "\"conf_error_max\": %.6g, \"fused_depth_diff_mean\": %.6g, \"fused_depth_diff_max\": %.6g, \"fused_changed_pct\": %.4f}%s\n",
+                p.name.c_str(), p.map_mb,
+                (p.encode.depth_pixels > 0) ? p.encode.depth_abs_sum / p.encode.depth_pixels : 0.0, p.encode.depth_abs_max, p.encode.clipped,
+                p.encode.conf_abs_max, p.depth_diff_mean, p.depth_diff_max, p.changed_pct,
+                (i+1 < precisions.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+    fprintf(fp, "}\n");
+
+    if (fp != stdout) {
+        fclose(fp);
+    }
+}
+
+/*
+ * @brief Fuses every view from maps held in reduced precision and compares the result to full precision
+ *
+ * @param precision     - The precision of the maps
+ * @param depth_maps    - The full-precision depth maps
+ * @param conf_maps     - The full-precision confidence maps
+ * @param bounds        - The depth bounds of every camera (MAP_Q16 only)
+ * @param scene         - The synthetic scene
+ * @param views         - The supporting views of every reference view
+ * @param opts          - The configuration of the run
+ * @param ref_maps      - The depth maps fused from the full-precision maps
+ *
+ * @return Returns the error of the maps and of the fused depth maps
+ *
+ */
+static PrecisionResult compare_precision(const MapPrecision precision, const vector<Mat> &depth_maps, const vector<Mat> &conf_maps, const vector<Bounds> &bounds,
+        const SyntheticScene &scene, const vector<vector<int>> &views, const BenchOptions &opts, const vector<Mat> &ref_maps) {
+    const int total_views = depth_maps.size();
+
+    PrecisionResult result;
+    result.name = map_precision_name(precision);
+    result.map_mb = (double) map_pixel_bytes(precision) * depth_maps[0].total() * total_views / (1024.0 * 1024.0);
+
+    vector<DepthQuant> quant(total_views);
+    vector<Mat> compact_depths(total_views);
+    vector<Mat> compact_confs(total_views);
+    for (int v=0; v<total_views; ++v) {
+        if (precision == MAP_Q16 && !make_depth_quant(bounds[v], &quant[v])) {
+            fprintf(stderr, "Error: the camera of view %d has no depth bounds.\n", v);
+            exit(EXIT_FAILURE);
+        }
+        compact_depths[v] = compact_depth(depth_maps[v], precision, quant[v], &result.encode);
+        compact_confs[v] = compact_conf(conf_maps[v], precision, &result.encode);
+    }
+
+    double diff_sum = 0.0;
+    size_t diff_pixels = 0;
+    size_t changed = 0;
+    result.depth_diff_max = 0.0f;
+
+    vector<Mat> depth_refs;
+    vector<Mat> conf_refs;
+    Mat fused_map;
+    Mat fused_conf;
+    FusionScratch scratch;
+    for (int v=0; v<total_views; ++v) {
+        render_views(compact_depths, compact_confs, &quant, scene.K, scene.P, views, v, opts.conf_pre_filt, opts.render_tile, NULL, depth_refs, conf_refs, NULL, &scratch);
+        fuse_views(depth_refs, conf_refs, compact_confs, scene.K, scene.P, views, v,
+                opts.conf_post_filt, opts.support_ratio, fused_map, fused_conf, NULL, &scratch);
+
+        for (int r=0; r<fused_map.rows; ++r) {
+            const float *fused = fused_map.ptr<float>(r);
+            const float *ref = ref_maps[v].ptr<float>(r);
+
+            for (int c=0; c<fused_map.cols; ++c) {
+                const bool has_depth = (fused[c] > 0.0f);
+                const bool ref_has_depth = (ref[c] > 0.0f);
+
+                if (has_depth != ref_has_depth) {
+                    ++changed;
+                } else if (has_depth) {
+                    const float diff = fabs(fused[c] - ref[c]);
+                    diff_sum += diff;
+                    ++diff_pixels;
+                    result.depth_diff_max = max(result.depth_diff_max, diff);
+                }
+            }
+        }
+    }
+
+    result.depth_diff_mean = (diff_pixels > 0) ? diff_sum / diff_pixels : 0.0;
+    result.changed_pct = 100.0 * changed / ((double) depth_maps[0].total() * total_views);
+
+    return result;
+}
+
+/*
+ * @brief Runs the consensus of every available SIMD kernel and compares it to the scalar kernel
+ *
+ * Every reference view of the scene is rendered once and fused by every kernel from the same
+ * rendered views.
+ *
+ * @param scene         - The scene (its maps are fused)
+ * @param views         - The supporting views of every reference view
+ * @param opts          - The configuration of the run
+ * @param results       - The container receiving the difference of every SIMD kernel
+ *
+ */
+static void compare_kernels(const SyntheticScene &scene, const vector<vector<int>> &views, const BenchOptions &opts, vector<KernelResult> *results) {
+    const int total_views = scene.depth_maps.size();
+    const Size size = scene.depth_maps[0].size();
+
+    vector<vector<Mat>> depth_refs(total_views);
+    vector<vector<Mat>> conf_refs(total_views);
+    for (int v=0; v<total_views; ++v) {
+        render_views(scene.depth_maps, scene.conf_maps, NULL, scene.K, scene.P, views, v, opts.conf_pre_filt, 0, NULL, depth_refs[v], conf_refs[v], NULL, NULL);
+    }
+
+    // outputs of the scalar kernel
+    vector<Mat> ref_maps(total_views);
+    vector<Mat> ref_confs(total_views);
+    select_consensus_kernel("scalar");
+    for (int v=0; v<total_views; ++v) {
+        fuse_views(depth_refs[v], conf_refs[v], scene.conf_maps, scene.K, scene.P, views, v,
+                opts.conf_post_filt, opts.support_ratio, ref_maps[v], ref_confs[v], NULL, NULL);
+    }
+
+    const char *kernels[] = { "avx2", "avx512" };
+    for (int k=0; k<2; ++k) {
+        if (!select_consensus_kernel(kernels[k])) {
+            continue;
+        }
+
+        KernelResult result;
+        result.name = kernels[k];
+        result.width = size.width;
+        result.height = size.height;
+        result.depth_diff_max = 0.0f;
+        result.conf_diff_max = 0.0f;
+        result.changed = 0;
+
+        Mat fused_map;
+        Mat fused_conf;
+        for (int v=0; v<total_views; ++v) {
+            fuse_views(depth_refs[v], conf_refs[v], scene.conf_maps, scene.K, scene.P, views, v,
+                    opts.conf_post_filt, opts.support_ratio, fused_map, fused_conf, NULL, NULL);
+
+            for (int r=0; r<size.height; ++r) {
+                const float *fused = fused_map.ptr<float>(r);
+                const float *conf = fused_conf.ptr<float>(r);
+                const float *ref = ref_maps[v].ptr<float>(r);
+                const float *ref_conf = ref_confs[v].ptr<float>(r);
+
+                for (int c=0; c<size.width; ++c) {
+                    const float depth_diff = fabs(fused[c] - ref[c]);
+                    const float conf_diff = fabs(conf[c] - ref_conf[c]);
+
+                    result.depth_diff_max = max(result.depth_diff_max, depth_diff);
+                    result.conf_diff_max = max(result.conf_diff_max, conf_diff);
+                    if (depth_diff > KERNEL_TOLERANCE * max(1.0f, fabs(ref[c])) || conf_diff > KERNEL_TOLERANCE * max(1.0f, fabs(ref_conf[c])) ||
+                            (fused[c] > 0.0f) != (ref[c] > 0.0f)) {
+                        ++result.changed;
+                    }
+                }
+            }
+        }
+
+        results->push_back(result);
+    }
+
+    select_consensus_kernel("auto");
+}
+
+/*
+ * @brief Removes a file or directory (callback of the scene clean-up)
+ *
+ */
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+}
+
+int main(int argc, char **argv) {
+    BenchOptions opts;
+    parse_bench_options(argc, argv, &opts);
+
+    if (opts.num_threads > 0) {
+        omp_set_num_threads(opts.num_threads);
+    }
+
+    // scene directory
+    bool temporary = opts.dir.empty();
+    if (temporary) {
+        char dir_template[] = "/tmp/fusion_bench_XXXXXX";
+        if (mkdtemp(dir_template) == NULL) {
+            fprintf(stderr, "Error: could not create a temporary directory.\n");
+            exit(EXIT_FAILURE);
+        }
+        opts.dir = string(dir_template) + "/";
+    }
+
+    const string scene_name = "synthetic";
+    const string depth_path = opts.dir + "Depths/" + scene_name + "/";
+    const string conf_path = opts.dir + "Confs/" + scene_name + "/";
+    const int total_views = opts.scene.total_views;
+    const Size size(opts.scene.width, opts.scene.height);
+    const double view_pixels = (double) size.area();
+
+    // the report goes to stderr when the JSON results are written to stdout
+    FILE *report = (opts.json_path == "-") ? stderr : stdout;
+
+    fprintf(report, "Synthetic scene: %d views of %dx%d, fusing %d views per reference view, %d thread(s)\n",
+            total_views, size.width, size.height, opts.num_views, omp_get_max_threads());
+
+    SyntheticScene scene;
+    generate_scene(opts.scene, &scene);
+    write_scene(scene, opts.dir, scene_name, opts.scene.pair_views);
+
+    if (opts.generate_only) {
+        fprintf(report, "Scene written to %s (scene name '%s')\n", opts.dir.c_str(), scene_name.c_str());
+        return EXIT_SUCCESS;
+    }
+
+    // supporting views fused per reference view, as load_views would read them
+    vector<vector<int>> views(total_views);
+    for (int v=0; v<total_views; ++v) {
+        views[v].assign(scene.views[v].begin(), scene.views[v].begin() + opts.num_views);
+    }
+
+    fprintf(report, "%-20s %12s %12s %19s %13s %13s\n", "stage", "min", "mean", "throughput", "rss", "peak rss");
+    vector<StageResult> results;
+
+    // PFM writing and reading
+    results.push_back(time_stage(report, "save_pfm", opts.reps, 2 * total_views * view_pixels, [&]() {
+        for (int v=0; v<total_views; ++v) {
+            string index_str = to_string(v);
+            pad(index_str, 8, '0');
+            save_pfm(scene.depth_maps[v], depth_path + index_str + "_depth.pfm");
+            save_pfm(scene.conf_maps[v], conf_path + index_str + "_conf.pfm");
+        }
+    }));
+
+    vector<Mat> depth_maps;
+    vector<Mat> conf_maps;
+    results.push_back(time_stage(report, "load_pfm", opts.reps, 2 * total_views * view_pixels, [&]() {
+        SceneData data;
+        load_scene(discover_scene(depth_path, conf_path, "", ""), LOAD_DEPTH | LOAD_CONF, &data, 0);
+        depth_maps = data.depth_maps;
+        conf_maps = data.conf_maps;
+    }));
+
+    // render pass over every reference view (the supporting views are the rendered pixels),
+    // into recycled scratch buffers as in the pipeline
+    vector<Mat> depth_refs;
+    vector<Mat> conf_refs;
+    FusionScratch scratch;
+    results.push_back(time_stage(report, "render", opts.reps, total_views * (opts.num_views-1) * view_pixels, [&]() {
+        for (int v=0; v<total_views; ++v) {
+            render_views(depth_maps, conf_maps, NULL, scene.K, scene.P, views, v, opts.conf_pre_filt, 0, NULL, depth_refs, conf_refs, NULL, &scratch);
+        }
+    }));
+
+    // the same pass with the tiled renderer
+    results.push_back(time_stage(report, "render_tiled", opts.reps, total_views * (opts.num_views-1) * view_pixels, [&]() {
+        for (int v=0; v<total_views; ++v) {
+            render_views(depth_maps, conf_maps, NULL, scene.K, scene.P, views, v, opts.conf_pre_filt, opts.render_tile, NULL, depth_refs, conf_refs, NULL, &scratch);
+        }
+    }));
+
+    // consensus pass of every available kernel, on the rendered views of each reference view
+    vector<vector<Mat>> all_depth_refs(total_views);
+    vector<vector<Mat>> all_conf_refs(total_views);
+    for (int v=0; v<total_views; ++v) {
+        render_views(depth_maps, conf_maps, NULL, scene.K, scene.P, views, v, opts.conf_pre_filt, 0, NULL, all_depth_refs[v], all_conf_refs[v], NULL, NULL);
+    }
+
+    Mat fused_map(size, CV_32F);
+    Mat fused_conf(size, CV_32F);
+    const char *kernels[] = { "scalar", "avx2", "avx512" };
+    for (int k=0; k<3; ++k) {
+        if (!select_consensus_kernel(kernels[k])) {
+            continue;
+        }
+
+        results.push_back(time_stage(report, string("consensus_") + kernels[k], opts.reps, total_views * view_pixels, [&]() {
+            for (int v=0; v<total_views; ++v) {
+                fuse_views(all_depth_refs[v], all_conf_refs[v], conf_maps, scene.K, scene.P, views, v,
+                        opts.conf_post_filt, opts.support_ratio, fused_map, fused_conf, NULL, NULL);
+            }
+        }));
+    }
+    all_depth_refs.clear();
+    all_conf_refs.clear();
+    select_consensus_kernel("auto");
+
+    // the SIMD kernels against the scalar kernel, on the benchmark scene and on small scenes
+    // whose widths leave a tail after every vector width (8 and 16 lanes)
+    vector<KernelResult> kernel_results;
+    {
+        compare_kernels(scene, views, opts, &kernel_results);
+
+        const int tail_sizes[][2] = { { 123, 61 }, { 37, 29 } };
+        for (int t=0; t<2; ++t) {
+            SyntheticSceneParams params = opts.scene;
+            params.width = tail_sizes[t][0];
+            params.height = tail_sizes[t][1];
+
+            SyntheticScene tail_scene;
+            generate_scene(params, &tail_scene);
+
+            vector<vector<int>> tail_views(total_views);
+            for (int v=0; v<total_views; ++v) {
+                tail_views[v].assign(tail_scene.views[v].begin(), tail_scene.views[v].begin() + opts.num_views);
+            }
+            compare_kernels(tail_scene, tail_views, opts, &kernel_results);
+        }
+
+        fprintf(report, "\n%-8s %11s %14s %14s %10s\n", "kernel", "size", "depth diff max", "conf diff max", "changed");
+        for (size_t i=0; i<kernel_results.size(); ++i) {
+            const KernelResult &k = kernel_results[i];
+            fprintf(report, "%-8s %5dx%-5d %14.4g %14.4g %10zu\n", k.name.c_str(), k.width, k.height, k.depth_diff_max, k.conf_diff_max, k.changed);
+        }
+    }
+
+    // fusion from maps held in reduced precision, against the full-precision fusion
+    vector<PrecisionResult> precisions;
+    {
+        SceneData cameras;
+        load_scene(discover_scene(depth_path, conf_path, "", opts.dir + "Cameras/"), LOAD_CAMERAS, &cameras, 0);
+
+        vector<Mat> ref_maps(total_views);
+        vector<Mat> depth_refs;
+        vector<Mat> conf_refs;
+        Mat ref_conf;
+        FusionScratch ref_scratch;
+        for (int v=0; v<total_views; ++v) {
+            render_views(depth_maps, conf_maps, NULL, scene.K, scene.P, views, v, opts.conf_pre_filt, opts.render_tile, NULL, depth_refs, conf_refs, NULL, &ref_scratch);
+            fuse_views(depth_refs, conf_refs, conf_maps, scene.K, scene.P, views, v,
+                    opts.conf_post_filt, opts.support_ratio, ref_maps[v], ref_conf, NULL, &ref_scratch);
+        }
+
+        fprintf(report, "\n%-8s %10s %14s %14s %10s %14s %14s %12s\n", "maps", "memory", "depth err", "depth err max", "clipped", "fused diff", "fused diff max", "changed");
+        const MapPrecision reduced[] = { MAP_FP16, MAP_Q16 };
+        for (int p=0; p<2; ++p) {
+            const PrecisionResult result = compare_precision(reduced[p], depth_maps, conf_maps, cameras.bounds, scene, views, opts, ref_maps);
+            fprintf(report, "%-8s %7.1f MB %14.4g %14.4g %10zu %14.4g %14.4g %11.3f%%\n",
+                    result.name.c_str(), result.map_mb,
+                    (result.encode.depth_pixels > 0) ? result.encode.depth_abs_sum / result.encode.depth_pixels : 0.0,
+                    result.encode.depth_abs_max, result.encode.clipped, result.depth_diff_mean, result.depth_diff_max, result.changed_pct);
+            precisions.push_back(result);
+        }
+        fprintf(report, "\n");
+    }
+
+    // point cloud export of the last fused view
+    const string ply_path = opts.dir + "bench_points.ply";
+    results.push_back(time_stage(report, "write_ply", opts.reps, view_pixels, [&]() {
+        write_ply(fused_map, scene.K[total_views-1], scene.P[total_views-1], ply_path, scene.images[total_views-1], fused_conf);
+    }));
+
+    if (!opts.json_path.empty()) {
+        write_json(opts, results, kernel_results, precisions);
+    }
+
+    if (temporary) {
+        nftw(opts.dir.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+    }
+
+    for (size_t i=0; i<kernel_results.size(); ++i) {
+        if (kernel_results[i].changed > 0) {
+            fprintf(stderr, "Error: the %s consensus kernel differs from the scalar kernel in %zu pixel(s) of the %dx%d scene.\n",
+                    kernel_results[i].name.c_str(), kernel_results[i].changed, kernel_results[i].width, kernel_results[i].height);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
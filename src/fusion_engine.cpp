@@ -0,0 +1,134 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+
+#include "fusion_engine.h"
+
+using namespace std;
+using namespace cv;
+
+/*
+ * @brief Creates an engine for views of the given size
+ *
+ * @param params        - The fusion parameters
+ * @param rows          - The number of rows of every view
+ * @param cols          - The number of columns of every view
+ *
+ */
+FusionEngine::FusionEngine(const FusionParams &params, const int rows, const int cols) :
+    params(params),
+    size(cols, rows)
+{}
+
+/*
+ * @brief Replaces the fusion parameters used by the next calls to fuse()
+ *
+ * @param params        - The fusion parameters
+ *
+ */
+void FusionEngine::set_params(const FusionParams &params) {
+    this->params = params;
+}
+
+/*
+ * @brief Registers the buffers of a view (replacing any buffers registered for it)
+ *
+ * @param view          - The view
+ * @param depth         - The depth map (rows*cols floats, row-major)
+ * @param conf          - The confidence map (rows*cols floats, row-major)
+ * @param K             - The intrinsic camera parameters (4x4 floats, row-major)
+ * @param P             - The extrinsic camera parameters (4x4 floats, row-major)
+ *
+ * @return Returns false if the view index or a buffer is invalid
+ *
+ */
+bool FusionEngine::set_view(const int view, const float *depth, const float *conf, const float *K, const float *P) {
+    if (view < 0 || depth == NULL || conf == NULL || K == NULL || P == NULL) {
+        fprintf(stderr, "Error: invalid buffers for view %d.\n", view);
+        return false;
+    }
+
+    if ((size_t) view >= depth_maps.size()) {
+        depth_maps.resize(view+1);
+        conf_maps.resize(view+1);
+        this->K.resize(view+1);
+        this->P.resize(view+1);
+        views.resize(view+1);
+    }
+
+    // headers over the caller's memory; nothing is copied
+    depth_maps[view] = Mat(size, CV_32F, (void *) depth);
+    conf_maps[view] = Mat(size, CV_32F, (void *) conf);
+    this->K[view] = Mat(4, 4, CV_32F, (void *) K);
+    this->P[view] = Mat(4, 4, CV_32F, (void *) P);
+
+    return true;
+}
+
+/*
+ * @brief Unregisters the buffers of a view (the caller may release them afterwards)
+ *
+ * @param view          - The view
+ *
+ */
+void FusionEngine::clear_view(const int view) {
+    if (view < 0 || (size_t) view >= depth_maps.size()) {
+        return;
+    }
+
+    depth_maps[view] = Mat();
+    conf_maps[view] = Mat();
+    K[view] = Mat();
+    P[view] = Mat();
+}
+
+/*
+ * @brief Returns true if the buffers of a view are registered
+ *
+ */
+bool FusionEngine::is_registered(const int view) const {
+    return view >= 0 && (size_t) view < depth_maps.size() && !depth_maps[view].empty();
+}
+
+/*
+ * @brief Fuses a reference view with its supporting views
+ *
+ * @param index         - The reference view
+ * @param support       - The supporting views (the reference view is added if it is missing)
+ * @param fused_depth   - The buffer receiving the fused depth map (rows*cols floats, row-major)
+ * @param fused_conf    - The buffer receiving the fused confidence map (rows*cols floats, row-major);
+ *                          pixels dropped by the post-filter are set to -1
+ * @param stats         - The statistics to be updated with the stage times and counters (may be NULL)
+ *
+ * @return Returns false if the reference view or a supporting view is not registered
+ *
+ */
+bool FusionEngine::fuse(const int index, const vector<int> &support, float *fused_depth, float *fused_conf, ViewStats *stats) {
+    if (!is_registered(index) || fused_depth == NULL || fused_conf == NULL) {
+        fprintf(stderr, "Error: view %d is not registered.\n", index);
+        return false;
+    }
+
+    // the reference view comes first, as in pair.txt
+    vector<int> &ref_views = views[index];
+    ref_views.assign(1, index);
+    for (size_t i=0; i<support.size(); ++i) {
+        if (support[i] == index) {
+            continue;
+        }
+        if (!is_registered(support[i])) {
+            fprintf(stderr, "Error: supporting view %d of view %d is not registered.\n", support[i], index);
+            return false;
+        }
+        ref_views.push_back(support[i]);
+    }
+
+    // the outputs are written straight into the caller's buffers
+    Mat out_depth(size, CV_32F, (void *) fused_depth);
+    Mat out_conf(size, CV_32F, (void *) fused_conf);
+
+    render_views(depth_maps, conf_maps, NULL, K, P, views, index, params.conf_pre_filt, params.render_tile, NULL, depth_refs, conf_refs, stats, &scratch);
+    fuse_views(depth_refs, conf_refs, conf_maps, K, P, views, index, params.conf_post_filt, params.support_ratio, out_depth, out_conf, stats, &scratch);
+
+    return true;
+}
@@ -0,0 +1,55 @@
+#ifndef _FUSION_ENGINE_H_
+#define _FUSION_ENGINE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <vector>
+
+#include "depth_fusion.h"
+
+
+struct ViewStats;
+
+/*
+ * In-memory fusion of the views of a scene (the entry point of libconfusion).
+ *
+ * The caller registers its views with set_view(): continuous row-major float buffers for
+ * the depth and confidence maps, and the 4x4 row-major intrinsic and extrinsic matrices
+ * (the layout of the camera files). The buffers are wrapped, never copied, and must stay
+ * valid and unchanged while they are registered. fuse() renders the supporting views into
+ * a reference view and writes the fused depth and confidence maps into caller-provided
+ * buffers; the render stacks, z-buffer and ray tables are kept across calls.
+ *
+ * An engine is not thread-safe: use one engine per thread. Every view must have the size
+ * given to the constructor.
+ */
+class FusionEngine {
+    public:
+        FusionEngine(const FusionParams &params, const int rows, const int cols);
+
+        void set_params(const FusionParams &params);
+        bool set_view(const int view, const float *depth, const float *conf, const float *K, const float *P);
+        void clear_view(const int view);
+
+        bool fuse(const int index, const std::vector<int> &support, float *fused_depth, float *fused_conf, ViewStats *stats);
+
+    private:
+        FusionParams params;
+        const cv::Size size;
+
+        // registered views (headers over the caller's buffers), indexed by view
+        std::vector<cv::Mat> depth_maps;
+        std::vector<cv::Mat> conf_maps;
+        std::vector<cv::Mat> K;
+        std::vector<cv::Mat> P;
+        std::vector<std::vector<int>> views;
+
+        // reused across calls
+        FusionScratch scratch;
+        std::vector<cv::Mat> depth_refs;
+        std::vector<cv::Mat> conf_refs;
+
+        bool is_registered(const int view) const;
+};
+
+#endif
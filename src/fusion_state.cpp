@@ -0,0 +1,292 @@
+#include <stdio.h>
+#include <sys/stat.h>
+#include <fstream>
+#include <sstream>
+#include <omp.h>
+
+#include "scene_loader.h"
+#include "fusion_state.h"
+
+/*
+ * @brief Returns the 64-bit FNV-1a hash of the content of a file
+ *
+ * @param path          - The file
+ * @param hash          - The hash to be set
+ *
+ * @return Returns false if the file could not be read
+ *
+ */
+static bool hash_file(const string path, uint64_t *hash) {
+    FILE *fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    uint64_t h = 14695981039346656037ULL;
+    vector<unsigned char> block(1 << 20);
+    size_t bytes;
+    while ((bytes = fread(block.data(), 1, block.size(), fp)) > 0) {
+        for (size_t i=0; i<bytes; ++i) {
+            h = (h ^ block[i]) * 1099511628211ULL;
+        }
+    }
+
+    const bool ok = !ferror(fp);
+    fclose(fp);
+    *hash = h;
+
+    return ok;
+}
+
+/*
+ * @brief Fingerprints an input file, reusing the previous hash if its size and modification
+ *          time are unchanged
+ *
+ * @param path          - The file (empty = no file)
+ * @param previous      - The fingerprint of the previous run
+ *
+ * @return Returns the fingerprint (with mtime_ns == -1 if the file is missing)
+ *
+ */
+static FileFingerprint fingerprint_file(const string path, const FileFingerprint &previous) {
+    FileFingerprint fingerprint;
+    struct stat st;
+
+    if (path.empty() || stat(path.c_str(), &st) != 0) {
+        return fingerprint;
+    }
+
+    fingerprint.size = st.st_size;
+    fingerprint.mtime_ns = (int64_t) st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+
+    if (fingerprint.size == previous.size && fingerprint.mtime_ns == previous.mtime_ns) {
+        fingerprint.hash = previous.hash;
+    } else if (!hash_file(path, &fingerprint.hash)) {
+        fingerprint.mtime_ns = -1;
+    }
+
+    return fingerprint;
+}
+
+/*
+ * @brief Reads the state of an incremental scene
+ *
+ * The state is a text file with the lines
+ *
+ *     params <params>
+ *     view <v> <size> <mtime> <hash> (for the depth map, the confidence map and the camera)
+ *     fused <v> <num_views> <view> <view> ...
+ *
+ * @param path          - The file written by write_fusion_state()
+ * @param state         - The container to be populated with the state
+ *
+ * @return Returns false if the file cannot be read or is malformed (the state is then empty)
+ *
+ */
+bool read_fusion_state(const string path, FusionState *state) {
+    *state = FusionState();
+
+    ifstream file(path);
+    if (!file) {
+        return false;
+    }
+
+    string line;
+    while (getline(file, line)) {
+        istringstream fields(line);
+        string key;
+
+        if (!(fields >> key)) {
+            continue;
+        }
+
+        bool ok = true;
+        size_t v;
+        if (key == "params") {
+            ok = (bool) (fields >> state->params);
+        } else if (key == "view") {
+            ViewFingerprint fingerprint;
+            ok = (fields >> v
+                    >> fingerprint.depth.size >> fingerprint.depth.mtime_ns >> fingerprint.depth.hash
+                    >> fingerprint.conf.size >> fingerprint.conf.mtime_ns >> fingerprint.conf.hash
+                    >> fingerprint.camera.size >> fingerprint.camera.mtime_ns >> fingerprint.camera.hash) && v == state->inputs.size();
+            state->inputs.push_back(fingerprint);
+        } else if (key == "fused") {
+            size_t num_views;
+            ok = (fields >> v >> num_views) && v < (1 << 24);
+            if (ok && v >= state->fused.size()) {
+                state->fused.resize(v+1);
+            }
+            for (size_t i=0; ok && i<num_views; ++i) {
+                int view;
+                ok = (bool) (fields >> view);
+                state->fused[v].push_back(view);
+            }
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Error: malformed line '%s' in %s, fusing every view.\n", line.c_str(), path.c_str());
+            *state = FusionState();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * @brief Writes the state of an incremental scene
+ *
+ * The state is written to a temporary file and renamed over the previous state, so an
+ * interrupted write leaves the previous state in place.
+ *
+ * @param state         - The state
+ * @param path          - The file to be written
+ *
+ * @return Returns true if the file was written successfully; false otherwise
+ *
+ */
+bool write_fusion_state(const FusionState &state, const string path) {
+    const string tmp_path = path + ".tmp";
+
+    {
+        ofstream file(tmp_path);
+
+        if (!file) {
+            fprintf(stderr, "Error: could not open file %s.\n", tmp_path.c_str());
+            return false;
+        }
+
+        file << "params " << state.params << "\n";
+
+        for (size_t v=0; v<state.inputs.size(); ++v) {
+            const ViewFingerprint &f = state.inputs[v];
+            file << "view " << v
+                 << " " << f.depth.size << " " << f.depth.mtime_ns << " " << f.depth.hash
+                 << " " << f.conf.size << " " << f.conf.mtime_ns << " " << f.conf.hash
+                 << " " << f.camera.size << " " << f.camera.mtime_ns << " " << f.camera.hash << "\n";
+        }
+
+        for (size_t v=0; v<state.fused.size(); ++v) {
+            if (state.fused[v].empty()) {
+                continue;
+            }
+
+            file << "fused " << v << " " << state.fused[v].size();
+            for (size_t i=0; i<state.fused[v].size(); ++i) {
+                file << " " << state.fused[v][i];
+            }
+            file << "\n";
+        }
+
+        if (!file.flush()) {
+            fprintf(stderr, "Error: could not write file %s.\n", tmp_path.c_str());
+            return false;
+        }
+    }
+
+    if (rename(tmp_path.c_str(), path.c_str()) != 0) {
+        fprintf(stderr, "Error: could not replace file %s.\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Fingerprints the depth map, confidence map and camera of every view
+ *
+ * @param files         - The files of the scene
+ * @param previous      - The fingerprints of the previous run (their hashes are reused for unchanged files)
+ * @param num_threads   - The number of threads hashing files (0 = all available cores)
+ *
+ * @return Returns the fingerprints of every view
+ *
+ */
+vector<ViewFingerprint> fingerprint_views(const SceneFiles &files, const vector<ViewFingerprint> &previous, const int num_threads) {
+    const int total_views = files.depth_files.size();
+    vector<ViewFingerprint> fingerprints(total_views);
+
+    #pragma omp parallel for schedule(dynamic) num_threads((num_threads > 0) ? num_threads : omp_get_max_threads())
+    for (int v=0; v<total_views; ++v) {
+        const ViewFingerprint last = (v < (int) previous.size()) ? previous[v] : ViewFingerprint();
+
+        fingerprints[v].depth = fingerprint_file(files.depth_files[v], last.depth);
+        fingerprints[v].conf = fingerprint_file((v < (int) files.conf_files.size()) ? files.conf_files[v] : "", last.conf);
+        fingerprints[v].camera = fingerprint_file((v < (int) files.camera_files.size()) ? files.camera_files[v] : "", last.camera);
+    }
+
+    return fingerprints;
+}
+
+/*
+ * @brief Selects the reference views to be fused again
+ *
+ * A reference view is fused again if the fusion parameters changed, if it has no output, if
+ * its supporting views (from pair.txt) changed, or if the inputs of any view it is fused with
+ * (itself included) changed or are new. Every other reference view keeps its outputs.
+ *
+ * @param previous      - The state of the previous run (empty = fuse every view)
+ * @param current       - The parameters and input fingerprints of this run
+ * @param views         - The supporting views of every reference view
+ * @param has_output    - [reference view] its fused maps are on disk
+ * @param start_ind     - The first reference view to be considered
+ * @param end_ind       - One past the last reference view to be considered
+ *
+ * @return Returns the reference views to be fused and the reasons
+ *
+ */
+RefusionPlan plan_refusion(const FusionState &previous, const FusionState &current, const vector<vector<int>> &views, const vector<bool> &has_output, const int start_ind, const int end_ind) {
+    RefusionPlan plan;
+    plan.params_changed = (previous.params != current.params);
+
+    const int total_views = current.inputs.size();
+    vector<bool> changed(total_views, false);
+    for (int v=0; v<total_views; ++v) {
+        if (v >= (int) previous.inputs.size()) {
+            changed[v] = true;
+            ++plan.new_views;
+        } else if (!current.inputs[v].same_content(previous.inputs[v])) {
+            changed[v] = true;
+            ++plan.changed_views;
+        }
+    }
+
+    for (int r=start_ind; r<end_ind; ++r) {
+        const bool fused = (r < (int) previous.fused.size() && !previous.fused[r].empty() && has_output[r]);
+        const bool pairs_changed = fused && previous.fused[r] != views[r];
+
+        bool inputs_changed = false;
+        for (size_t i=0; i<views[r].size(); ++i) {
+            const int v = views[r][i];
+            inputs_changed = inputs_changed || v < 0 || v >= total_views || changed[v];
+        }
+
+        plan.missing_outputs += !fused;
+        plan.pair_changes += pairs_changed;
+
+        if (plan.params_changed || !fused || pairs_changed || inputs_changed) {
+            plan.refs.push_back(r);
+        }
+    }
+
+    return plan;
+}
+
+/*
+ * @brief Prints why the reference views of an incremental run are fused again
+ *
+ * @param plan          - The plan
+ * @param num_refs      - The number of reference views considered
+ *
+ */
+void print_refusion_plan(const RefusionPlan &plan, const int num_refs) {
+    printf("Incremental: %zu of %d reference view(s) to fuse (%zu changed and %zu new input view(s), %zu changed pair list(s), %zu missing output(s)%s)\n",
+            plan.refs.size(),
+            num_refs,
+            plan.changed_views,
+            plan.new_views,
+            plan.pair_changes,
+            plan.missing_outputs,
+            plan.params_changed ? ", fusion parameters changed" : "");
+}
@@ -0,0 +1,57 @@
+#ifndef _FUSION_STATE_H_
+#define _FUSION_STATE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct SceneFiles;
+
+// file name of the state of an incremental scene (in its output path)
+#define FUSION_STATE_FILE_NAME "fusion_state.txt"
+
+// fingerprint of an input file: its size and modification time, and a hash of its content
+// (the content is only hashed again when the size or the modification time changed)
+struct FileFingerprint {
+    uint64_t size = 0;
+    int64_t mtime_ns = -1;      // -1 = missing file
+    uint64_t hash = 0;
+
+    bool same_content(const FileFingerprint &other) const { return mtime_ns >= 0 && other.mtime_ns >= 0 && size == other.size && hash == other.hash; }
+};
+
+// fingerprints of the inputs of a view
+struct ViewFingerprint {
+    FileFingerprint depth;
+    FileFingerprint conf;
+    FileFingerprint camera;
+
+    bool same_content(const ViewFingerprint &other) const { return depth.same_content(other.depth) && conf.same_content(other.conf) && camera.same_content(other.camera); }
+};
+
+// structure to hold what the outputs of a scene were fused from
+struct FusionState {
+    string params;                      // fusion parameters of the outputs (a change re-fuses every view)
+    vector<ViewFingerprint> inputs;     // [view] inputs of every view
+    vector<vector<int>> fused;          // [reference view] views it was fused with (empty = no output)
+};
+
+// counters of an incremental plan
+struct RefusionPlan {
+    vector<int> refs;                   // reference views to be fused again
+    size_t changed_views = 0;           // views whose inputs changed
+    size_t new_views = 0;               // views without fingerprints in the previous state
+    size_t pair_changes = 0;            // reference views whose supporting views changed
+    size_t missing_outputs = 0;         // reference views without outputs
+    bool params_changed = false;
+};
+
+bool read_fusion_state(const string path, FusionState *state);
+bool write_fusion_state(const FusionState &state, const string path);
+vector<ViewFingerprint> fingerprint_views(const SceneFiles &files, const vector<ViewFingerprint> &previous, const int num_threads);
+RefusionPlan plan_refusion(const FusionState &previous, const FusionState &current, const vector<vector<int>> &views, const vector<bool> &has_output, const int start_ind, const int end_ind);
+void print_refusion_plan(const RefusionPlan &plan, const int num_refs);
+
+#endif
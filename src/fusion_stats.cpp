@@ -0,0 +1,272 @@
+#include <stdio.h>
+#include <math.h>
+
+#include "fusion_stats.h"
+
+using namespace std;
+
+/*
+ * @brief Accumulates the timers and counters of another set of statistics
+ *
+ * @param other         - The statistics to be added
+ *
+ */
+void ViewStats::add(const ViewStats &other) {
+    load_sec += other.load_sec;
+    render_sec += other.render_sec;
+    consensus_sec += other.consensus_sec;
+    post_filter_sec += other.post_filter_sec;
+    write_sec += other.write_sec;
+
+    source_pixels += other.source_pixels;
+    pre_filtered += other.pre_filtered;
+    out_of_frame += other.out_of_frame;
+    frustum_culled += other.frustum_culled;
+    zbuffer_writes += other.zbuffer_writes;
+    zbuffer_overwrites += other.zbuffer_overwrites;
+    zbuffer_rejects += other.zbuffer_rejects;
+
+    support_votes += other.support_votes;
+    occlusion_votes += other.occlusion_votes;
+    free_space_votes += other.free_space_votes;
+
+    fused_pixels += other.fused_pixels;
+    post_filtered += other.post_filtered;
+}
+
+/*
+ * @brief Records the statistics of a fused reference view
+ *
+ * @param view          - The statistics of the view (view.index identifies it)
+ *
+ */
+void FusionStats::add_view(const ViewStats &view) {
+    lock_guard<mutex> guard(lock);
+
+    // the write time may have been recorded first
+    ViewStats &entry = views[view.index];
+    const double write_sec = entry.write_sec;
+    entry = view;
+    entry.write_sec += write_sec;
+}
+
+/*
+ * @brief Records the time spent writing the outputs of a reference view
+ *
+ * @param index         - The reference view
+ * @param sec           - The time spent writing (seconds)
+ *
+ */
+void FusionStats::add_write(const int index, const double sec) {
+    lock_guard<mutex> guard(lock);
+
+    ViewStats &entry = views[index];
+    entry.index = index;
+    entry.write_sec += sec;
+}
+
+/*
+ * @brief Sets a run-level timer (for example the camera loading or the wall time)
+ *
+ * @param name          - The name of the timer
+ * @param sec           - The measured time (seconds)
+ *
+ */
+void FusionStats::set_timer(const string &name, const double sec) {
+    lock_guard<mutex> guard(lock);
+
+    for (size_t i=0; i<timers.size(); ++i) {
+        if (timers[i].first == name) {
+            timers[i].second = sec;
+            return;
+        }
+    }
+    timers.push_back(make_pair(name, sec));
+}
+
+/*
+ * @brief Sets a run parameter reported with the statistics (for example a threshold)
+ *
+ * @param name          - The name of the parameter
+ * @param value         - The value of the parameter, as printed
+ *
+ */
+void FusionStats::set_param(const string &name, const string &value) {
+    lock_guard<mutex> guard(lock);
+
+    for (size_t i=0; i<params.size(); ++i) {
+        if (params[i].first == name) {
+            params[i].second = value;
+            return;
+        }
+    }
+    params.push_back(make_pair(name, value));
+}
+
+/*
+ * @brief Returns the statistics summed over every reference view
+ *
+ */
+ViewStats FusionStats::totals() const {
+    lock_guard<mutex> guard(lock);
+    ViewStats total;
+
+    for (map<int, ViewStats>::const_iterator it = views.begin(); it != views.end(); ++it) {
+        total.add(it->second);
+    }
+
+    return total;
+}
+
+/*
+ * @brief Quotes a string as a JSON string literal
+ *
+ * @param value         - The string (a scene name or a path may hold any character)
+ *
+ * @return Returns the quoted string, with quotes, backslashes and control characters escaped
+ *
+ */
+static string json_string(const string &value) {
+    string quoted = "\"";
+
+    for (size_t i=0; i<value.length(); ++i) {
+        const unsigned char c = value[i];
+
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if (c < 0x20) {
+            char escaped[8];
+            snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            quoted += escaped;
+        } else {
+            quoted += c;
+        }
+    }
+
+    return quoted + "\"";
+}
+
+/*
+ * @brief Formats a number as a JSON value
+ *
+ * @param value         - The number
+ *
+ * @return Returns the number with 6 decimals, or null if it is not finite (JSON has no NaN or infinity)
+ *
+ */
+static string json_number(const double value) {
+    if (!isfinite(value)) {
+        return "null";
+    }
+
+    char formatted[64];
+    snprintf(formatted, sizeof(formatted), "%.6f", value);
+    return formatted;
+}
+
+/*
+ * @brief Writes the timers and counters of a set of statistics as JSON object members
+ *
+ * @param fp            - The output file
+ * @param s             - The statistics
+ * @param indent        - The indentation of the members
+ *
+ */
+static void write_view_members(FILE *fp, const ViewStats &s, const char *indent) {
+    fprintf(fp, "%s\"load_sec\": %s, \"render_sec\": %s, \"consensus_sec\": %s, \"post_filter_sec\": %s, \"write_sec\": %s,\n",
+            indent,
+            json_number(s.load_sec).c_str(),
+            json_number(s.render_sec).c_str(),
+            json_number(s.consensus_sec).c_str(),
+            json_number(s.post_filter_sec).c_str(),
+            json_number(s.write_sec).c_str());
+    fprintf(fp, "%s\"source_pixels\": %zu, \"pre_filtered\": %zu, \"out_of_frame\": %zu, \"frustum_culled\": %zu, \"zbuffer_writes\": %zu, \"zbuffer_overwrites\": %zu, \"zbuffer_rejects\": %zu,\n",
+            indent, s.source_pixels, s.pre_filtered, s.out_of_frame, s.frustum_culled, s.zbuffer_writes, s.zbuffer_overwrites, s.zbuffer_rejects);
+    fprintf(fp, "%s\"support_votes\": %zu, \"occlusion_votes\": %zu, \"free_space_votes\": %zu,\n",
+            indent, s.support_votes, s.occlusion_votes, s.free_space_votes);
+    fprintf(fp, "%s\"fused_pixels\": %zu, \"post_filtered\": %zu",
+            indent, s.fused_pixels, s.post_filtered);
+}
+
+/*
+ * @brief Writes the statistics as a JSON sidecar
+ *
+ * The file holds the run parameters, the run-level timers, the totals over every view
+ * and the statistics of each reference view.
+ *
+ * @param path          - The file to be written
+ *
+ * @return Returns true if the file was written successfully; false otherwise
+ *
+ */
+bool FusionStats::write_json(const string &path) const {
+    const ViewStats total = totals();
+    lock_guard<mutex> guard(lock);
+
+    FILE *fp = fopen(path.c_str(), "w");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not open file %s.\n", path.c_str());
+        return false;
+    }
+
+    fprintf(fp, "{\n");
+
+    fprintf(fp, "  \"params\": {");
+    for (size_t i=0; i<params.size(); ++i) {
+        fprintf(fp, "%s%s: %s", (i > 0) ? ", " : "", json_string(params[i].first).c_str(), json_string(params[i].second).c_str());
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"timers\": {");
+    for (size_t i=0; i<timers.size(); ++i) {
+        fprintf(fp, "%s%s: %s", (i > 0) ? ", " : "", json_string(timers[i].first).c_str(), json_number(timers[i].second).c_str());
+    }
+    fprintf(fp, "},\n");
+
+    fprintf(fp, "  \"totals\": {\n");
+    fprintf(fp, "    \"views\": %zu,\n", views.size());
+    write_view_members(fp, total, "    ");
+    fprintf(fp, "\n  },\n");
+
+    fprintf(fp, "  \"views\": [\n");
+    size_t n = 0;
+    for (map<int, ViewStats>::const_iterator it = views.begin(); it != views.end(); ++it, ++n) {
+        fprintf(fp, "    {\n      \"index\": %d,\n", it->first);
+        write_view_members(fp, it->second, "      ");
+        fprintf(fp, "\n    }%s\n", (n+1 < views.size()) ? "," : "");
+    }
+    fprintf(fp, "  ]\n");
+
+    fprintf(fp, "}\n");
+
+    const bool ok = (ferror(fp) == 0);
+    fclose(fp);
+
+    return ok;
+}
+
+/*
+ * @brief Prints the totals of the statistics
+ *
+ */
+void FusionStats::print_summary() const {
+    const ViewStats s = totals();
+    const size_t votes = s.support_votes + s.occlusion_votes + s.free_space_votes;
+    const size_t pixels = s.fused_pixels + s.post_filtered;
+
+    printf("Stage time (summed over views): load %.2f s, render %.2f s, consensus %.2f s, post-filter %.2f s, write %.2f s\n",
+            s.load_sec, s.render_sec, s.consensus_sec, s.post_filter_sec, s.write_sec);
+    printf("Render: %zu source pixels, %.1f%% pre-filtered, %.1f%% out of frame (%.1f%% culled), %zu z-buffer overwrites, %zu hidden\n",
+            s.source_pixels,
+            (s.source_pixels > 0) ? 100.0 * s.pre_filtered / s.source_pixels : 0.0,
+            (s.source_pixels > 0) ? 100.0 * s.out_of_frame / s.source_pixels : 0.0,
+            (s.source_pixels > 0) ? 100.0 * s.frustum_culled / s.source_pixels : 0.0,
+            s.zbuffer_overwrites,
+            s.zbuffer_rejects);
+    printf("Consensus: %.1f%% support, %.1f%% occlusion, %.1f%% free-space votes; %.1f%% of the pixels dropped by the post-filter\n",
+            (votes > 0) ? 100.0 * s.support_votes / votes : 0.0,
+            (votes > 0) ? 100.0 * s.occlusion_votes / votes : 0.0,
+            (votes > 0) ? 100.0 * s.free_space_votes / votes : 0.0,
+            (pixels > 0) ? 100.0 * s.post_filtered / pixels : 0.0);
+}
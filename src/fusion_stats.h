@@ -0,0 +1,65 @@
+#ifndef _FUSION_STATS_H_
+#define _FUSION_STATS_H_
+
+#include <stddef.h>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// structure to hold the timers and fusion-outcome counters of a reference view
+struct ViewStats {
+    int index = -1;
+
+    // stage timers (seconds)
+    double load_sec = 0.0;
+    double render_sec = 0.0;
+    double consensus_sec = 0.0;
+    double post_filter_sec = 0.0;
+    double write_sec = 0.0;
+
+    // render pass (summed over the supporting views)
+    size_t source_pixels = 0;           // pixels of the supporting views considered for rendering
+    size_t pre_filtered = 0;            // pixels culled by conf_pre_filt
+    size_t out_of_frame = 0;            // projections outside the reference view or behind its camera
+    size_t frustum_culled = 0;          // out-of-frame pixels skipped as a whole block by tiled rendering
+    size_t zbuffer_writes = 0;          // samples written into an empty z-buffer cell
+    size_t zbuffer_overwrites = 0;      // samples that replaced a farther (or less confident) sample
+    size_t zbuffer_rejects = 0;         // samples hidden behind a closer sample
+
+    // consensus votes (summed over the pixels of the reference view)
+    size_t support_votes = 0;
+    size_t occlusion_votes = 0;
+    size_t free_space_votes = 0;
+
+    // post-filter
+    size_t fused_pixels = 0;            // pixels kept
+    size_t post_filtered = 0;           // pixels dropped by conf_post_filt
+
+    void add(const ViewStats &other);
+};
+
+/*
+ * Collects the statistics of every reference view of a run (from any thread) and exports
+ * them, together with the run-level timers, as a JSON sidecar.
+ */
+class FusionStats {
+    public:
+        void add_view(const ViewStats &view);
+        void add_write(const int index, const double sec);
+        void set_timer(const std::string &name, const double sec);
+        void set_param(const std::string &name, const std::string &value);
+
+        ViewStats totals() const;
+        bool write_json(const std::string &path) const;
+        void print_summary() const;
+
+    private:
+        mutable std::mutex lock;
+        std::map<int, ViewStats> views;
+        std::vector<std::pair<std::string, double>> timers;
+        std::vector<std::pair<std::string, std::string>> params;
+};
+
+#endif
@@ -0,0 +1,93 @@
+#include "opencv2/core/core.hpp"
+
+#include "geometry.h"
+
+/*
+ * @brief Copies a 4x4 CV_32F camera matrix into a fixed-size double precision matrix
+ *
+ * @param M             - The 4x4 matrix to be copied
+ *
+ * @return Returns the fixed-size copy of the matrix
+ *
+ */
+static Matx44d to_matx44d(const Mat &M) {
+    Matx44d out;
+
+    for (int i=0; i<4; ++i) {
+        for (int j=0; j<4; ++j) {
+            out(i,j) = M.at<float>(i,j);
+        }
+    }
+
+    return out;
+}
+
+/*
+ * @brief Drops the last row of a 4x4 transform
+ *
+ * The camera matrices used throughout the fusion code have a last row of [0 0 0 1],
+ * so the homogeneous coordinate of any transformed point stays 1 and can be dropped.
+ *
+ * @param M             - The 4x4 transform
+ *
+ * @return Returns the upper 3x4 block of the transform in single precision
+ *
+ */
+static Matx34f upper_3x4(const Matx44d &M) {
+    Matx34f out;
+
+    for (int i=0; i<3; ++i) {
+        for (int j=0; j<4; ++j) {
+            out(i,j) = (float) M(i,j);
+        }
+    }
+
+    return out;
+}
+
+/*
+ * @brief Builds the transform taking a pixel with known depth into world coordinates
+ *
+ * @param K             - The intrinsic camera parameters for the view
+ * @param P             - The extrinsic camera parameters for the view
+ *
+ * @return Returns the 3x4 transform mapping (c*depth, r*depth, depth, 1) to (X, Y, Z)
+ *
+ */
+Matx34f backprojection_transform(const Mat &K, const Mat &P) {
+    return upper_3x4(to_matx44d(P).inv() * to_matx44d(K).inv());
+}
+
+/*
+ * @brief Builds the transform taking world coordinates into a view
+ *
+ * @param K             - The intrinsic camera parameters for the view
+ * @param P             - The extrinsic camera parameters for the view
+ *
+ * @return Returns the 3x4 transform mapping (X, Y, Z, 1) to (c*depth, r*depth, depth)
+ *
+ */
+Matx34f projection_transform(const Mat &K, const Mat &P) {
+    return upper_3x4(to_matx44d(K) * to_matx44d(P));
+}
+
+/*
+ * @brief Builds the transform taking a pixel of a source view into a target view
+ *
+ * The result is K_tgt * P_tgt * P_src^-1 * K_src^-1, composed in double precision.
+ * Applying it to (c*depth, r*depth, depth, 1) of the source view yields (u*z, v*z, z)
+ * in the target view, where z is the depth of the point with respect to the target camera.
+ *
+ * @param K_src         - The intrinsic camera parameters for the source view
+ * @param P_src         - The extrinsic camera parameters for the source view
+ * @param K_tgt         - The intrinsic camera parameters for the target view
+ * @param P_tgt         - The extrinsic camera parameters for the target view
+ *
+ * @return Returns the 3x4 source-to-target reprojection transform
+ *
+ */
+Matx34f reprojection_transform(const Mat &K_src, const Mat &P_src, const Mat &K_tgt, const Mat &P_tgt) {
+    Matx44d M = to_matx44d(K_tgt) * to_matx44d(P_tgt) * to_matx44d(P_src).inv() * to_matx44d(K_src).inv();
+
+    return upper_3x4(M);
+}
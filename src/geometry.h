@@ -0,0 +1,55 @@
+#ifndef _GEOMETRY_H_
+#define _GEOMETRY_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <cmath>
+
+using namespace std;
+using namespace cv;
+
+// transform building functions (computed once per view or view pair, never per pixel)
+Matx34f backprojection_transform(const Mat &K, const Mat &P);
+Matx34f projection_transform(const Mat &K, const Mat &P);
+Matx34f reprojection_transform(const Mat &K_src, const Mat &P_src, const Mat &K_tgt, const Mat &P_tgt);
+
+// applies a 3x4 transform to the homogeneous point (c*depth, r*depth, depth, 1)
+inline Vec3f transform_pixel(const Matx34f &T, const float c, const float r, const float depth) {
+    const float x = depth * c;
+    const float y = depth * r;
+
+    return Vec3f(
+            T(0,0)*x + T(0,1)*y + T(0,2)*depth + T(0,3),
+            T(1,0)*x + T(1,1)*y + T(1,2)*depth + T(1,3),
+            T(2,0)*x + T(2,1)*y + T(2,2)*depth + T(2,3));
+}
+
+// applies a 3x4 transform to the homogeneous point (x, y, z, 1)
+inline Vec3f transform_point(const Matx34f &T, const float x, const float y, const float z) {
+    return Vec3f(
+            T(0,0)*x + T(0,1)*y + T(0,2)*z + T(0,3),
+            T(1,0)*x + T(1,1)*y + T(1,2)*z + T(1,3),
+            T(2,0)*x + T(2,1)*y + T(2,2)*z + T(2,3));
+}
+
+// converts a transformed point into integer pixel coordinates and its depth in the target view
+// returns false if the projection falls outside the target image
+inline bool to_pixel(const Vec3f &x_2, const Size &size, int &r_p, int &c_p, float &proj_depth) {
+    proj_depth = x_2[2];
+
+    const float u = x_2[0] / x_2[2];
+    const float v = x_2[1] / x_2[2];
+
+    // compare before the integer conversion so that NaN/inf projections are rejected safely
+    if (!(u >= 0.0f && u < size.width && v >= 0.0f && v < size.height)) {
+        return false;
+    }
+
+    // take the floor to get the row and column pixel locations
+    c_p = (int) u;
+    r_p = (int) v;
+
+    return true;
+}
+
+#endif
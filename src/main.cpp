@@ -0,0 +1,678 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <vector>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <omp.h>
+
+#include "util.h"
+#include "depth_fusion.h"
+#include "options.h"
+#include "scheduler.h"
+#include "render_cache.h"
+#include "map_store.h"
+#include "output_writer.h"
+#include "pipeline.h"
+#include "scene_loader.h"
+#include "mapped_pfm.h"
+#include "consensus.h"
+#include "fusion_stats.h"
+#include "voxel_cloud.h"
+#include "scratch_pool.h"
+#include "shard.h"
+#include "map_precision.h"
+#include "output_archive.h"
+#include "fusion_state.h"
+#include "stream_fusion.h"
+
+// structure to hold a scene ready to be fused: its files, cameras, pair lists and view order
+struct PreparedScene {
+    SceneEntry entry;
+    SceneFiles files;
+    SceneData cameras;
+    vector<vector<int>> views;
+    vector<int> order;
+    MapPrecision precision;
+    vector<DepthQuant> quant;       // depth quantization of every view (MAP_Q16 only)
+    FusionState state;              // inputs of this run and what every reference view is fused from (with --incremental)
+    Size size;
+    double prepare_sec;
+    bool ok;
+};
+
+// structure to hold a fused scene until its outputs are written
+struct ActiveScene {
+    unique_ptr<PreparedScene> prepared;
+    FusionStats stats;
+    OutputTarget target;
+    ArchiveWriter archive;          // the fused maps of the scene (with --archive)
+    chrono::steady_clock::time_point start;
+};
+
+/*
+ * @brief Returns the fusion parameters that the outputs of an incremental scene depend on
+ *
+ */
+static string incremental_params(const FusionOptions &opts) {
+    return "num_views=" + to_string(opts.num_views) +
+        ",conf_pre_filt=" + to_string(opts.conf_pre_filt) +
+        ",conf_post_filt=" + to_string(opts.conf_post_filt) +
+        ",support_ratio=" + to_string(opts.support_ratio) +
+        ",map_precision=" + opts.map_precision +
+        ",archive=" + to_string(opts.archive);
+}
+
+/*
+ * @brief Checks that every map of a scene has a pair list that only names views of the scene
+ *
+ * @param views         - The supporting views of every reference view
+ * @param num_maps      - The number of depth maps of the scene
+ * @param scene         - The name of the scene
+ *
+ * @return Returns true if the pair lists are consistent with the maps; false otherwise
+ *
+ */
+static bool check_pair_lists(const vector<vector<int>> &views, const size_t num_maps, const string &scene) {
+    if (views.size() < num_maps) {
+        fprintf(stderr, "Error: found %zu depth maps and %zu pair lists in scene %s.\n", num_maps, views.size(), scene.c_str());
+        return false;
+    }
+
+    for (size_t v=0; v<num_maps; ++v) {
+        for (int s : views[v]) {
+            if (s < 0 || (size_t) s >= num_maps) {
+                fprintf(stderr, "Error: the pair list of view %zu in scene %s names view %d, but the scene has %zu views.\n", v, scene.c_str(), s, num_maps);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+/*
+ * @brief Selects the reference views of an incremental scene that have to be fused again
+ *
+ * Compares the fingerprints of the inputs and the pair lists with the state of the previous
+ * run and restricts the view order of the scene to the views affected by a change.
+ *
+ * @param opts          - The options of the run
+ * @param prepared      - The scene (its order and state are set)
+ *
+ */
+static void plan_incremental(const FusionOptions &opts, PreparedScene *prepared) {
+    const SceneEntry &entry = prepared->entry;
+    const int total_views = prepared->files.depth_files.size();
+
+    FusionState previous;
+    read_fusion_state(entry.output_path + FUSION_STATE_FILE_NAME, &previous);
+
+    FusionState &state = prepared->state;
+    state.params = incremental_params(opts);
+    state.inputs = fingerprint_views(prepared->files, previous.inputs, opts.num_threads);
+
+    // outputs left by the previous runs
+    vector<bool> has_output(total_views, false);
+    if (opts.archive) {
+        ArchiveReader reader;
+        if (reader.open(archive_path(entry.output_path, -1))) {
+            const vector<int> archived = reader.list_views();
+            for (size_t i=0; i<archived.size(); ++i) {
+                if (archived[i] >= 0 && archived[i] < total_views) {
+                    has_output[archived[i]] = true;
+                }
+            }
+        }
+    } else {
+        for (int v=0; v<total_views; ++v) {
+            string index_str = to_string(v);
+            pad(index_str, 8, '0');
+            // a truncated map (left by an interrupted write) counts as missing
+            MappedPfm depth(entry.output_path + "depths/" + index_str + "_depth.pfm");
+            MappedPfm conf(entry.output_path + "confs/" + index_str + "_conf.pfm");
+            has_output[v] = depth.is_open() && conf.is_open();
+        }
+    }
+
+    const RefusionPlan plan = plan_refusion(previous, state, prepared->views, has_output, 0, total_views);
+    print_refusion_plan(plan, total_views);
+
+    // every other reference view keeps the record of the fusion its outputs come from
+    state.fused = previous.fused;
+    state.fused.resize(total_views);
+    for (size_t i=0; i<plan.refs.size(); ++i) {
+        state.fused[plan.refs[i]] = prepared->views[plan.refs[i]];
+    }
+
+    prepared->order = plan_view_order(prepared->views, plan.refs);
+}
+
+/*
+ * @brief Discovers the files of a scene and loads its cameras and pair lists
+ *
+ * Runs in the background while the previous scene is fused. The maps themselves are
+ * loaded on demand by the map store of the scene.
+ *
+ * @param opts          - The options of the run
+ * @param entry         - The scene
+ *
+ * @return Returns the prepared scene; ok is false if its files are inconsistent
+ *
+ */
+static PreparedScene *prepare_scene(const FusionOptions &opts, const SceneEntry &entry) {
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    PreparedScene *prepared = new PreparedScene();
+    prepared->entry = entry;
+    prepared->ok = false;
+
+	string depth_path = entry.data_path + "Depths/" + entry.scene + "/";
+	string conf_path = entry.data_path + "Confs/" + entry.scene + "/";
+	string cam_path = entry.data_path + "Cameras/";
+
+    // discover the scene files once; load views and, concurrently, the K's, P's and bounds
+    printf("Loading data of scene %s...\n", entry.scene.c_str());
+    prepared->files = discover_scene(depth_path, conf_path, "", cam_path);
+    const vector<string> &depth_files = prepared->files.depth_files;
+    const vector<string> &conf_files = prepared->files.conf_files;
+	//load_images(&images, img_path);
+    // a missing pair list or camera skips the scene instead of ending the run
+    if (!load_views(&prepared->views, opts.num_views, cam_path)) {
+        fprintf(stderr, "Error: could not load the pair list of scene %s.\n", entry.scene.c_str());
+        return prepared;
+    }
+
+    if (!load_scene(prepared->files, LOAD_CAMERAS, &prepared->cameras, opts.num_threads)) {
+        fprintf(stderr, "Error: could not load the cameras of scene %s.\n", entry.scene.c_str());
+        return prepared;
+    }
+    print_load_timings(prepared->cameras.timings);
+
+    if (depth_files.empty() || depth_files.size() != conf_files.size()) {
+        fprintf(stderr, "Error: found %zu depth maps and %zu confidence maps in scene %s.\n", depth_files.size(), conf_files.size(), entry.scene.c_str());
+        return prepared;
+    }
+
+    if (prepared->cameras.K.size() < depth_files.size()) {
+        fprintf(stderr, "Error: found %zu depth maps but only %zu camera files in scene %s.\n", depth_files.size(), prepared->cameras.K.size(), entry.scene.c_str());
+        return prepared;
+    }
+
+    if (!check_pair_lists(prepared->views, depth_files.size(), entry.scene)) {
+        return prepared;
+    }
+
+    // the 16-bit depth quantization of every view follows the depth bounds of its camera
+    parse_map_precision(opts.map_precision.c_str(), &prepared->precision);
+    if (prepared->precision == MAP_Q16) {
+        prepared->quant.resize(depth_files.size());
+
+        for (size_t v=0; v<depth_files.size(); ++v) {
+            if (!make_depth_quant(prepared->cameras.bounds[v], &prepared->quant[v])) {
+                fprintf(stderr, "Error: the camera of view %zu in scene %s has no depth bounds, which --map-precision q16 requires.\n", v, entry.scene.c_str());
+                return prepared;
+            }
+        }
+    }
+
+    // the size of the maps, from the header of the first depth map (its payload is not read)
+    MappedPfm first_depth(depth_files[0]);
+    if (!first_depth.is_open()) {
+        fprintf(stderr, "Error: could not read depth map %s.\n", depth_files[0].c_str());
+        return prepared;
+    }
+    prepared->size = Size(first_depth.cols(), first_depth.rows());
+
+    // starting and ending index used to select which views to produce fused maps for (default is all views).
+    int start_ind = min(entry.start_view, (int) depth_files.size());
+    int end_ind = (entry.end_view < 0) ? depth_files.size() : min(entry.end_view, (int) depth_files.size());
+
+    // fuse views that share supporting views one after another, so that cached back-projections are reused
+    prepared->order = plan_view_order(prepared->views, start_ind, end_ind);
+
+    // incremental runs only fuse the views affected by a change since the previous run
+    if (opts.incremental) {
+        plan_incremental(opts, prepared);
+    }
+
+    if (opts.archive) {
+        make_dirs(entry.output_path);
+    } else {
+        make_dirs(entry.output_path + "depths/");
+        make_dirs(entry.output_path + "confs/");
+    }
+
+    prepared->prepare_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    prepared->ok = true;
+
+    return prepared;
+}
+
+/*
+ * @brief Fuses every view of a prepared scene
+ *
+ * Returns once every view is handed to the writer; the writes of the scene continue in the
+ * background (see finish_scene()).
+ *
+ * @param opts          - The options of the run
+ * @param prepared      - The scene
+ * @param writer        - The writer shared by every scene
+ * @param pool          - The working memory shared by every scene
+ *
+ * @return Returns the scene, to be finished once its outputs are written
+ *
+ */
+static ActiveScene *run_scene(const FusionOptions &opts, PreparedScene *prepared, OutputWriter &writer, ScratchPool &pool) {
+    ActiveScene *active = new ActiveScene();
+    active->prepared.reset(prepared);
+    active->start = chrono::steady_clock::now();
+
+    const SceneEntry &entry = prepared->entry;
+    const vector<Mat> &K = prepared->cameras.K;
+    const vector<Mat> &P = prepared->cameras.P;
+    const vector<int> &order = prepared->order;
+    const Size size = prepared->size;
+
+    // timers and fusion-outcome counters of every reference view, exported as JSON
+    FusionStats &stats = active->stats;
+    stats.set_param("scene", entry.scene);
+    stats.set_param("num_views", to_string(opts.num_views));
+    stats.set_param("conf_pre_filt", to_string(opts.conf_pre_filt));
+    stats.set_param("conf_post_filt", to_string(opts.conf_post_filt));
+    stats.set_param("support_ratio", to_string(opts.support_ratio));
+    stats.set_param("kernel", consensus_kernel_name());
+    stats.set_param("render_tile", to_string(opts.render_tile));
+    stats.set_param("map_precision", map_precision_name(prepared->precision));
+    if (opts.shard >= 0) {
+        stats.set_param("shard", to_string(opts.shard));
+    }
+    if (opts.incremental) {
+        stats.set_param("incremental_views", to_string(order.size()) + "/" + to_string(prepared->files.depth_files.size()));
+    }
+
+    double camera_sec = 0.0;
+    for (size_t i=0; i<prepared->cameras.timings.size(); ++i) {
+        camera_sec += prepared->cameras.timings[i].msec / 1e3;
+    }
+    stats.set_timer("camera_load", camera_sec);
+    stats.set_timer("prepare", prepared->prepare_sec);
+
+    // destination of the fused maps in the background writer
+    OutputTarget &target = active->target;
+    target.out_depth_path = entry.output_path + "depths/";
+    target.out_conf_path = entry.output_path + "confs/";
+    target.stats = &stats;
+
+    // a single compressed archive instead of the per-view files; a failure to create it fails every write of the scene
+    if (opts.archive) {
+        const string path = archive_path(entry.output_path, opts.shard);
+        target.archive = &active->archive;
+        active->archive.open(path, opts.incremental);
+        stats.set_param("archive", path);
+    }
+
+    RenderCache *cache = NULL;
+    if (opts.cache_mb > 0) {
+        cache = new RenderCache(opts.cache_mb * 1024 * 1024);
+    }
+
+    // maps are loaded (and reduced to the chosen precision) when the first reference view needing them is fused,
+    // and dropped after the last one
+    const size_t view_bytes = map_pixel_bytes(prepared->precision) * (size_t) size.area();
+    MapStore store(prepared->files, prepared->views, order, view_bytes, size, opts.mem_budget_mb * 1024 * 1024,
+            prepared->precision, prepared->quant, opts.loader_threads);
+
+    // split the threads between concurrent reference views and the passes within each view
+    Schedule schedule = plan_schedule(opts.num_threads, order.size(), size);
+
+    // the concurrent views are split between the render and fuse stages unless sized explicitly,
+    // and the stage workers times the threads within each view stay within the threads of the run
+    PipelineConfig config;
+    config.render_threads = (opts.render_threads > 0) ? opts.render_threads : max(1, (schedule.view_workers+1) / 2);
+    config.fuse_threads = (opts.fuse_threads > 0) ? opts.fuse_threads : max(1, schedule.view_workers - config.render_threads);
+    fit_stage_workers(&schedule, opts.num_threads, config.render_threads + config.fuse_threads);
+    print_schedule(schedule, order.size());
+    config.loader_threads = opts.loader_threads;
+    config.inner_threads = schedule.inner_threads;
+    config.queue_depth = opts.pipeline_queue;
+
+    FusionParams params;
+    params.conf_pre_filt = opts.conf_pre_filt;
+    params.conf_post_filt = opts.conf_post_filt;
+    params.support_ratio = opts.support_ratio;
+    params.render_tile = opts.render_tile;
+
+    // scene-level cloud merging every fused view (the per-view maps are still written)
+    VoxelCloud *cloud = NULL;
+    if (opts.merge_voxel > 0) {
+        cloud = new VoxelCloud(opts.merge_voxel, false);
+    }
+
+    // load, render, fuse and write concurrently
+    FusionPipeline pipeline(config, params, K, P, prepared->views, store, cache, writer, target, cloud, &pool);
+    pipeline.run(order);
+
+    pipeline.print_stats();
+    store.print_stats();
+
+    const vector<LoadTiming> map_timings = store.load_timings();
+    double map_sec = 0.0;
+    for (size_t i=0; i<map_timings.size(); ++i) {
+        map_sec += map_timings[i].msec / 1e3;
+    }
+    print_load_timings(map_timings);
+    stats.set_timer("map_load", map_sec);
+    stats.set_param("map_over_budget", to_string(store.stats().over_budget));
+
+    // error of the reduced-precision maps against the full-precision maps
+    if (prepared->precision != MAP_FP32) {
+        const PrecisionError error = store.precision_error();
+        stats.set_param("map_depth_error_mean", to_string((error.depth_pixels > 0) ? error.depth_abs_sum / error.depth_pixels : 0.0));
+        stats.set_param("map_depth_error_max", to_string(error.depth_abs_max));
+        stats.set_param("map_depth_clipped", to_string(error.clipped));
+        stats.set_param("map_conf_error_max", to_string(error.conf_abs_max));
+    }
+    if (cache != NULL) {
+        cache->print_stats();
+        delete cache;
+    }
+    if (cloud != NULL) {
+        cloud->print_stats();
+        // the workers of a sharded scene each write the cloud of their shard
+        cloud->write_ply(entry.output_path + ((opts.shard >= 0) ? "merged_shard" + to_string(opts.shard) + ".ply" : "merged.ply"));
+        delete cloud;
+    }
+
+    return active;
+}
+
+/*
+ * @brief Waits until the outputs of a fused scene are written and exports its statistics
+ *
+ * @param opts          - The options of the run
+ * @param active        - The scene (deleted)
+ * @param writer        - The writer shared by every scene
+ *
+ * @return Returns true if every reference view of the scene was fused and written; false otherwise
+ *
+ */
+static bool finish_scene(const FusionOptions &opts, ActiveScene *active, OutputWriter &writer) {
+    writer.wait(active->target);
+
+    ArchiveWriter &archive = active->archive;
+    if (archive.is_open()) {
+        const uint64_t raw_bytes = archive.raw_bytes();
+        const uint64_t stored_bytes = archive.stored_bytes();
+        if (archive.close()) {
+            printf("Archive: %zu views, %.1f MB compressed to %.1f MB (%.2fx)\n",
+                    archive.views(), raw_bytes / (1024.0 * 1024.0), stored_bytes / (1024.0 * 1024.0), (stored_bytes > 0) ? (double) raw_bytes / stored_bytes : 0.0);
+        }
+        active->stats.set_param("archive_ratio", to_string((stored_bytes > 0) ? (double) raw_bytes / stored_bytes : 0.0));
+    }
+
+    const SceneEntry &entry = active->prepared->entry;
+    const size_t failed_views = active->target.failed;
+    active->stats.set_param("failed_views", to_string(failed_views));
+
+    const string stats_name = (opts.shard >= 0) ? "fusion_stats_shard" + to_string(opts.shard) + ".json" : "fusion_stats.json";
+    const string stats_path = opts.stats_path.empty() ? entry.output_path + stats_name : opts.stats_path;
+
+    active->stats.set_timer("wall", active->prepared->prepare_sec + chrono::duration<double>(chrono::steady_clock::now() - active->start).count());
+    printf("Scene %s:\n", entry.scene.c_str());
+    active->stats.print_summary();
+    if (active->stats.write_json(stats_path)) {
+        printf("Statistics written to %s\n", stats_path.c_str());
+    }
+
+    // the state only advances once every fused view is on disk, so failed views are fused again by the next run
+    if (opts.incremental) {
+        if (failed_views == 0) {
+            write_fusion_state(active->prepared->state, entry.output_path + FUSION_STATE_FILE_NAME);
+        } else {
+            fprintf(stderr, "Error: %zu view(s) of scene %s could not be fused or written; its incremental state is not updated.\n", failed_views, entry.scene.c_str());
+        }
+    } else if (failed_views > 0) {
+        fprintf(stderr, "Error: %zu view(s) of scene %s could not be fused or written.\n", failed_views, entry.scene.c_str());
+    }
+
+    delete active;
+
+    return failed_views == 0;
+}
+
+/*
+ * @brief Coordinator of a sharded run: splits the reference views of a scene into shards
+ *          and writes the work manifest '<output-path>shards.txt'
+ *
+ * @param opts          - The options of the run
+ * @param entry         - The scene
+ *
+ * @return Returns the exit status of the run
+ *
+ */
+static int plan_scene_shards(const FusionOptions &opts, const SceneEntry &entry) {
+    SceneFiles files = discover_scene(entry.data_path + "Depths/" + entry.scene + "/", entry.data_path + "Confs/" + entry.scene + "/", "", "");
+    vector<vector<int>> views;
+    if (!load_views(&views, opts.num_views, entry.data_path + "Cameras/")) {
+        return EXIT_FAILURE;
+    }
+
+    if (files.depth_files.empty()) {
+        fprintf(stderr, "Error: found no depth maps in scene %s.\n", entry.scene.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!check_pair_lists(views, files.depth_files.size(), entry.scene)) {
+        return EXIT_FAILURE;
+    }
+
+    const ShardManifest manifest = plan_shards(entry.scene, views, files.depth_files.size(), opts.plan_shards);
+    const string path = entry.output_path + "shards.txt";
+
+    make_dirs(entry.output_path);
+    if (!write_shard_manifest(manifest, path)) {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t k=0; k<manifest.shards.size(); ++k) {
+        printf("Shard %zu: views %d-%d, reading %zu of %d views\n",
+                k, manifest.shards[k].start, manifest.shards[k].end-1, manifest.shards[k].inputs.size(), manifest.total_views);
+    }
+    printf("Work manifest written to %s\n", path.c_str());
+
+    return EXIT_SUCCESS;
+}
+
+/*
+ * @brief Merges the fused maps of every view of a verified sharded scene into the scene-level
+ *          cloud '<output-path>merged.ply'
+ *
+ * The cloud is built from the fused maps rather than from the clouds of the shards, so that the
+ * voxels shared by neighbouring shards are averaged as in an unsharded run.
+ *
+ * @param opts          - The options of the run
+ * @param entry         - The scene
+ * @param manifest      - The manifest of the scene
+ *
+ * @return Returns true if every view was merged and the cloud was written successfully
+ *
+ */
+static bool merge_shard_cloud(const FusionOptions &opts, const SceneEntry &entry, const ShardManifest &manifest) {
+    SceneData cameras;
+    if (!load_scene(discover_scene("", "", "", entry.data_path + "Cameras/"), LOAD_CAMERAS, &cameras, opts.num_threads) ||
+            (int) cameras.K.size() < manifest.total_views) {
+        fprintf(stderr, "Error: could not load the cameras of scene %s.\n", entry.scene.c_str());
+        return false;
+    }
+
+    ArchiveReader reader;
+    if (opts.archive && !reader.open(archive_path(entry.output_path, -1))) {
+        return false;
+    }
+
+    VoxelCloud cloud(opts.merge_voxel, false);
+    for (int v=0; v<manifest.total_views; ++v) {
+        Mat depth;
+        Mat conf;
+
+        if (opts.archive) {
+            reader.read(v, ARCHIVE_DEPTH, &depth);
+            reader.read(v, ARCHIVE_CONF, &conf);
+        } else {
+            string index_str = to_string(v);
+            pad(index_str, 8, '0');
+            depth = load_pfm(entry.output_path + "depths/" + index_str + "_depth.pfm");
+            conf = load_pfm(entry.output_path + "confs/" + index_str + "_conf.pfm");
+        }
+
+        if (depth.empty() || depth.size() != conf.size()) {
+            fprintf(stderr, "Error: could not read the fused maps of view %d.\n", v);
+            return false;
+        }
+        cloud.add_view(depth, conf, cameras.K[v], cameras.P[v], Mat());
+    }
+
+    cloud.print_stats();
+    return cloud.write_ply(entry.output_path + "merged.ply");
+}
+
+int main(int argc, char **argv) {
+    // read in command-line args
+    FusionOptions opts;
+    parse_options(argc, argv, &opts);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    // the positional scene, or every scene of the batch manifest
+    vector<SceneEntry> scenes = list_scenes(opts);
+
+    // sharded runs: the coordinator writes the work manifest, the workers fuse one shard each
+    // and the final step verifies that every shard and view is complete
+    if (opts.plan_shards > 0) {
+        return plan_scene_shards(opts, scenes[0]);
+    }
+
+    ShardManifest manifest;
+    if (opts.shard >= 0 || opts.verify) {
+        if (!read_shard_manifest(scenes[0].output_path + "shards.txt", &manifest)) {
+            exit(EXIT_FAILURE);
+        }
+        if (manifest.scene != scenes[0].scene) {
+            fprintf(stderr, "Error: the work manifest is for scene %s.\n", manifest.scene.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // once every shard is complete, the outputs of the shards are combined into those of the scene
+    if (opts.verify) {
+        if (!verify_shards(manifest, scenes[0].output_path, opts.archive) ||
+                (opts.archive && !merge_shard_archives(manifest, scenes[0].output_path)) ||
+                (opts.merge_voxel > 0 && !merge_shard_cloud(opts, scenes[0], manifest))) {
+            return EXIT_FAILURE;
+        }
+        return EXIT_SUCCESS;
+    }
+
+    if (opts.shard >= 0) {
+        if (opts.shard >= (int) manifest.shards.size()) {
+            fprintf(stderr, "Error: the work manifest has %zu shards.\n", manifest.shards.size());
+            exit(EXIT_FAILURE);
+        }
+        // the worker must read the views its shard was planned with
+        vector<vector<int>> views;
+        if (!load_views(&views, opts.num_views, scenes[0].data_path + "Cameras/") || !check_shard_inputs(manifest, opts.shard, views)) {
+            exit(EXIT_FAILURE);
+        }
+        scenes[0].start_view = manifest.shards[opts.shard].start;
+        scenes[0].end_view = manifest.shards[opts.shard].end;
+        printf("Shard %d: views %d-%d, reading %zu of %d views\n", opts.shard, scenes[0].start_view, scenes[0].end_view-1, manifest.shards[opts.shard].inputs.size(), manifest.total_views);
+    }
+
+    // consensus kernel (the widest SIMD kernel the CPU supports, unless chosen explicitly)
+    if (!select_consensus_kernel(opts.kernel.c_str())) {
+        fprintf(stderr, "Error: consensus kernel '%s' is unknown or not supported on this CPU.\n", opts.kernel.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    MapPrecision precision;
+    if (!parse_map_precision(opts.map_precision.c_str(), &precision)) {
+        fprintf(stderr, "Error: map precision '%s' is unknown (fp32, fp16 or q16).\n", opts.map_precision.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    // online mode: frames are fused as they arrive instead of read from the scene directories
+    // (the stream prints its own status, away from the replies)
+    if (!opts.stream_source.empty()) {
+        return run_stream(opts, scenes[0]);
+    }
+
+    printf("Consensus kernel: %s\n", consensus_kernel_name());
+    printf("Map precision: %s\n", map_precision_name(precision));
+
+    // working memory and output maps of the reference views, recycled across views and scenes
+    ScratchPool pool;
+
+    // background writer for the fused maps, shared by every scene
+    OutputWriter writer(opts.write_queue, opts.writer_threads, &pool);
+
+    // the next scene is prepared while the current one is fused, and the outputs of a scene
+    // are written while the next one is fused
+    future<PreparedScene *> next = async(launch::async, prepare_scene, cref(opts), cref(scenes[0]));
+    ActiveScene *previous = NULL;
+    size_t failed = 0;
+
+    for (size_t i=0; i<scenes.size(); ++i) {
+        PreparedScene *prepared = next.get();
+        if (i+1 < scenes.size()) {
+            next = async(launch::async, prepare_scene, cref(opts), cref(scenes[i+1]));
+        }
+
+        if (!prepared->ok) {
+            delete prepared;
+            ++failed;
+            continue;
+        }
+
+        // nothing changed since the previous incremental run (the state still records the new fingerprints)
+        if (opts.incremental && prepared->order.empty()) {
+            printf("Scene %s is up to date\n", prepared->entry.scene.c_str());
+            write_fusion_state(prepared->state, prepared->entry.output_path + FUSION_STATE_FILE_NAME);
+            delete prepared;
+            continue;
+        }
+
+        ActiveScene *active = run_scene(opts, prepared, writer, pool);
+
+        if (previous != NULL && !finish_scene(opts, previous, writer)) {
+            ++failed;
+        }
+        previous = active;
+    }
+
+    if (previous != NULL && !finish_scene(opts, previous, writer)) {
+        ++failed;
+    }
+
+    writer.finish();
+    writer.print_stats();
+    pool.print_stats();
+
+    // the marker is only written once every view of the shard is on disk
+    if (opts.shard >= 0) {
+        if (failed > 0 || writer.failures() > 0 || !write_shard_marker(scenes[0].output_path, opts.shard)) {
+            fprintf(stderr, "Error: shard %d is incomplete.\n", opts.shard);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (scenes.size() > 1) {
+        printf("Batch: %zu of %zu scenes fused in %.2f s\n",
+                scenes.size() - failed,
+                scenes.size(),
+                chrono::duration<double>(chrono::steady_clock::now() - start).count());
+    }
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
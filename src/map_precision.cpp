@@ -0,0 +1,296 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <omp.h>
+
+#include "util.h"
+#include "map_precision.h"
+
+/*
+ * @brief Accumulates the error of another set of maps
+ *
+ * @param other         - The error to be added
+ *
+ */
+void PrecisionError::add(const PrecisionError &other) {
+    depth_pixels += other.depth_pixels;
+    depth_abs_sum += other.depth_abs_sum;
+    depth_rel_sum += other.depth_rel_sum;
+    depth_abs_max = max(depth_abs_max, other.depth_abs_max);
+    depth_rel_max = max(depth_rel_max, other.depth_rel_max);
+    clipped += other.clipped;
+    conf_pixels += other.conf_pixels;
+    conf_abs_sum += other.conf_abs_sum;
+    conf_abs_max = max(conf_abs_max, other.conf_abs_max);
+}
+
+/*
+ * @brief Prints the error against the full-precision maps
+ *
+ * @param label         - The label of the maps
+ *
+ */
+void PrecisionError::print(const char *label) const {
+    printf("%s: depth error mean %.3g (%.3g%%), max %.3g (%.3g%%) over %zu pixels, %zu clipped; confidence error mean %.3g, max %.3g\n",
+            label,
+            (depth_pixels > 0) ? depth_abs_sum / depth_pixels : 0.0,
+            (depth_pixels > 0) ? 100.0 * depth_rel_sum / depth_pixels : 0.0,
+            depth_abs_max,
+            100.0 * depth_rel_max,
+            depth_pixels,
+            clipped,
+            (conf_pixels > 0) ? conf_abs_sum / conf_pixels : 0.0,
+            conf_abs_max);
+}
+
+/*
+ * @brief Parses the name of a map precision ("fp32", "fp16" or "q16")
+ *
+ * @param name          - The name
+ * @param precision     - The precision to be set
+ *
+ * @return Returns false if the name is unknown
+ *
+ */
+bool parse_map_precision(const char *name, MapPrecision *precision) {
+    if (strcmp(name, "fp32") == 0) {
+        *precision = MAP_FP32;
+    } else if (strcmp(name, "fp16") == 0) {
+        *precision = MAP_FP16;
+    } else if (strcmp(name, "q16") == 0) {
+        *precision = MAP_Q16;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Returns the name of a map precision
+ *
+ */
+const char *map_precision_name(const MapPrecision precision) {
+    switch (precision) {
+        case MAP_FP16:  return "fp16";
+        case MAP_Q16:   return "q16";
+        default:        return "fp32";
+    }
+}
+
+/*
+ * @brief Returns the memory held by the depth and confidence map of one pixel
+ *
+ */
+size_t map_pixel_bytes(const MapPrecision precision) {
+    switch (precision) {
+        case MAP_FP16:  return 2 * sizeof(float16_t);
+        case MAP_Q16:   return sizeof(uint16_t) + sizeof(uint8_t);
+        default:        return 2 * sizeof(float);
+    }
+}
+
+/*
+ * @brief Derives the 16-bit depth quantization of a view from its camera bounds
+ *
+ * The quantized range starts at the minimum depth and covers 256 depth increments, with
+ * Q16_STEPS_PER_INCREMENT steps per increment.
+ *
+ * @param bounds        - The depth bounds of the camera
+ * @param quant         - The quantization to be set
+ *
+ * @return Returns false if the bounds are not usable (no positive increment)
+ *
+ */
+bool make_depth_quant(const Bounds &bounds, DepthQuant *quant) {
+    if (!isfinite(bounds.min_dist) || !isfinite(bounds.increment) || !(bounds.increment > 0.0f)) {
+        return false;
+    }
+
+    quant->offset = bounds.min_dist;
+    quant->step = bounds.increment / Q16_STEPS_PER_INCREMENT;
+
+    return true;
+}
+
+/*
+ * @brief Converts a full-precision depth map to the given precision
+ *
+ * Depths that are not positive and finite are stored as zero (no depth) by the 16-bit
+ * quantization, and depths outside its range are clamped to it.
+ *
+ * @param depth_map     - The CV_32F depth map
+ * @param precision     - The precision
+ * @param quant         - The quantization of the view (MAP_Q16 only)
+ * @param error         - The error to be updated (may be NULL)
+ *
+ * @return Returns the converted map (the given map for MAP_FP32)
+ *
+ */
+Mat compact_depth(const Mat &depth_map, const MapPrecision precision, const DepthQuant &quant, PrecisionError *error) {
+    if (precision == MAP_FP32) {
+        return depth_map;
+    }
+
+    const int rows = depth_map.rows;
+    const int cols = depth_map.cols;
+    Mat compact(rows, cols, (precision == MAP_FP16) ? CV_16F : CV_16U);
+
+    size_t depth_pixels = 0;
+    size_t clipped = 0;
+    double abs_sum = 0.0;
+    double rel_sum = 0.0;
+    float abs_max = 0.0f;
+    float rel_max = 0.0f;
+
+    #pragma omp parallel for reduction(+:depth_pixels,clipped,abs_sum,rel_sum) reduction(max:abs_max,rel_max)
+    for (int r=0; r<rows; ++r) {
+        const float *depth_row = depth_map.ptr<float>(r);
+
+        if (precision == MAP_FP16) {
+            float16_t *out = compact.ptr<float16_t>(r);
+            for (int c=0; c<cols; ++c) {
+                out[c] = float16_t(depth_row[c]);
+            }
+        } else {
+            uint16_t *out = compact.ptr<uint16_t>(r);
+            for (int c=0; c<cols; ++c) {
+                const float d = depth_row[c];
+
+                if (!(d > 0.0f) || d == HUGE_VALF) {
+                    out[c] = 0;
+                    continue;
+                }
+
+                const float k = roundf((d - quant.offset) / quant.step);
+                if (k < 0.0f || k > 65534.0f) {
+                    ++clipped;
+                }
+                out[c] = (uint16_t) (min(max(k, 0.0f), 65534.0f) + 1.0f);
+            }
+        }
+
+        // error of the widened row against the full-precision row
+        vector<float> widened(cols);
+        const float *decoded = widen_row(compact, &quant, r, 0, cols, widened.data());
+        for (int c=0; c<cols; ++c) {
+            const float d = depth_row[c];
+
+            if (!(d > 0.0f) || d == HUGE_VALF) {
+                continue;
+            }
+
+            const float abs_err = fabs(decoded[c] - d);
+            ++depth_pixels;
+            abs_sum += abs_err;
+            rel_sum += abs_err / d;
+            abs_max = max(abs_max, abs_err);
+            rel_max = max(rel_max, abs_err / d);
+        }
+    }
+
+    if (error != NULL) {
+        error->depth_pixels += depth_pixels;
+        error->depth_abs_sum += abs_sum;
+        error->depth_rel_sum += rel_sum;
+        error->depth_abs_max = max(error->depth_abs_max, abs_max);
+        error->depth_rel_max = max(error->depth_rel_max, rel_max);
+        error->clipped += clipped;
+    }
+
+    return compact;
+}
+
+/*
+ * @brief Converts a full-precision confidence map to the given precision
+ *
+ * The 8-bit quantization covers [0, 1] in steps of 1/255; other values are clamped.
+ *
+ * @param conf_map      - The CV_32F confidence map
+ * @param precision     - The precision
+ * @param error         - The error to be updated (may be NULL)
+ *
+ * @return Returns the converted map (the given map for MAP_FP32)
+ *
+ */
+Mat compact_conf(const Mat &conf_map, const MapPrecision precision, PrecisionError *error) {
+    if (precision == MAP_FP32) {
+        return conf_map;
+    }
+
+    const int rows = conf_map.rows;
+    const int cols = conf_map.cols;
+    Mat compact(rows, cols, (precision == MAP_FP16) ? CV_16F : CV_8U);
+
+    size_t conf_pixels = 0;
+    double abs_sum = 0.0;
+    float abs_max = 0.0f;
+
+    #pragma omp parallel for reduction(+:conf_pixels,abs_sum) reduction(max:abs_max)
+    for (int r=0; r<rows; ++r) {
+        const float *conf_row = conf_map.ptr<float>(r);
+
+        if (precision == MAP_FP16) {
+            float16_t *out = compact.ptr<float16_t>(r);
+            for (int c=0; c<cols; ++c) {
+                out[c] = float16_t(conf_row[c]);
+            }
+        } else {
+            uint8_t *out = compact.ptr<uint8_t>(r);
+            for (int c=0; c<cols; ++c) {
+                const float q = roundf(conf_row[c] * 255.0f);
+                out[c] = (q >= 0.0f) ? (uint8_t) min(q, 255.0f) : 0;
+            }
+        }
+
+        vector<float> widened(cols);
+        const float *decoded = widen_row(compact, NULL, r, 0, cols, widened.data());
+        for (int c=0; c<cols; ++c) {
+            if (!isfinite(conf_row[c])) {
+                continue;
+            }
+
+            const float abs_err = fabs(decoded[c] - conf_row[c]);
+            ++conf_pixels;
+            abs_sum += abs_err;
+            abs_max = max(abs_max, abs_err);
+        }
+    }
+
+    if (error != NULL) {
+        error->conf_pixels += conf_pixels;
+        error->conf_abs_sum += abs_sum;
+        error->conf_abs_max = max(error->conf_abs_max, abs_max);
+    }
+
+    return compact;
+}
+
+/*
+ * @brief Widens a map held in any precision into a CV_32F map
+ *
+ * @param map           - The map
+ * @param quant         - The quantization of a CV_16U depth map (unused otherwise)
+ * @param out           - The CV_32F map to be populated (written in place if it has the right size)
+ *
+ */
+void widen_map(const Mat &map, const DepthQuant *quant, Mat &out) {
+    if (map.type() == CV_32F) {
+        map.copyTo(out);
+        return;
+    }
+
+    out.create(map.size(), CV_32F);
+
+    #pragma omp parallel for
+    for (int r=0; r<map.rows; ++r) {
+        float *out_row = out.ptr<float>(r);
+        const float *row = widen_row(map, quant, r, 0, map.cols, out_row);
+
+        if (row != out_row) {
+            memcpy(out_row, row, map.cols * sizeof(float));
+        }
+    }
+}
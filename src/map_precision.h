@@ -0,0 +1,97 @@
+#ifndef _MAP_PRECISION_H_
+#define _MAP_PRECISION_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <stdint.h>
+#include <math.h>
+
+
+struct Bounds;
+
+// precision of the depth and confidence maps held in memory
+enum MapPrecision {
+    MAP_FP32,       // depth and confidence as CV_32F (8 bytes per pixel)
+    MAP_FP16,       // depth and confidence as CV_16F (4 bytes per pixel)
+    MAP_Q16         // depth quantized to CV_16U with the camera bounds, confidence to CV_8U (3 bytes per pixel)
+};
+
+// quantization steps per depth increment of the camera bounds (256 increments fit in 16 bits)
+#define Q16_STEPS_PER_INCREMENT 256
+
+// quantization of a CV_16U depth map: code 0 holds no depth, code k holds offset + (k-1)*step
+struct DepthQuant {
+    float offset = 0.0f;
+    float step = 0.0f;
+};
+
+// structure to hold the error of reduced-precision maps against the full-precision maps
+struct PrecisionError {
+    size_t depth_pixels = 0;        // pixels with a positive, finite depth
+    double depth_abs_sum = 0.0;
+    double depth_rel_sum = 0.0;
+    float depth_abs_max = 0.0f;
+    float depth_rel_max = 0.0f;
+    size_t clipped = 0;             // depths outside the quantized range (clamped to it)
+    size_t conf_pixels = 0;
+    double conf_abs_sum = 0.0;
+    float conf_abs_max = 0.0f;
+
+    void add(const PrecisionError &other);
+    void print(const char *label) const;
+};
+
+// precision selection
+bool parse_map_precision(const char *name, MapPrecision *precision);
+const char *map_precision_name(const MapPrecision precision);
+size_t map_pixel_bytes(const MapPrecision precision);
+bool make_depth_quant(const Bounds &bounds, DepthQuant *quant);
+
+// conversion of full-precision maps (the error against them is added to error, if not NULL)
+cv::Mat compact_depth(const cv::Mat &depth_map, const MapPrecision precision, const DepthQuant &quant, PrecisionError *error);
+cv::Mat compact_conf(const cv::Mat &conf_map, const MapPrecision precision, PrecisionError *error);
+void widen_map(const cv::Mat &map, const DepthQuant *quant, cv::Mat &out);
+
+/*
+ * @brief Returns the columns [c_start, c_end) of a row of a map held in any precision as floats
+ *
+ * CV_32F rows are returned in place; other rows are widened into the buffer. Element 0 of
+ * the result is column c_start.
+ *
+ * @param map           - The map (CV_32F, CV_16F, CV_16U depth or CV_8U confidence)
+ * @param quant         - The quantization of a CV_16U depth map (unused otherwise)
+ * @param r             - The row
+ * @param c_start       - The first column
+ * @param c_end         - One past the last column
+ * @param buffer        - Room for c_end-c_start floats
+ *
+ */
+inline const float *widen_row(const cv::Mat &map, const DepthQuant *quant, const int r, const int c_start, const int c_end, float *buffer) {
+    switch (map.depth()) {
+        case CV_16F: {
+            const cv::float16_t *row = map.ptr<cv::float16_t>(r);
+            for (int c=c_start; c<c_end; ++c) {
+                buffer[c-c_start] = (float) row[c];
+            }
+            return buffer;
+        }
+        case CV_16U: {
+            const uint16_t *row = map.ptr<uint16_t>(r);
+            for (int c=c_start; c<c_end; ++c) {
+                buffer[c-c_start] = (row[c] == 0) ? 0.0f : quant->offset + (float) (row[c]-1) * quant->step;
+            }
+            return buffer;
+        }
+        case CV_8U: {
+            const uint8_t *row = map.ptr<uint8_t>(r);
+            for (int c=c_start; c<c_end; ++c) {
+                buffer[c-c_start] = row[c] * (1.0f / 255.0f);
+            }
+            return buffer;
+        }
+        default:
+            return map.ptr<float>(r) + c_start;
+    }
+}
+
+#endif
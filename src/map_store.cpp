@@ -0,0 +1,332 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+
+#include "util.h"
+#include "map_store.h"
+
+/*
+ * @brief Creates an empty map store for a scene
+ *
+ * @param files         - The depth and confidence map files of every view, indexed by view
+ * @param views         - The supporting views of every reference view
+ * @param order         - The reference views that will be acquired during the run
+ * @param view_bytes    - The memory held by the depth and confidence map of one view
+ * @param size          - The size of every map of the scene
+ * @param budget_bytes  - The maximum memory held by the resident maps (0 = unlimited)
+ * @param precision     - The precision the maps are held in
+ * @param quant         - The depth quantization of every view (MAP_Q16 only)
+ * @param load_threads  - The threads decoding the maps of a reference view
+ *
+ */
+MapStore::MapStore(
+        const SceneFiles &files,
+        const vector<vector<int>> &views,
+        const vector<int> &order,
+        const size_t view_bytes,
+        const Size size,
+        const size_t budget_bytes,
+        const MapPrecision precision,
+        const vector<DepthQuant> &quant,
+        const int load_threads) :
+    files(files),
+    views(views),
+    view_bytes(view_bytes),
+    size(size),
+    budget_bytes(budget_bytes > 0 ? budget_bytes : ~((size_t) 0)),
+    precision(precision),
+    quant(quant),
+    load_threads(max(1, load_threads)),
+    depth(files.depth_files.size()),
+    conf(files.depth_files.size()),
+    state(files.depth_files.size(), EMPTY),
+    pending(files.depth_files.size(), 0),
+    in_use(files.depth_files.size(), 0),
+    loaded_once(files.depth_files.size(), false),
+    active_refs(0)
+{
+    // count how many of the scheduled reference views need each view
+    for (int index : order) {
+        for (int v : views[index]) {
+            ++pending[v];
+        }
+    }
+
+    counters.loads = 0;
+    counters.reloads = 0;
+    counters.evictions = 0;
+    counters.over_budget = 0;
+    counters.invalid = 0;
+    counters.resident_bytes = 0;
+    counters.peak_bytes = 0;
+}
+
+/*
+ * @brief Returns the memory needed to load the views of a reference view that are not resident
+ *
+ * Must be called with the lock held.
+ *
+ * @param index         - The reference view
+ *
+ */
+size_t MapStore::missing_bytes(const int index) const {
+    size_t bytes = 0;
+
+    for (int v : views[index]) {
+        if (state[v] == EMPTY) {
+            bytes += view_bytes;
+        }
+    }
+
+    return bytes;
+}
+
+/*
+ * @brief Drops the maps of a view
+ *
+ * Must be called with the lock held.
+ *
+ * @param v             - The view to be dropped
+ *
+ */
+void MapStore::evict(const int v) {
+    depth[v].release();
+    conf[v].release();
+    state[v] = EMPTY;
+    counters.resident_bytes -= view_bytes;
+    ++counters.evictions;
+}
+
+/*
+ * @brief Drops idle maps until the given number of bytes fits in the budget
+ *
+ * Idle maps needed by the fewest pending reference views are dropped first. The views of the
+ * reference view being admitted are kept, since it is about to use them.
+ * Must be called with the lock held.
+ *
+ * @param index         - The reference view being admitted
+ * @param bytes         - The number of bytes that are about to be loaded
+ *
+ * @return Returns false if the bytes do not fit even with every other idle map dropped
+ *
+ */
+bool MapStore::make_room(const int index, const size_t bytes) {
+    const vector<int> &needed = views[index];
+
+    while (counters.resident_bytes + bytes > budget_bytes) {
+        int victim = -1;
+
+        for (size_t v=0; v<state.size(); ++v) {
+            if (state[v] == RESIDENT && in_use[v] == 0 && (victim < 0 || pending[v] < pending[victim]) &&
+                    find(needed.begin(), needed.end(), (int) v) == needed.end()) {
+                victim = v;
+            }
+        }
+
+        if (victim < 0) {
+            return false;
+        }
+
+        evict(victim);
+    }
+
+    return true;
+}
+
+/*
+ * @brief Makes the maps of a reference view and its supporting views available
+ *
+ * Blocks until the missing maps fit in the budget (or no other reference view is active),
+ * then loads them. Maps that are being loaded by another worker are waited for. The reference
+ * view must be released even if its maps are not available.
+ *
+ * @param index         - The reference view about to be fused
+ * @param depth_maps    - The container (indexed by view) to be populated with the depth maps
+ * @param conf_maps     - The container (indexed by view) to be populated with the confidence maps
+ *
+ * @return Returns false if the maps of a view could not be read or differ in size from the scene
+ *
+ */
+bool MapStore::acquire(const int index, vector<Mat> &depth_maps, vector<Mat> &conf_maps) {
+    vector<int> to_load;
+
+    unique_lock<mutex> guard(lock);
+
+    // wait for admission
+    for (;;) {
+        size_t bytes = missing_bytes(index);
+
+        if (make_room(index, bytes)) {
+            break;
+        }
+
+        // nothing else will free memory: the reference view runs over the budget
+        if (active_refs == 0) {
+            if (counters.over_budget++ == 0) {
+                fprintf(stderr, "Warning: the maps of reference view %d need %.1f MB, more than the memory budget of %.1f MB allows.\n",
+                        index, (counters.resident_bytes + bytes) / (1024.0*1024.0), budget_bytes / (1024.0*1024.0));
+            }
+            break;
+        }
+
+        changed.wait(guard);
+    }
+
+    // reserve the views, claiming the ones nobody is loading yet
+    ++active_refs;
+    for (int v : views[index]) {
+        ++in_use[v];
+
+        if (state[v] == EMPTY) {
+            state[v] = LOADING;
+            counters.resident_bytes += view_bytes;
+            to_load.push_back(v);
+        }
+    }
+    counters.peak_bytes = max(counters.peak_bytes, counters.resident_bytes);
+
+    // load the claimed views outside of the lock
+    guard.unlock();
+
+    SceneData loaded;
+    PrecisionError new_error;
+    if (!to_load.empty()) {
+        load_scene_maps(files, to_load, &loaded, load_threads);
+    }
+    for (int v : to_load) {
+        // unreadable or truncated files load as empty maps
+        if (loaded.depth_maps[v].size() != size || loaded.conf_maps[v].size() != size) {
+            loaded.depth_maps[v] = Mat();
+            loaded.conf_maps[v] = Mat();
+            continue;
+        }
+        loaded.depth_maps[v] = compact_depth(loaded.depth_maps[v], precision, (precision == MAP_Q16) ? quant[v] : DepthQuant(), &new_error);
+        loaded.conf_maps[v] = compact_conf(loaded.conf_maps[v], precision, &new_error);
+    }
+
+    guard.lock();
+    error.add(new_error);
+    timings.insert(timings.end(), loaded.timings.begin(), loaded.timings.end());
+
+    for (int v : to_load) {
+        if (loaded.depth_maps[v].empty()) {
+            fprintf(stderr, "Error: the maps of view %d could not be read or are not %dx%d.\n", v, size.width, size.height);
+            state[v] = INVALID;
+            counters.resident_bytes -= view_bytes;
+            ++counters.invalid;
+            continue;
+        }
+
+        depth[v] = loaded.depth_maps[v];
+        conf[v] = loaded.conf_maps[v];
+        state[v] = RESIDENT;
+
+        ++counters.loads;
+        if (loaded_once[v]) {
+            ++counters.reloads;
+        }
+        loaded_once[v] = true;
+    }
+    changed.notify_all();
+
+    // wait for the views claimed by other workers
+    bool ok = true;
+    for (int v : views[index]) {
+        while (state[v] == LOADING) {
+            changed.wait(guard);
+        }
+
+        if (state[v] == INVALID) {
+            ok = false;
+            continue;
+        }
+
+        depth_maps[v] = depth[v];
+        conf_maps[v] = conf[v];
+    }
+
+    return ok;
+}
+
+/*
+ * @brief Returns the maps of a fused reference view to the store
+ *
+ * Views that no pending reference view needs anymore are dropped immediately.
+ *
+ * @param index         - The reference view that was fused
+ * @param depth_maps    - The container of depth maps populated by acquire()
+ * @param conf_maps     - The container of confidence maps populated by acquire()
+ *
+ */
+void MapStore::release(const int index, vector<Mat> &depth_maps, vector<Mat> &conf_maps) {
+    lock_guard<mutex> guard(lock);
+
+    for (int v : views[index]) {
+        depth_maps[v].release();
+        conf_maps[v].release();
+
+        --in_use[v];
+        --pending[v];
+
+        if (pending[v] <= 0 && in_use[v] == 0 && state[v] == RESIDENT) {
+            evict(v);
+        }
+    }
+
+    --active_refs;
+    changed.notify_all();
+}
+
+/*
+ * @brief Returns a snapshot of the store counters
+ *
+ */
+MapStoreStats MapStore::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+/*
+ * @brief Returns the error of the reduced-precision maps loaded so far
+ *
+ */
+PrecisionError MapStore::precision_error() const {
+    lock_guard<mutex> guard(lock);
+    return error;
+}
+
+/*
+ * @brief Returns the load timings of every map file loaded so far
+ *
+ */
+vector<LoadTiming> MapStore::load_timings() const {
+    lock_guard<mutex> guard(lock);
+    return timings;
+}
+
+/*
+ * @brief Prints the store counters
+ *
+ */
+void MapStore::print_stats() const {
+    MapStoreStats s = stats();
+
+    printf("Map store: %zu loads (%zu reloads), %zu evictions, %.1f MB peak resident\n",
+            s.loads,
+            s.reloads,
+            s.evictions,
+            s.peak_bytes / (1024.0*1024.0));
+
+    if (s.invalid > 0) {
+        printf("Map store: %zu view(s) with unreadable maps or maps of the wrong size\n", s.invalid);
+    }
+
+    if (s.over_budget > 0) {
+        printf("Map store: %zu reference view(s) admitted over the %.1f MB budget\n", s.over_budget, budget_bytes / (1024.0*1024.0));
+    }
+
+    if (precision != MAP_FP32) {
+        precision_error().print((string("Maps held as ") + map_precision_name(precision)).c_str());
+    }
+}
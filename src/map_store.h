@@ -0,0 +1,100 @@
+#ifndef _MAP_STORE_H_
+#define _MAP_STORE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "map_precision.h"
+#include "scene_loader.h"
+
+using namespace std;
+using namespace cv;
+
+// structure to hold the counters of a map store
+struct MapStoreStats {
+    size_t loads;
+    size_t reloads;
+    size_t evictions;
+    size_t over_budget;         // reference views admitted although their maps did not fit in the budget
+    size_t invalid;             // views whose maps could not be read or differ in size from the scene
+    size_t resident_bytes;
+    size_t peak_bytes;
+};
+
+/*
+ * On-demand, memory-budgeted storage of the depth and confidence maps of a scene.
+ *
+ * Instead of holding every map of the scene, the maps of a view are loaded the first time a
+ * reference view that needs them is acquired, decoded concurrently by the scene loader (see
+ * load_scene_maps()), which also times every file. Every view counts the reference views that
+ * still have to be fused with it (from the pair graph), and its maps are dropped as soon as
+ * that count reaches zero. When the budget is exceeded, idle maps that are still pending are
+ * dropped as well and loaded again later. A reference view is only admitted once its maps
+ * fit in the budget, unless no other reference view is active, so the peak memory is bounded
+ * by max(budget, maps of one pair list) instead of by the size of the scene. The maps of the
+ * reference view being admitted are never dropped to make room for it, and admissions over
+ * the budget are counted and reported. Maps that cannot be read or differ in size from the
+ * scene are never handed out: the reference views that need them fail instead.
+ *
+ * The maps can be held in reduced precision (see map_precision.h): they are converted as
+ * they are loaded and widened to floats by the render and consensus passes as they read them.
+ */
+class MapStore {
+    public:
+        MapStore(
+                const SceneFiles &files,
+                const vector<vector<int>> &views,
+                const vector<int> &order,
+                const size_t view_bytes,
+                const Size size,
+                const size_t budget_bytes,
+                const MapPrecision precision,
+                const vector<DepthQuant> &quant,
+                const int load_threads);
+
+        bool acquire(const int index, vector<Mat> &depth_maps, vector<Mat> &conf_maps);
+        void release(const int index, vector<Mat> &depth_maps, vector<Mat> &conf_maps);
+
+        const vector<DepthQuant> &depth_quant() const { return quant; }
+
+        MapStoreStats stats() const;
+        PrecisionError precision_error() const;
+        vector<LoadTiming> load_timings() const;
+        void print_stats() const;
+
+    private:
+        enum State { EMPTY, LOADING, RESIDENT, INVALID };
+
+        const SceneFiles files;
+        const vector<vector<int>> &views;
+        const size_t view_bytes;
+        const Size size;
+        const size_t budget_bytes;
+        const MapPrecision precision;
+        const vector<DepthQuant> quant;
+        const int load_threads;
+
+        mutable mutex lock;
+        condition_variable changed;
+
+        vector<Mat> depth;
+        vector<Mat> conf;
+        vector<State> state;
+        vector<int> pending;        // reference views that still need the view
+        vector<int> in_use;         // active reference views using the view
+        vector<bool> loaded_once;
+        int active_refs;
+        MapStoreStats counters;
+        PrecisionError error;       // of the reduced-precision maps, over every load
+        vector<LoadTiming> timings; // of every map file loaded
+
+        size_t missing_bytes(const int index) const;
+        bool make_room(const int index, const size_t bytes);
+        void evict(const int v);
+};
+
+#endif
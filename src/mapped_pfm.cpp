@@ -0,0 +1,186 @@
+#include "opencv2/core/core.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "mapped_pfm.h"
+
+/*
+ * @brief Reads the next whitespace-delimited token of the header
+ *
+ * @param data          - The mapped file
+ * @param size          - The size of the mapped file
+ * @param pos           - The current position; advanced past the token
+ * @param token         - The buffer to be populated with the token
+ * @param max_len       - The size of the token buffer
+ *
+ * @return Returns true if a token was read
+ *
+ */
+static bool next_token(const char *data, const size_t size, size_t *pos, char *token, const size_t max_len) {
+    while (*pos < size && isspace((unsigned char) data[*pos])) {
+        ++(*pos);
+    }
+
+    size_t len = 0;
+    while (*pos < size && !isspace((unsigned char) data[*pos]) && len < max_len-1) {
+        token[len++] = data[(*pos)++];
+    }
+    token[len] = '\0';
+
+    return len > 0;
+}
+
+/*
+ * @brief Maps a PFM file into memory and parses its header
+ *
+ * @param filePath      - The file path of the PFM to be mapped
+ *
+ */
+MappedPfm::MappedPfm(const string &filePath) :
+    mapping(MAP_FAILED),
+    mapping_size(0),
+    payload(NULL),
+    width(0),
+    height(0),
+    num_channels(0),
+    native_endian(true)
+{
+    int fd = open(filePath.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    mapping_size = st.st_size;
+
+    mapping = mmap(NULL, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (mapping == MAP_FAILED) {
+        return;
+    }
+
+    // the payload is read front to back
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    size_t offset;
+    if (!parse_header((const char *) mapping, mapping_size, &offset)) {
+        fprintf(stderr, "Error: malformed PFM header in %s.\n", filePath.c_str());
+        return;
+    }
+
+    payload = (const char *) mapping + offset;
+}
+
+/*
+ * @brief Unmaps the file
+ *
+ */
+MappedPfm::~MappedPfm() {
+    if (mapping != MAP_FAILED) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+/*
+ * @brief Parses the header of a mapped PFM file
+ *
+ * The header is 'PF' (3 channels) or 'Pf' (1 channel), the width, the height and a scale
+ * factor whose sign gives the byte order of the payload (negative: little endian),
+ * separated by whitespace. Exactly one whitespace character precedes the payload.
+ *
+ * @param data          - The mapped file
+ * @param size          - The size of the mapped file
+ * @param offset        - The container to be populated with the offset of the payload
+ *
+ * @return Returns true if the header is valid and the file holds the whole payload
+ *
+ */
+bool MappedPfm::parse_header(const char *data, const size_t size, size_t *offset) {
+    char token[64];
+    size_t pos = 0;
+
+    if (!next_token(data, size, &pos, token, sizeof(token))) {
+        return false;
+    }
+
+    if (strcmp(token, "PF") == 0) {
+        num_channels = 3;
+    } else if (strcmp(token, "Pf") == 0) {
+        num_channels = 1;
+    } else {
+        return false;
+    }
+
+    if (!next_token(data, size, &pos, token, sizeof(token)) || (width = atoi(token)) <= 0) {
+        return false;
+    }
+    if (!next_token(data, size, &pos, token, sizeof(token)) || (height = atoi(token)) <= 0) {
+        return false;
+    }
+    if (!next_token(data, size, &pos, token, sizeof(token))) {
+        return false;
+    }
+
+    const bool file_little_endian = (atof(token) < 0.0);
+#if defined(__BYTE_ORDER__) && (__BYTE_ORDER__ == __ORDER_BIG_ENDIAN__)
+    native_endian = !file_little_endian;
+#else
+    native_endian = file_little_endian;
+#endif
+
+    // skip the single whitespace character terminating the header
+    *offset = pos + 1;
+
+    const size_t payload_size = (size_t) width * height * num_channels * sizeof(float);
+    return (*offset <= size && size - *offset >= payload_size);
+}
+
+/*
+ * @brief Copies the payload into a top-down, native-endian matrix
+ *
+ * @return Returns the CV_32FC1 or CV_32FC3 (BGR) image (empty if the file is not open)
+ *
+ */
+Mat MappedPfm::to_mat() const {
+    if (!is_open()) {
+        return Mat();
+    }
+
+    Mat image(height, width, CV_MAKETYPE(CV_32F, num_channels));
+    const size_t row_bytes = (size_t) width * num_channels * sizeof(float);
+
+    //In the PFM format the image is upside down
+    for (int i=0; i<height; ++i) {
+        uchar *dst = image.ptr(height-1-i);
+        memcpy(dst, payload + i*row_bytes, row_bytes);
+
+        if (!native_endian) {
+            uint32_t *words = (uint32_t *) dst;
+            for (size_t j=0; j<row_bytes/sizeof(uint32_t); ++j) {
+                words[j] = __builtin_bswap32(words[j]);
+            }
+        }
+    }
+
+    //OpenCV stores the color as BGR
+    if (num_channels == 3) {
+        cvtColor(image, image, COLOR_RGB2BGR);
+    }
+
+    return image;
+}
@@ -0,0 +1,49 @@
+#ifndef _MAPPED_PFM_H_
+#define _MAPPED_PFM_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <string>
+
+using namespace std;
+using namespace cv;
+
+/*
+ * Read-only memory mapping of a PFM file.
+ *
+ * The header is parsed once when the file is mapped, and the pixel payload is not read
+ * until it is accessed. PFM stores its rows bottom-up, and a cv::Mat cannot express a
+ * negative row stride, so the maps are not used in place: to_mat() makes a top-down,
+ * native-endian, BGR copy with one memcpy per row, straight from the page cache.
+ */
+class MappedPfm {
+    public:
+        MappedPfm(const string &filePath);
+        ~MappedPfm();
+
+        bool is_open() const { return payload != NULL; }
+        bool is_native_endian() const { return native_endian; }
+
+        int rows() const { return height; }
+        int cols() const { return width; }
+        int channels() const { return num_channels; }
+
+        Mat to_mat() const;
+
+    private:
+        MappedPfm(const MappedPfm &);
+        MappedPfm &operator=(const MappedPfm &);
+
+        void *mapping;
+        size_t mapping_size;
+        const char *payload;
+
+        int width;
+        int height;
+        int num_channels;
+        bool native_endian;
+
+        bool parse_header(const char *data, const size_t size, size_t *offset);
+};
+
+#endif
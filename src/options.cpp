@@ -0,0 +1,278 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <fstream>
+#include <sstream>
+
+#include "options.h"
+
+/*
+ * @brief Prints the command-line usage and exits
+ *
+ * @param exe           - The name of the executable
+ *
+ */
+static void usage(const char *exe) {
+    fprintf(stderr, "Error: usage %s <data-root-path> <output-path> <scene> <num-views> <conf-pre-filt> <conf-post-filt> <epsilon> [options]\n", exe);
+    fprintf(stderr, "       %s <data-root-path> <output-path> - <num-views> <conf-pre-filt> <conf-post-filt> <epsilon> --batch <manifest> [options]\n", exe);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --threads <n>        total number of worker threads (default: $FUSION_THREADS, or all cores)\n");
+    fprintf(stderr, "  --cache-mb <n>       memory budget of the back-projected source view cache (default: 0, disabled)\n");
+    fprintf(stderr, "  --mem-budget-mb <n>  memory budget of the resident depth and confidence maps (default: 0, unlimited)\n");
+    fprintf(stderr, "  --writer-threads <n> number of background output writer threads (default: 1)\n");
+    fprintf(stderr, "  --write-queue <n>    number of fused views that may wait to be written (default: 4)\n");
+    fprintf(stderr, "  --loader-threads <n> number of pipeline threads loading maps (default: 2)\n");
+    fprintf(stderr, "  --render-threads <n> number of pipeline threads rendering views (default: from --threads)\n");
+    fprintf(stderr, "  --fuse-threads <n>   number of pipeline threads fusing views (default: from --threads)\n");
+    fprintf(stderr, "  --pipeline-queue <n> number of views that may wait between pipeline stages (default: 2)\n");
+    fprintf(stderr, "  --kernel <name>      consensus kernel: auto, scalar, avx2 or avx512 (default: auto)\n");
+    fprintf(stderr, "  --stats <path>       JSON file for the stage timers and fusion counters (default: <output-path>fusion_stats.json)\n");
+    fprintf(stderr, "  --map-precision <p>  precision of the maps held in memory: fp32, fp16 or q16 (default: fp32)\n");
+    fprintf(stderr, "  --render-tile <px>   render the supporting views tile by tile, with tiles of this size (default: 0, disabled)\n");
+    fprintf(stderr, "  --merge-voxel <size> write all fused views as one cloud merged at this voxel size (default: 0, disabled)\n");
+    fprintf(stderr, "  --archive            write the fused maps into one compressed archive per scene (fused_views.far) instead of PFM and PNG files\n");
+    fprintf(stderr, "  --incremental        only fuse the reference views whose inputs or supporting views changed since the last run (<output-path>fusion_state.txt)\n");
+    fprintf(stderr, "  --stream <source>    fuse frames as they arrive on stdin ('-'), a pipe or 'unix:<socket-path>' instead of a scene directory\n");
+    fprintf(stderr, "  --stream-lookahead <n> frames after a streamed frame that it is fused with (default: 0)\n");
+    fprintf(stderr, "  --stream-max-lag <n> drop streamed frames more than n frames behind the newest frame (default: 0, never)\n");
+    fprintf(stderr, "  --batch <manifest>   fuse every scene listed in the manifest ('<scene> [<data-root-path> [<output-path>]]' per line)\n");
+    fprintf(stderr, "  --plan-shards <n>    split the scene into n shards and write the work manifest <output-path>shards.txt\n");
+    fprintf(stderr, "  --shard <k>          fuse shard k of the work manifest\n");
+    fprintf(stderr, "  --verify             check that every shard and view of the work manifest is complete\n");
+    exit(EXIT_FAILURE);
+}
+
+/*
+ * @brief Appends a trailing '/' to a directory path if it is missing
+ *
+ * @param path          - The directory path to be formatted
+ *
+ */
+static void add_trailing_slash(string &path) {
+    if (path.empty() || path[path.length()-1] != '/') {
+        path += "/";
+    }
+}
+
+/*
+ * @brief Parses the command-line arguments of a fusion run
+ *
+ * @param argc          - The number of command-line arguments
+ * @param argv          - The command-line arguments
+ * @param opts          - The container to be populated with the parsed options
+ *
+ */
+void parse_options(int argc, char **argv, FusionOptions *opts) {
+    // check for proper command-line usage
+    if (argc < 8) {
+        usage(argv[0]);
+    }
+
+    // read in positional args
+    opts->data_path = argv[1];
+    opts->output_path = argv[2];
+    opts->scene = argv[3];
+    opts->num_views = atoi(argv[4]);
+    opts->conf_pre_filt = atof(argv[5]);
+    opts->conf_post_filt = atof(argv[6]);
+    opts->support_ratio = atof(argv[7]);
+
+    // string formatting to add '/' to the paths if it is missing from the input
+    add_trailing_slash(opts->data_path);
+    add_trailing_slash(opts->output_path);
+
+    // defaults for the optional flags (environment variables are overridden by flags)
+    const char *env_threads = getenv("FUSION_THREADS");
+    opts->num_threads = (env_threads != NULL) ? atoi(env_threads) : 0;
+    opts->cache_mb = 0;
+    opts->mem_budget_mb = 0;
+    opts->writer_threads = 1;
+    opts->write_queue = 4;
+    opts->loader_threads = 2;
+    opts->render_threads = 0;
+    opts->fuse_threads = 0;
+    opts->pipeline_queue = 2;
+    opts->kernel = "auto";
+    opts->stats_path = "";
+    opts->map_precision = "fp32";
+    opts->render_tile = 0;
+    opts->merge_voxel = 0.0f;
+    opts->plan_shards = 0;
+    opts->shard = -1;
+    opts->verify = false;
+    opts->archive = false;
+    opts->incremental = false;
+    opts->stream_lookahead = 0;
+    opts->stream_max_lag = 0;
+
+    // read in optional flags
+    for (int i=8; i<argc; ++i) {
+        if (strcmp(argv[i], "--threads") == 0 && i+1 < argc) {
+            opts->num_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--cache-mb") == 0 && i+1 < argc) {
+            opts->cache_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--mem-budget-mb") == 0 && i+1 < argc) {
+            opts->mem_budget_mb = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--writer-threads") == 0 && i+1 < argc) {
+            opts->writer_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--write-queue") == 0 && i+1 < argc) {
+            opts->write_queue = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--loader-threads") == 0 && i+1 < argc) {
+            opts->loader_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--render-threads") == 0 && i+1 < argc) {
+            opts->render_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fuse-threads") == 0 && i+1 < argc) {
+            opts->fuse_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pipeline-queue") == 0 && i+1 < argc) {
+            opts->pipeline_queue = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--kernel") == 0 && i+1 < argc) {
+            opts->kernel = argv[++i];
+        } else if (strcmp(argv[i], "--stats") == 0 && i+1 < argc) {
+            opts->stats_path = argv[++i];
+        } else if (strcmp(argv[i], "--map-precision") == 0 && i+1 < argc) {
+            opts->map_precision = argv[++i];
+        } else if (strcmp(argv[i], "--render-tile") == 0 && i+1 < argc) {
+            opts->render_tile = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--merge-voxel") == 0 && i+1 < argc) {
+            opts->merge_voxel = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i+1 < argc) {
+            opts->batch_path = argv[++i];
+        } else if (strcmp(argv[i], "--plan-shards") == 0 && i+1 < argc) {
+            opts->plan_shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shard") == 0 && i+1 < argc) {
+            opts->shard = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--verify") == 0) {
+            opts->verify = true;
+        } else if (strcmp(argv[i], "--archive") == 0) {
+            opts->archive = true;
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            opts->incremental = true;
+        } else if (strcmp(argv[i], "--stream") == 0 && i+1 < argc) {
+            opts->stream_source = argv[++i];
+        } else if (strcmp(argv[i], "--stream-lookahead") == 0 && i+1 < argc) {
+            opts->stream_lookahead = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stream-max-lag") == 0 && i+1 < argc) {
+            opts->stream_max_lag = atoi(argv[++i]);
+        } else {
+            fprintf(stderr, "Error: unknown option '%s'.\n", argv[i]);
+            usage(argv[0]);
+        }
+    }
+
+    if (opts->num_threads < 0 || opts->writer_threads < 1 || opts->write_queue < 1 ||
+            opts->loader_threads < 1 || opts->render_threads < 0 || opts->fuse_threads < 0 || opts->pipeline_queue < 1) {
+        fprintf(stderr, "Error: the number of threads and the queue size must be positive.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->render_tile < 0) {
+        fprintf(stderr, "Error: the render tile size must not be negative.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->merge_voxel < 0) {
+        fprintf(stderr, "Error: the voxel size of the merged cloud must not be negative.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // every scene of a batch writes its statistics next to its outputs
+    if (!opts->batch_path.empty() && !opts->stats_path.empty()) {
+        fprintf(stderr, "Error: --stats cannot be combined with --batch.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // a shard manifest covers a single scene, and a run either plans, fuses or verifies
+    const int shard_modes = (opts->plan_shards != 0) + (opts->shard != -1) + opts->verify;
+    if (shard_modes > 1 || (shard_modes > 0 && !opts->batch_path.empty()) || opts->plan_shards < 0 || opts->shard < -1) {
+        fprintf(stderr, "Error: use one of --plan-shards <n>, --shard <k> or --verify, without --batch.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // the state of an incremental scene covers all of its views, and the merged cloud would only hold the fused ones
+    if (opts->incremental && (shard_modes > 0 || opts->merge_voxel > 0)) {
+        fprintf(stderr, "Error: --incremental cannot be combined with sharding or --merge-voxel.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // a stream is a single, open-ended sequence of frames
+    if (!opts->stream_source.empty() && (shard_modes > 0 || !opts->batch_path.empty() || opts->incremental || opts->merge_voxel > 0)) {
+        fprintf(stderr, "Error: --stream cannot be combined with --batch, sharding, --incremental or --merge-voxel.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // streamed frames are fused from the full-precision maps they were loaded into, without
+    // the source view cache or the map store
+    if (!opts->stream_source.empty() && (opts->map_precision != "fp32" || opts->cache_mb > 0 || opts->mem_budget_mb > 0)) {
+        fprintf(stderr, "Error: --stream cannot be combined with --map-precision fp16/q16, --cache-mb or --mem-budget-mb.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (opts->stream_lookahead < 0 || opts->stream_lookahead > opts->num_views-1 || opts->stream_max_lag < 0) {
+        fprintf(stderr, "Error: the stream lookahead must be between 0 and num-views-1, and the maximum lag must not be negative.\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * @brief Lists the scenes of a run: the positional scene, or every scene of the batch manifest
+ *
+ * Every non-empty line of the manifest not starting with '#' names a scene, optionally
+ * followed by its data root path and its output path. The data root path defaults to the
+ * positional one and the output path to '<output-path><scene>/'.
+ *
+ * @param opts          - The parsed options
+ *
+ * @return Returns the scenes, in the order they should be fused
+ *
+ */
+vector<SceneEntry> list_scenes(const FusionOptions &opts) {
+    vector<SceneEntry> scenes;
+
+    if (opts.batch_path.empty()) {
+        SceneEntry entry;
+        entry.scene = opts.scene;
+        entry.data_path = opts.data_path;
+        entry.output_path = opts.output_path;
+        entry.start_view = 0;
+        entry.end_view = -1;
+        scenes.push_back(entry);
+
+        return scenes;
+    }
+
+    ifstream manifest(opts.batch_path);
+    if (!manifest) {
+        fprintf(stderr, "Error: could not open file %s.\n", opts.batch_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    string line;
+    while (getline(manifest, line)) {
+        istringstream fields(line);
+        SceneEntry entry;
+
+        if (!(fields >> entry.scene) || entry.scene[0] == '#') {
+            continue;
+        }
+        if (!(fields >> entry.data_path)) {
+            entry.data_path = opts.data_path;
+        }
+        if (!(fields >> entry.output_path)) {
+            entry.output_path = opts.output_path + entry.scene;
+        }
+
+        add_trailing_slash(entry.data_path);
+        add_trailing_slash(entry.output_path);
+        entry.start_view = 0;
+        entry.end_view = -1;
+        scenes.push_back(entry);
+    }
+
+    if (scenes.empty()) {
+        fprintf(stderr, "Error: no scenes listed in %s.\n", opts.batch_path.c_str());
+        exit(EXIT_FAILURE);
+    }
+
+    return scenes;
+}
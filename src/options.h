@@ -0,0 +1,59 @@
+#ifndef _OPTIONS_H_
+#define _OPTIONS_H_
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// structure to hold the command-line configuration of a fusion run
+struct FusionOptions {
+    // positional arguments
+    string data_path;
+    string output_path;
+    string scene;
+    int num_views;
+    float conf_pre_filt;
+    float conf_post_filt;
+    float support_ratio;
+
+    // optional flags
+    int num_threads;        // total worker threads (0 = all available cores)
+    size_t cache_mb;        // budget of the back-projected source view cache (0 = disabled)
+    size_t mem_budget_mb;   // budget of the resident depth and confidence maps (0 = unlimited)
+    int writer_threads;     // background threads writing the fused outputs
+    size_t write_queue;     // fused views that may wait to be written before fusion blocks
+    int loader_threads;     // pipeline threads loading the maps of upcoming views
+    int render_threads;     // pipeline threads rendering supporting views (0 = from the schedule)
+    int fuse_threads;       // pipeline threads running the consensus (0 = from the schedule)
+    size_t pipeline_queue;  // reference views that may wait between two pipeline stages
+    string kernel;          // consensus kernel: auto, scalar, avx2 or avx512
+    string stats_path;      // JSON file receiving the stage timers and fusion-outcome counters (empty = <output-path>fusion_stats.json)
+    string map_precision;   // precision of the maps held in memory: fp32, fp16 or q16
+    int render_tile;        // tile size of the tiled renderer (0 = scatter every sample straight into the z-buffer)
+    float merge_voxel;      // voxel size of the merged scene cloud (0 = no merged cloud)
+    string batch_path;      // manifest of the scenes to fuse in one run (empty = the positional scene only)
+    int plan_shards;        // coordinator: split the scene into this many shards and write the work manifest (0 = off)
+    int shard;              // worker: fuse this shard of the work manifest (-1 = the whole scene)
+    bool verify;            // check that every shard and view of the work manifest is complete
+    bool archive;           // write the fused maps of a scene into one compressed archive instead of PFM and PNG files
+    bool incremental;       // only fuse the reference views whose inputs or supporting views changed since the last run
+    string stream_source;   // fuse frames streamed from stdin ("-"), a pipe or "unix:<socket>" (empty = fuse the scene directories)
+    int stream_lookahead;   // frames after a streamed frame in its window
+    int stream_max_lag;     // drop streamed frames more than this many frames behind the newest one (0 = never)
+};
+
+// structure to hold a scene to be fused
+struct SceneEntry {
+    string scene;
+    string data_path;
+    string output_path;
+    int start_view;         // range of reference views to fuse: [start_view, end_view)
+    int end_view;           // (-1 = up to the last view)
+};
+
+void parse_options(int argc, char **argv, FusionOptions *opts);
+vector<SceneEntry> list_scenes(const FusionOptions &opts);
+
+#endif
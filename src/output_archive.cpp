@@ -0,0 +1,484 @@
+#include "opencv2/core/core.hpp"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+#include <map>
+
+#include "output_archive.h"
+
+using namespace std;
+using namespace cv;
+
+#define ARCHIVE_MAGIC "FUSEARC1"
+#define ARCHIVE_VERSION 1
+#define ARCHIVE_CHUNK_MAGIC 0x4B4E4843u     // 'CHNK'
+#define ARCHIVE_INDEX_MAGIC 0x58444E49u     // 'INDX'
+
+// file header of an archive (little-endian)
+struct ArchiveHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t index_offset;  // 0 while the archive is being written
+};
+
+static_assert(sizeof(ArchiveHeader) == 24 && sizeof(ArchiveChunk) == 40 && sizeof(ArchiveEntry) == 48, "archive records must not be padded");
+
+/*
+ * @brief Reads the chunk entries of an open archive
+ *
+ * Reads the index of a closed archive, or walks the chunk headers of one that was never
+ * closed, stopping at the first incomplete chunk. The entry count of the index and the
+ * payload of every entry are checked against the size of the file before anything is
+ * allocated, so a corrupt archive is rejected instead of exhausting the memory.
+ *
+ * @param fp            - The archive
+ * @param entries       - The entries to be populated
+ * @param end           - Set to the end of the last complete chunk
+ * @param indexed       - Set to true if the entries were read from the index (may be NULL)
+ *
+ * @return Returns false if the file is not an archive or its index is corrupt
+ *
+ */
+static bool read_entries(FILE *fp, vector<ArchiveEntry> *entries, uint64_t *end, bool *indexed) {
+    ArchiveHeader header;
+    if (fseeko(fp, 0, SEEK_SET) != 0 || fread(&header, sizeof(header), 1, fp) != 1 ||
+            memcmp(header.magic, ARCHIVE_MAGIC, sizeof(header.magic)) != 0 || header.version != ARCHIVE_VERSION) {
+        return false;
+    }
+
+    entries->clear();
+
+    if (indexed != NULL) {
+        *indexed = (header.index_offset != 0);
+    }
+
+    if (fseeko(fp, 0, SEEK_END) != 0) {
+        return false;
+    }
+    const uint64_t file_size = ftello(fp);
+
+    // closed archive: the index follows the last chunk
+    if (header.index_offset != 0) {
+        uint32_t index_header[2];
+        if (header.index_offset > file_size || file_size - header.index_offset < sizeof(index_header) ||
+                fseeko(fp, header.index_offset, SEEK_SET) != 0 || fread(index_header, sizeof(index_header), 1, fp) != 1 || index_header[0] != ARCHIVE_INDEX_MAGIC) {
+            return false;
+        }
+
+        if ((uint64_t) index_header[1] * sizeof(ArchiveEntry) > file_size - header.index_offset - sizeof(index_header)) {
+            return false;
+        }
+
+        entries->resize(index_header[1]);
+        if (!entries->empty() && fread(entries->data(), sizeof(ArchiveEntry), entries->size(), fp) != entries->size()) {
+            return false;
+        }
+
+        // every payload lies between the file header and the index
+        for (size_t i=0; i<entries->size(); ++i) {
+            const ArchiveEntry &entry = (*entries)[i];
+            if (entry.offset < sizeof(ArchiveHeader) || entry.offset > header.index_offset || entry.chunk.stored_bytes > header.index_offset - entry.offset) {
+                return false;
+            }
+        }
+
+        *end = header.index_offset;
+        return true;
+    }
+
+    // interrupted archive: walk the chunks
+
+    uint64_t offset = sizeof(ArchiveHeader);
+    ArchiveEntry entry;
+    while (offset + sizeof(ArchiveChunk) <= file_size) {
+        if (fseeko(fp, offset, SEEK_SET) != 0 || fread(&entry.chunk, sizeof(ArchiveChunk), 1, fp) != 1 || entry.chunk.magic != ARCHIVE_CHUNK_MAGIC) {
+            break;
+        }
+
+        entry.offset = offset + sizeof(ArchiveChunk);
+        if (entry.chunk.stored_bytes > file_size - entry.offset) {
+            break;
+        }
+
+        entries->push_back(entry);
+        offset = entry.offset + entry.chunk.stored_bytes;
+    }
+
+    *end = offset;
+    return true;
+}
+
+/*
+ * @brief Encodes a map as a chunk payload
+ *
+ * The bytes of the floats are regrouped into four planes (all first bytes, then all
+ * second bytes, ...), which puts the slowly varying sign and exponent bytes next to each
+ * other and lets zlib compress them far better than the interleaved floats. Maps that do
+ * not compress are stored raw.
+ *
+ * @param map           - The CV_32F map
+ * @param chunk         - The chunk header to be populated (except its view and kind)
+ * @param payload       - The payload to be populated
+ *
+ * @return Returns false if the map could not be compressed
+ *
+ */
+static bool encode_map(const Mat &map, ArchiveChunk *chunk, vector<uint8_t> &payload) {
+    const Mat contiguous = map.isContinuous() ? map : map.clone();
+    const size_t count = contiguous.total();
+    const uint8_t *bytes = contiguous.ptr<uint8_t>(0);
+
+    chunk->magic = ARCHIVE_CHUNK_MAGIC;
+    chunk->rows = contiguous.rows;
+    chunk->cols = contiguous.cols;
+    chunk->raw_bytes = count * sizeof(float);
+
+    vector<uint8_t> shuffled(chunk->raw_bytes);
+    for (size_t i=0; i<count; ++i) {
+        for (size_t b=0; b<sizeof(float); ++b) {
+            shuffled[b*count + i] = bytes[i*sizeof(float) + b];
+        }
+    }
+
+    uLongf stored = compressBound(chunk->raw_bytes);
+    payload.resize(stored);
+    if (compress2(payload.data(), &stored, shuffled.data(), chunk->raw_bytes, Z_DEFAULT_COMPRESSION) != Z_OK) {
+        return false;
+    }
+
+    if (stored < chunk->raw_bytes) {
+        chunk->codec = ARCHIVE_CODEC_ZLIB_SHUFFLE;
+        payload.resize(stored);
+    } else {
+        chunk->codec = ARCHIVE_CODEC_RAW;
+        payload.assign(bytes, bytes + chunk->raw_bytes);
+    }
+    chunk->stored_bytes = payload.size();
+
+    return true;
+}
+
+/*
+ * @brief Constructs a closed writer
+ *
+ */
+ArchiveWriter::ArchiveWriter() :
+    fp(NULL),
+    end(0),
+    total_raw(0),
+    total_stored(0)
+{}
+
+/*
+ * @brief Writes the index of the archive, if it is still open
+ *
+ */
+ArchiveWriter::~ArchiveWriter() {
+    close();
+}
+
+/*
+ * @brief Creates an archive, or opens an existing one to append to it
+ *
+ * An existing archive keeps its chunks; its index is dropped and rewritten (with the
+ * appended chunks) on close. An interrupted archive is cut back to its last complete chunk.
+ *
+ * @param path          - The archive file
+ * @param append        - Append to the archive if it exists (otherwise it is replaced)
+ *
+ * @return Returns false if the file could not be created, or is not an archive
+ *
+ */
+bool ArchiveWriter::open(const string &path, const bool append) {
+    close();
+    this->path = path;
+    entries.clear();
+    total_raw = 0;
+    total_stored = 0;
+
+    fp = append ? fopen(path.c_str(), "r+b") : NULL;
+    if (fp != NULL) {
+        if (!read_entries(fp, &entries, &end, NULL) || ftruncate(fileno(fp), end) != 0) {
+            fprintf(stderr, "Error: %s is not a valid archive.\n", path.c_str());
+            fclose(fp);
+            fp = NULL;
+            return false;
+        }
+
+        for (size_t i=0; i<entries.size(); ++i) {
+            total_raw += entries[i].chunk.raw_bytes;
+            total_stored += entries[i].chunk.stored_bytes;
+        }
+    } else {
+        fp = fopen(path.c_str(), "w+b");
+        if (fp == NULL) {
+            fprintf(stderr, "Error: could not open file %s.\n", path.c_str());
+            return false;
+        }
+        end = sizeof(ArchiveHeader);
+    }
+
+    // the header stays unindexed until the archive is closed
+    ArchiveHeader header;
+    memcpy(header.magic, ARCHIVE_MAGIC, sizeof(header.magic));
+    header.version = ARCHIVE_VERSION;
+    header.reserved = 0;
+    header.index_offset = 0;
+
+    if (fseeko(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1 || fflush(fp) != 0) {
+        fprintf(stderr, "Error: could not write file %s.\n", path.c_str());
+        fclose(fp);
+        fp = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Compresses the fused maps of a view and appends them to the archive
+ *
+ * @param view          - The reference view
+ * @param fused_map     - The CV_32F fused depth map
+ * @param fused_conf    - The CV_32F fused confidence map
+ *
+ * @return Returns false if the maps could not be compressed or written
+ *
+ */
+bool ArchiveWriter::add(const int view, const Mat &fused_map, const Mat &fused_conf) {
+    ArchiveEntry depth;
+    ArchiveEntry conf;
+    vector<uint8_t> depth_payload;
+    vector<uint8_t> conf_payload;
+
+    if (!encode_map(fused_map, &depth.chunk, depth_payload) || !encode_map(fused_conf, &conf.chunk, conf_payload)) {
+        fprintf(stderr, "Error: could not compress the maps of view %d.\n", view);
+        return false;
+    }
+    depth.chunk.view = view;
+    depth.chunk.kind = ARCHIVE_DEPTH;
+    conf.chunk.view = view;
+    conf.chunk.kind = ARCHIVE_CONF;
+
+    lock_guard<mutex> guard(lock);
+
+    if (fp == NULL) {
+        return false;
+    }
+
+    // both chunks are flushed before they are indexed, so an interrupted run keeps every complete view
+    depth.offset = end + sizeof(ArchiveChunk);
+    conf.offset = depth.offset + depth.chunk.stored_bytes + sizeof(ArchiveChunk);
+
+    if (fseeko(fp, end, SEEK_SET) != 0 ||
+            fwrite(&depth.chunk, sizeof(ArchiveChunk), 1, fp) != 1 ||
+            fwrite(depth_payload.data(), 1, depth_payload.size(), fp) != depth_payload.size() ||
+            fwrite(&conf.chunk, sizeof(ArchiveChunk), 1, fp) != 1 ||
+            fwrite(conf_payload.data(), 1, conf_payload.size(), fp) != conf_payload.size() ||
+            fflush(fp) != 0) {
+        fprintf(stderr, "Error: could not write file %s.\n", path.c_str());
+        return false;
+    }
+
+    end = conf.offset + conf.chunk.stored_bytes;
+    entries.push_back(depth);
+    entries.push_back(conf);
+    total_raw += depth.chunk.raw_bytes + conf.chunk.raw_bytes;
+    total_stored += depth.chunk.stored_bytes + conf.chunk.stored_bytes;
+
+    return true;
+}
+
+/*
+ * @brief Writes the index after the last chunk, points the header at it and closes the file
+ *
+ * @return Returns false if the index could not be written
+ *
+ */
+bool ArchiveWriter::close() {
+    lock_guard<mutex> guard(lock);
+
+    if (fp == NULL) {
+        return true;
+    }
+
+    const uint32_t index_header[2] = { ARCHIVE_INDEX_MAGIC, (uint32_t) entries.size() };
+    bool ok = (fseeko(fp, end, SEEK_SET) == 0 &&
+            fwrite(index_header, sizeof(index_header), 1, fp) == 1 &&
+            fwrite(entries.data(), sizeof(ArchiveEntry), entries.size(), fp) == entries.size() &&
+            fflush(fp) == 0);
+
+    // the header is pointed at the index only once the index is complete
+    const uint64_t index_offset = end;
+    ok = ok && (fseeko(fp, offsetof(ArchiveHeader, index_offset), SEEK_SET) == 0 &&
+            fwrite(&index_offset, sizeof(index_offset), 1, fp) == 1);
+
+    ok = (fclose(fp) == 0) && ok;
+    fp = NULL;
+
+    if (!ok) {
+        fprintf(stderr, "Error: could not write the index of %s.\n", path.c_str());
+    }
+
+    return ok;
+}
+
+/*
+ * @brief Constructs a closed reader
+ *
+ */
+ArchiveReader::ArchiveReader() :
+    fp(NULL),
+    indexed(false)
+{}
+
+/*
+ * @brief Closes the archive
+ *
+ */
+ArchiveReader::~ArchiveReader() {
+    if (fp != NULL) {
+        fclose(fp);
+    }
+}
+
+/*
+ * @brief Opens an archive and reads its index
+ *
+ * @param path          - The archive file
+ *
+ * @return Returns false if the file could not be opened or is not an archive
+ *
+ */
+bool ArchiveReader::open(const string &path) {
+    if (fp != NULL) {
+        fclose(fp);
+    }
+
+    fp = fopen(path.c_str(), "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    uint64_t end;
+    if (!read_entries(fp, &entries, &end, &indexed)) {
+        fprintf(stderr, "Error: %s is not a valid archive.\n", path.c_str());
+        fclose(fp);
+        fp = NULL;
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Returns the last chunk of a map of a view (NULL if it is not in the archive)
+ *
+ */
+const ArchiveEntry *ArchiveReader::find(const int view, const int kind) const {
+    for (size_t i=entries.size(); i>0; --i) {
+        if (entries[i-1].chunk.view == view && (int) entries[i-1].chunk.kind == kind) {
+            return &entries[i-1];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * @brief Returns true if both maps of a view are in the archive
+ *
+ */
+bool ArchiveReader::has(const int view) const {
+    return find(view, ARCHIVE_DEPTH) != NULL && find(view, ARCHIVE_CONF) != NULL;
+}
+
+/*
+ * @brief Lists the views of the archive (in increasing order)
+ *
+ */
+vector<int> ArchiveReader::list_views() const {
+    std::map<int, int> kinds;
+    for (size_t i=0; i<entries.size(); ++i) {
+        kinds[entries[i].chunk.view] |= 1 << entries[i].chunk.kind;
+    }
+
+    vector<int> views;
+    for (std::map<int, int>::const_iterator it=kinds.begin(); it!=kinds.end(); ++it) {
+        if (it->second == ((1 << ARCHIVE_DEPTH) | (1 << ARCHIVE_CONF))) {
+            views.push_back(it->first);
+        }
+    }
+
+    return views;
+}
+
+/*
+ * @brief Reads and decompresses one map of a view, without touching any other chunk
+ *
+ * @param view          - The reference view
+ * @param kind          - ARCHIVE_DEPTH or ARCHIVE_CONF
+ * @param map           - The CV_32F map to be populated
+ *
+ * @return Returns false if the map is not in the archive or is corrupt
+ *
+ */
+bool ArchiveReader::read(const int view, const int kind, Mat *map) {
+    const ArchiveEntry *entry = find(view, kind);
+    if (fp == NULL || entry == NULL) {
+        return false;
+    }
+
+    // the sizes are checked before anything is allocated (the payloads lie within the file, see read_entries())
+    const ArchiveChunk &chunk = entry->chunk;
+    if (chunk.rows < 0 || chunk.cols < 0) {
+        return false;
+    }
+    const size_t count = (size_t) chunk.rows * chunk.cols;
+    if (chunk.raw_bytes != count * sizeof(float)) {
+        return false;
+    }
+
+    // deflate expands at most 1032:1, so a larger raw size is corrupt
+    if (chunk.codec == ARCHIVE_CODEC_ZLIB_SHUFFLE && chunk.raw_bytes / 1032 > chunk.stored_bytes) {
+        return false;
+    }
+
+    vector<uint8_t> payload(chunk.stored_bytes);
+    if (fseeko(fp, entry->offset, SEEK_SET) != 0 || fread(payload.data(), 1, payload.size(), fp) != payload.size()) {
+        return false;
+    }
+
+    map->create(chunk.rows, chunk.cols, CV_32F);
+    uint8_t *bytes = map->ptr<uint8_t>(0);
+
+    if (chunk.codec == ARCHIVE_CODEC_RAW) {
+        if (chunk.stored_bytes != chunk.raw_bytes) {
+            return false;
+        }
+        memcpy(bytes, payload.data(), chunk.raw_bytes);
+        return true;
+    }
+
+    if (chunk.codec != ARCHIVE_CODEC_ZLIB_SHUFFLE) {
+        return false;
+    }
+
+    vector<uint8_t> shuffled(chunk.raw_bytes);
+    uLongf raw_bytes = chunk.raw_bytes;
+    if (uncompress(shuffled.data(), &raw_bytes, payload.data(), payload.size()) != Z_OK || raw_bytes != chunk.raw_bytes) {
+        return false;
+    }
+
+    for (size_t i=0; i<count; ++i) {
+        for (size_t b=0; b<sizeof(float); ++b) {
+            bytes[i*sizeof(float) + b] = shuffled[b*count + i];
+        }
+    }
+
+    return true;
+}
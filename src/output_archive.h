@@ -0,0 +1,113 @@
+#ifndef _OUTPUT_ARCHIVE_H_
+#define _OUTPUT_ARCHIVE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+// file name of the archive of a scene (in its output path)
+#define ARCHIVE_FILE_NAME "fused_views.far"
+
+// kinds of maps held in an archive
+#define ARCHIVE_DEPTH 0
+#define ARCHIVE_CONF 1
+
+// chunk payload encodings
+#define ARCHIVE_CODEC_RAW 0             // float32 rows, as in memory
+#define ARCHIVE_CODEC_ZLIB_SHUFFLE 1    // zlib stream of the float32 bytes regrouped into four byte planes
+
+// chunk header, as stored in front of every payload (little-endian)
+struct ArchiveChunk {
+    uint32_t magic;         // ARCHIVE_CHUNK_MAGIC
+    int32_t view;
+    uint32_t kind;          // ARCHIVE_DEPTH or ARCHIVE_CONF
+    int32_t rows;
+    int32_t cols;
+    uint32_t codec;
+    uint64_t raw_bytes;     // rows*cols*sizeof(float)
+    uint64_t stored_bytes;  // bytes of the payload
+};
+
+// entry of the archive index: a chunk header and the offset of its payload
+struct ArchiveEntry {
+    ArchiveChunk chunk;
+    uint64_t offset;
+};
+
+/*
+ * Single-file container for the fused maps of a scene.
+ *
+ * Every fused view is appended as two chunks (depth and confidence), each compressed on
+ * its own, so that one map can be read without decompressing any other. The layout is
+ *
+ *      header      'FUSEARC1', version, index offset (0 while the archive is being written)
+ *      chunks      chunk header + payload, appended as the views are written
+ *      index       'INDX', entry count, one ArchiveEntry per chunk (written on close)
+ *
+ * Readers seek to the index through the header. An archive that was never closed (an
+ * interrupted run) has no index; its chunks are then found by walking the chunk headers,
+ * and an incomplete trailing chunk is ignored. A view appended more than once is read from
+ * its last chunk, so a re-run can append to the archive of an earlier run.
+ *
+ * add() is thread-safe: the maps are compressed by the calling thread and only the append
+ * itself is serialized.
+ */
+class ArchiveWriter {
+    public:
+        ArchiveWriter();
+        ~ArchiveWriter();
+
+        bool open(const std::string &path, const bool append);
+        bool add(const int view, const cv::Mat &fused_map, const cv::Mat &fused_conf);
+        bool close();
+
+        bool is_open() const { return fp != NULL; }
+        size_t views() const { return entries.size() / 2; }
+        uint64_t raw_bytes() const { return total_raw; }
+        uint64_t stored_bytes() const { return total_stored; }
+
+    private:
+        ArchiveWriter(const ArchiveWriter &);
+        ArchiveWriter &operator=(const ArchiveWriter &);
+
+        FILE *fp;
+        std::string path;
+        std::mutex lock;
+        std::vector<ArchiveEntry> entries;
+        uint64_t end;           // offset of the next chunk
+        uint64_t total_raw;
+        uint64_t total_stored;
+};
+
+/*
+ * Random-access reader of an archive.
+ */
+class ArchiveReader {
+    public:
+        ArchiveReader();
+        ~ArchiveReader();
+
+        bool open(const std::string &path);
+        bool has(const int view) const;
+        bool read(const int view, const int kind, cv::Mat *map);
+        std::vector<int> list_views() const;
+
+        bool is_complete() const { return indexed; }
+
+    private:
+        ArchiveReader(const ArchiveReader &);
+        ArchiveReader &operator=(const ArchiveReader &);
+
+        FILE *fp;
+        std::vector<ArchiveEntry> entries;
+        bool indexed;           // the archive was closed (read from its index)
+
+        const ArchiveEntry *find(const int view, const int kind) const;
+};
+
+#endif
@@ -0,0 +1,194 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <chrono>
+
+#include "util.h"
+#include "output_writer.h"
+#include "fusion_stats.h"
+#include "scratch_pool.h"
+#include "output_archive.h"
+
+/*
+ * @brief Starts the writer threads
+ *
+ * @param capacity          - The number of fused views that may wait to be written
+ * @param num_threads       - The number of writer threads
+ * @param pool              - The pool receiving the output maps once they are written (may be NULL)
+ *
+ */
+OutputWriter::OutputWriter(const size_t capacity, const int num_threads, ScratchPool *pool) :
+    pool(pool),
+    queue(capacity),
+    finished(false),
+    written(0),
+    failed(0),
+    blocked_submits(0),
+    blocked_usec(0),
+    write_usec(0)
+{
+    for (int t=0; t<max(1, num_threads); ++t) {
+        workers.push_back(thread(&OutputWriter::run, this));
+    }
+}
+
+/*
+ * @brief Writes the remaining views and stops the writer threads
+ *
+ */
+OutputWriter::~OutputWriter() {
+    finish();
+}
+
+/*
+ * @brief Queues the fused output of a reference view
+ *
+ * Blocks while the queue is full. The maps are not copied, so the caller must not
+ * modify them after submitting.
+ *
+ * @param target        - The destination of the outputs (must outlive the write, see wait())
+ * @param index         - The reference view
+ * @param fused_map     - The fused depth map
+ * @param fused_conf    - The fused confidence map
+ *
+ */
+void OutputWriter::submit(OutputTarget &target, const int index, const Mat &fused_map, const Mat &fused_conf) {
+    {
+        lock_guard<mutex> guard(target.lock);
+        ++target.pending;
+    }
+
+    WriteJob job;
+    job.target = &target;
+    job.index = index;
+    job.fused_map = fused_map;
+    job.fused_conf = fused_conf;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    if (queue.push(job)) {
+        ++blocked_submits;
+        blocked_usec += chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+    }
+}
+
+/*
+ * @brief Waits until every view submitted to the given target is written
+ *
+ * @param target        - The destination of the outputs
+ *
+ */
+void OutputWriter::wait(OutputTarget &target) {
+    unique_lock<mutex> guard(target.lock);
+
+    while (target.pending > 0) {
+        target.written.wait(guard);
+    }
+}
+
+/*
+ * @brief Waits until every queued view is written and stops the writer threads
+ *
+ */
+void OutputWriter::finish() {
+    if (finished) {
+        return;
+    }
+    finished = true;
+
+    queue.close();
+    for (size_t t=0; t<workers.size(); ++t) {
+        workers[t].join();
+    }
+}
+
+/*
+ * @brief Writer thread loop
+ *
+ */
+void OutputWriter::run() {
+    WriteJob job;
+
+    while (queue.pop(job)) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        const bool ok = write(job);
+
+        const long usec = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+        write_usec += usec;
+        if (job.target->stats != NULL) {
+            job.target->stats->add_write(job.index, usec / 1e6);
+        }
+
+        if (pool != NULL) {
+            pool->release_output(job.fused_map, job.fused_conf);
+        }
+
+        // the target may be released by the waiting thread as soon as the count drops
+        OutputTarget *target = job.target;
+        job = WriteJob();
+        {
+            lock_guard<mutex> guard(target->lock);
+            target->failed += !ok;
+            if (--target->pending == 0) {
+                target->written.notify_all();
+            }
+        }
+    }
+}
+
+/*
+ * @brief Writes the PFM and PNG outputs of a reference view, or appends its maps to the archive
+ *
+ * @param job           - The fused output to be written
+ *
+ * @return Returns true if the outputs were written successfully; false otherwise
+ *
+ */
+bool OutputWriter::write(const WriteJob &job) {
+    if (job.target->archive != NULL) {
+        const bool ok = job.target->archive->add(job.index, job.fused_map, job.fused_conf);
+        if (ok) {
+            ++written;
+        } else {
+            ++failed;
+        }
+        return ok;
+    }
+
+    // pad the index string for filenames
+    std::string index_str = to_string(job.index);
+    pad(index_str, 8, '0');
+
+    // save the depth and confidence map outputs in .pfm format
+    const string &out_depth_path = job.target->out_depth_path;
+    const string &out_conf_path = job.target->out_conf_path;
+    bool ok = save_pfm(job.fused_map, out_depth_path + index_str + "_depth.pfm");
+    ok = save_pfm(job.fused_conf, out_conf_path + index_str + "_conf.pfm") && ok;
+
+    // save the depth and confidence map outputs in .png output for visual display
+    ok = display_depth(job.fused_map, out_depth_path + index_str + "_depth_disp.png") && ok;
+    ok = display_conf(job.fused_conf, out_conf_path + index_str + "_conf_disp.png") && ok;
+
+    if (ok) {
+        ++written;
+    } else {
+        ++failed;
+    }
+
+    return ok;
+}
+
+/*
+ * @brief Prints the writer counters
+ *
+ */
+void OutputWriter::print_stats() const {
+    printf("Output writer: %zu views written (%zu failed) in %.2f s of writer time, %zu submits blocked for %.2f s%s\n",
+            (size_t) written,
+            (size_t) failed,
+            write_usec / 1e6,
+            (size_t) blocked_submits,
+            blocked_usec / 1e6,
+            (blocked_submits > 0) ? " (storage-bound)" : "");
+}
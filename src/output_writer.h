@@ -0,0 +1,83 @@
+#ifndef _OUTPUT_WRITER_H_
+#define _OUTPUT_WRITER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.h"
+
+class FusionStats;
+class ScratchPool;
+class ArchiveWriter;
+
+using namespace std;
+using namespace cv;
+
+// structure to hold the destination of the fused outputs of a scene
+//
+// Several scenes may share a writer; every job refers to the target of its scene, which
+// counts the writes still pending so that the scene can be finished once they are done.
+struct OutputTarget {
+    string out_depth_path;      // directory for the fused depth maps
+    string out_conf_path;       // directory for the fused confidence maps
+    FusionStats *stats = NULL;  // statistics recording the write time of every view (may be NULL)
+    ArchiveWriter *archive = NULL;  // archive receiving the fused maps instead of the files (may be NULL)
+
+    mutex lock;
+    condition_variable written;
+    size_t pending = 0;
+    size_t failed = 0;          // views of the target that could not be fused or written
+};
+
+// structure to hold the fused output of a reference view waiting to be written
+struct WriteJob {
+    OutputTarget *target;
+    int index;
+    Mat fused_map;
+    Mat fused_conf;
+};
+
+/*
+ * Background writer for the fused depth and confidence maps.
+ *
+ * Fusion workers hand their output to submit() and continue with the next reference view
+ * while writer threads encode the PFM and PNG files (or compress the maps into the archive
+ * of the scene). The queue is bounded, so a slow disk
+ * eventually blocks the fusion workers; every blocked submit is counted (with the time spent
+ * waiting) so the back-pressure is visible in the statistics.
+ */
+class OutputWriter {
+    public:
+        OutputWriter(const size_t capacity, const int num_threads, ScratchPool *pool);
+        ~OutputWriter();
+
+        void submit(OutputTarget &target, const int index, const Mat &fused_map, const Mat &fused_conf);
+        void wait(OutputTarget &target);
+        void finish();
+        void print_stats() const;
+        size_t failures() const { return failed; }
+
+    private:
+        ScratchPool *pool;
+
+        BoundedQueue<WriteJob> queue;
+        vector<thread> workers;
+        bool finished;
+
+        atomic<size_t> written;
+        atomic<size_t> failed;
+        atomic<size_t> blocked_submits;
+        atomic<long> blocked_usec;
+        atomic<long> write_usec;
+
+        void run();
+        bool write(const WriteJob &job);
+};
+
+#endif
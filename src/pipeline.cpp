@@ -0,0 +1,261 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <chrono>
+#include <thread>
+#include <omp.h>
+
+#include "depth_fusion.h"
+#include "map_store.h"
+#include "output_writer.h"
+#include "pipeline.h"
+#include "voxel_cloud.h"
+#include "scratch_pool.h"
+
+/*
+ * @brief Returns the microseconds elapsed since the given time point
+ *
+ */
+static long usec_since(const chrono::steady_clock::time_point &start) {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * @brief Creates a pipeline over the views of a scene
+ *
+ * @param config        - The number of threads of every stage
+ * @param params        - The fusion parameters
+ * @param K             - The intrinsics of every view
+ * @param P             - The extrinsics of every view
+ * @param views         - The supporting views of every reference view
+ * @param store         - The store providing the depth and confidence maps
+ * @param cache         - The cache of back-projected supporting views (may be NULL)
+ * @param writer        - The writer consuming the fused maps
+ * @param target        - The destination of the fused maps; its statistics (if any) also collect the
+ *                          timers and counters of every view
+ * @param cloud         - The scene-level cloud merging every fused view (may be NULL)
+ * @param pool          - The pool recycling the working memory and output maps of the views (may be NULL)
+ *
+ */
+FusionPipeline::FusionPipeline(
+        const PipelineConfig &config,
+        const FusionParams &params,
+        const vector<Mat> &K,
+        const vector<Mat> &P,
+        const vector<vector<int>> &views,
+        MapStore &store,
+        RenderCache *cache,
+        OutputWriter &writer,
+        OutputTarget &target,
+        VoxelCloud *cloud,
+        ScratchPool *pool) :
+    config(config),
+    params(params),
+    K(K),
+    P(P),
+    views(views),
+    store(store),
+    cache(cache),
+    writer(writer),
+    target(target),
+    cloud(cloud),
+    pool(pool),
+    render_queue(config.queue_depth),
+    fuse_queue(config.queue_depth),
+    next_view(0),
+    loaders_left(0),
+    renderers_left(0),
+    load_usec(0),
+    render_usec(0),
+    fuse_usec(0),
+    fused_views(0)
+{}
+
+/*
+ * @brief Fuses the given reference views and waits until all of them are handed to the writer
+ *
+ * @param order         - The reference views, in the order they should be started
+ *
+ */
+void FusionPipeline::run(const vector<int> &order) {
+    vector<thread> threads;
+
+    next_view = 0;
+    loaders_left = config.loader_threads;
+    renderers_left = config.render_threads;
+
+    for (int t=0; t<config.loader_threads; ++t) {
+        threads.push_back(thread(&FusionPipeline::load_stage, this, std::cref(order)));
+    }
+    for (int t=0; t<config.render_threads; ++t) {
+        threads.push_back(thread(&FusionPipeline::render_stage, this));
+    }
+    for (int t=0; t<config.fuse_threads; ++t) {
+        threads.push_back(thread(&FusionPipeline::fuse_stage, this));
+    }
+
+    for (size_t t=0; t<threads.size(); ++t) {
+        threads[t].join();
+    }
+}
+
+/*
+ * @brief Loader stage: acquires the maps of the next reference view from the map store
+ *
+ * @param order         - The reference views, in the order they should be started
+ *
+ */
+void FusionPipeline::load_stage(const vector<int> &order) {
+    const int total_views = K.size();
+
+    for (size_t n = next_view++; n < order.size(); n = next_view++) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        FusionTask *task = new FusionTask();
+        task->index = order[n];
+        task->scratch = NULL;
+        task->depth_maps.resize(total_views);
+        task->conf_maps.resize(total_views);
+
+        // a reference view whose maps could not be loaded is not fused, and fails its scene
+        if (!store.acquire(task->index, task->depth_maps, task->conf_maps)) {
+            fprintf(stderr, "Error: reference view %d is not fused, since the maps of its views could not be loaded.\n", task->index);
+            store.release(task->index, task->depth_maps, task->conf_maps);
+            {
+                lock_guard<mutex> guard(target.lock);
+                ++target.failed;
+            }
+            delete task;
+            continue;
+        }
+
+        const long usec = usec_since(start);
+        task->stats.index = task->index;
+        task->stats.load_sec = usec / 1e6;
+        load_usec += usec;
+        render_queue.push(task);
+    }
+
+    // the last loader to finish closes the render queue
+    if (--loaders_left == 0) {
+        render_queue.close();
+    }
+}
+
+/*
+ * @brief Render stage: renders the supporting views of a reference view
+ *
+ */
+void FusionPipeline::render_stage() {
+    omp_set_num_threads(config.inner_threads);
+
+    FusionTask *task;
+    while (render_queue.pop(task)) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        if (pool != NULL) {
+            task->scratch = pool->acquire_scratch();
+        }
+
+        render_views(
+                task->depth_maps,
+                task->conf_maps,
+                &store.depth_quant(),
+                K,
+                P,
+                views,
+                task->index,
+                params.conf_pre_filt,
+                params.render_tile,
+                cache,
+                task->depth_refs,
+                task->conf_refs,
+                &task->stats,
+                task->scratch);
+
+        render_usec += usec_since(start);
+        fuse_queue.push(task);
+    }
+
+    // the last renderer to finish closes the fuse queue
+    if (--renderers_left == 0) {
+        fuse_queue.close();
+    }
+}
+
+/*
+ * @brief Fuse stage: runs the consensus of a rendered reference view and hands it to the writer
+ *
+ */
+void FusionPipeline::fuse_stage() {
+    omp_set_num_threads(config.inner_threads);
+
+    FusionTask *task;
+    while (fuse_queue.pop(task)) {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        // containers populated with fusion output; ownership passes to the writer afterwards
+        // (which returns them to the pool once they are written)
+        Size size = task->depth_refs[0].size();
+        Mat fused_map;
+        Mat fused_conf;
+        if (pool != NULL) {
+            pool->acquire_output(size, fused_map, fused_conf);
+        } else {
+            fused_map.create(size, CV_32F);
+            fused_conf.create(size, CV_32F);
+        }
+
+        fuse_views(
+                task->depth_refs,
+                task->conf_refs,
+                task->conf_maps,
+                K,
+                P,
+                views,
+                task->index,
+                params.conf_post_filt,
+                params.support_ratio,
+                fused_map,
+                fused_conf,
+                &task->stats,
+                task->scratch);
+
+        store.release(task->index, task->depth_maps, task->conf_maps);
+
+        // the rendered maps live in the scratch set
+        task->depth_refs.clear();
+        task->conf_refs.clear();
+        if (task->scratch != NULL) {
+            pool->release_scratch(task->scratch);
+            task->scratch = NULL;
+        }
+
+        if (cloud != NULL) {
+            cloud->add_view(fused_map, fused_conf, K[task->index], P[task->index], Mat());
+        }
+
+        fuse_usec += usec_since(start);
+        ++fused_views;
+
+        if (target.stats != NULL) {
+            target.stats->add_view(task->stats);
+        }
+
+        // write the outputs in the background while the next view is fused
+        writer.submit(target, task->index, fused_map, fused_conf);
+        delete task;
+    }
+}
+
+/*
+ * @brief Prints the busy time of every stage
+ *
+ */
+void FusionPipeline::print_stats() const {
+    printf("Pipeline: %zu views fused; busy time load %.2f s (%d thread(s)), render %.2f s (%d thread(s)), fuse %.2f s (%d thread(s))\n",
+            (size_t) fused_views,
+            load_usec / 1e6, config.loader_threads,
+            render_usec / 1e6, config.render_threads,
+            fuse_usec / 1e6, config.fuse_threads);
+}
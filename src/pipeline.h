@@ -0,0 +1,99 @@
+#ifndef _PIPELINE_H_
+#define _PIPELINE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <atomic>
+#include <vector>
+
+#include "bounded_queue.h"
+#include "depth_fusion.h"
+#include "fusion_stats.h"
+
+using namespace std;
+using namespace cv;
+
+class MapStore;
+class OutputWriter;
+struct OutputTarget;
+class RenderCache;
+class ScratchPool;
+class VoxelCloud;
+
+// structure to hold the number of threads of every pipeline stage
+struct PipelineConfig {
+    int loader_threads;     // threads acquiring (loading) the maps of upcoming reference views
+    int render_threads;     // threads rendering supporting views into reference views
+    int fuse_threads;       // threads running the consensus of rendered reference views
+    int inner_threads;      // OpenMP threads inside each render or fuse call
+    size_t queue_depth;     // reference views that may wait between two stages
+};
+
+// structure to hold a reference view while it travels through the pipeline
+struct FusionTask {
+    int index;
+    vector<Mat> depth_maps;     // indexed by view; only the supporting views are populated
+    vector<Mat> conf_maps;      // indexed by view; only the supporting views are populated
+    vector<Mat> depth_refs;     // rendered supporting views, in the order of views[index]
+    vector<Mat> conf_refs;
+    ViewStats stats;            // timers and counters of the view, handed to the run statistics when fused
+    FusionScratch *scratch;     // working memory from the scratch pool, from rendering until fused
+};
+
+/*
+ * Staged fusion pipeline: loader -> renderer -> fuser -> writer.
+ *
+ * Every stage runs on its own threads and hands reference views to the next stage through a
+ * bounded queue, so the loads of upcoming views, the render and consensus passes of the
+ * current views and the disk writes of finished views all overlap. The bounded queues limit
+ * how far the loaders run ahead (on top of the map store's memory budget).
+ */
+class FusionPipeline {
+    public:
+        FusionPipeline(
+                const PipelineConfig &config,
+                const FusionParams &params,
+                const vector<Mat> &K,
+                const vector<Mat> &P,
+                const vector<vector<int>> &views,
+                MapStore &store,
+                RenderCache *cache,
+                OutputWriter &writer,
+                OutputTarget &target,
+                VoxelCloud *cloud,
+                ScratchPool *pool);
+
+        void run(const vector<int> &order);
+        void print_stats() const;
+
+    private:
+        const PipelineConfig config;
+        const FusionParams params;
+        const vector<Mat> &K;
+        const vector<Mat> &P;
+        const vector<vector<int>> &views;
+        MapStore &store;
+        RenderCache *cache;
+        OutputWriter &writer;
+        OutputTarget &target;
+        VoxelCloud *cloud;
+        ScratchPool *pool;
+
+        BoundedQueue<FusionTask *> render_queue;
+        BoundedQueue<FusionTask *> fuse_queue;
+
+        atomic<size_t> next_view;
+        atomic<int> loaders_left;
+        atomic<int> renderers_left;
+
+        atomic<long> load_usec;
+        atomic<long> render_usec;
+        atomic<long> fuse_usec;
+        atomic<size_t> fused_views;
+
+        void load_stage(const vector<int> &order);
+        void render_stage();
+        void fuse_stage();
+};
+
+#endif
@@ -0,0 +1,212 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include <omp.h>
+
+#include "geometry.h"
+#include "ply_writer.h"
+
+/*
+ * @brief Writes the header of a binary PLY point cloud
+ *
+ * The vertices are x, y and z (float), optionally followed by red, green and blue (uchar)
+ * and confidence (float), in the byte order of the host.
+ *
+ * @param fp            - The output file
+ * @param count         - The number of vertices
+ * @param color         - Whether the vertices have a color
+ * @param confidence    - Whether the vertices have a confidence
+ *
+ */
+void write_ply_header(FILE *fp, const size_t count, const bool color, const bool confidence) {
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    const char *format = "binary_big_endian";
+#else
+    const char *format = "binary_little_endian";
+#endif
+
+    fprintf(fp, "ply\n");
+    fprintf(fp, "format %s 1.0\n", format);
+    fprintf(fp, "element vertex %zu\n", count);
+    fprintf(fp, "property float x\n");
+    fprintf(fp, "property float y\n");
+    fprintf(fp, "property float z\n");
+    if (color) {
+        fprintf(fp, "property uchar red\n");
+        fprintf(fp, "property uchar green\n");
+        fprintf(fp, "property uchar blue\n");
+    }
+    if (confidence) {
+        fprintf(fp, "property float confidence\n");
+    }
+    fprintf(fp, "element face 0\n");
+    fprintf(fp, "end_header\n");
+}
+
+/*
+ * @brief Returns true if the pixel of a depth map is exported as a point
+ *
+ * Pixels without a depth estimate (non-positive or NaN) and, if a confidence map is
+ * given, pixels dropped by the fusion (negative confidence) are skipped.
+ *
+ */
+static inline bool is_point(const float depth, const float *conf_row, const int c) {
+    return depth > 0 && (conf_row == NULL || conf_row[c] >= 0);
+}
+
+/*
+ * @brief Back-projects a block of rows of a depth map and encodes the points as binary PLY vertices
+ *
+ * @param depth_map     - The depth map
+ * @param image         - The image of the view (may be empty)
+ * @param conf_map      - The confidence map of the view (may be empty)
+ * @param T             - The pixel-to-world transform of the view
+ * @param r_start       - The first row of the block
+ * @param r_end         - One past the last row of the block
+ * @param vertex_size   - The size of an encoded vertex (bytes)
+ * @param buffer        - The container to be populated with the encoded vertices
+ *
+ */
+static void encode_block(
+        const Mat &depth_map,
+        const Mat &image,
+        const Mat &conf_map,
+        const Matx34f &T,
+        const int r_start,
+        const int r_end,
+        const size_t vertex_size,
+        vector<unsigned char> &buffer)
+{
+    const int cols = depth_map.cols;
+
+    buffer.resize((size_t) (r_end - r_start) * cols * vertex_size);
+    unsigned char *out = buffer.data();
+
+    for (int r=r_start; r<r_end; ++r) {
+        const float *depth_row = depth_map.ptr<float>(r);
+        const Vec3f *image_row = image.empty() ? NULL : image.ptr<Vec3f>(r);
+        const float *conf_row = conf_map.empty() ? NULL : conf_map.ptr<float>(r);
+
+        for (int c=0; c<cols; ++c) {
+            if (!is_point(depth_row[c], conf_row, c)) {
+                continue;
+            }
+
+            // find 3D world coord of back projection
+            const Vec3f X_world = transform_pixel(T, c, r, depth_row[c]);
+            memcpy(out, &X_world[0], 3*sizeof(float));
+            out += 3*sizeof(float);
+
+            // the image is stored BGR
+            if (image_row != NULL) {
+                out[0] = saturate_cast<unsigned char>(image_row[c][2]);
+                out[1] = saturate_cast<unsigned char>(image_row[c][1]);
+                out[2] = saturate_cast<unsigned char>(image_row[c][0]);
+                out += 3;
+            }
+
+            if (conf_row != NULL) {
+                memcpy(out, &conf_row[c], sizeof(float));
+                out += sizeof(float);
+            }
+        }
+    }
+
+    buffer.resize(out - buffer.data());
+}
+
+/*
+ * @brief Stores the given depth map as a binary point cloud
+ *
+ * The points are counted first so that the header is exact, then back-projected and encoded
+ * in blocks of PLY_BLOCK_ROWS rows, one block per thread, and written in row order as soon
+ * as a batch of blocks is encoded. The vertices are written in the byte order of the host.
+ *
+ * @param depth_map     - The depth map to be stored
+ * @param K             - The intrinsic camera parameters for the view corresponding to the given map
+ * @param P             - The extrinsic camera parameters for the view corresponding to the given map
+ * @param filename      - The filename where the map will be stored
+ * @param image         - The image of the view in order to color the points (CV_32FC3, may be empty)
+ * @param conf_map      - The confidence map of the view, stored as a point property (may be empty)
+ *
+ * @return Returns true if the file was written successfully; false otherwise
+ *
+ */
+bool write_ply(const Mat &depth_map, const Mat &K, const Mat &P, const string filename, const Mat &image, const Mat &conf_map) {
+    const Size size = depth_map.size();
+    const int rows = size.height;
+
+    if ((!image.empty() && (image.size() != size || image.type() != CV_32FC3)) ||
+            (!conf_map.empty() && (conf_map.size() != size || conf_map.type() != CV_32F))) {
+        fprintf(stderr, "Error: the image and confidence map of %s must match the depth map.\n", filename.c_str());
+        return false;
+    }
+
+    // count the points
+    size_t count = 0;
+
+#pragma omp parallel for reduction(+:count)
+    for (int r=0; r<rows; ++r) {
+        const float *depth_row = depth_map.ptr<float>(r);
+        const float *conf_row = conf_map.empty() ? NULL : conf_map.ptr<float>(r);
+
+        for (int c=0; c<size.width; ++c) {
+            if (is_point(depth_row[c], conf_row, c)) {
+                ++count;
+            }
+        }
+    }
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not open file %s.\n", filename.c_str());
+        return false;
+    }
+
+    write_ply_header(fp, count, !image.empty(), !conf_map.empty());
+
+    const size_t vertex_size = 3*sizeof(float) + (image.empty() ? 0 : 3) + (conf_map.empty() ? 0 : sizeof(float));
+
+    // pixel-to-world transform, shared by every pixel of the map
+    const Matx34f T = backprojection_transform(K, P);
+
+    // encode a batch of blocks in parallel, then stream them out in row order
+    const int num_blocks = (rows + PLY_BLOCK_ROWS - 1) / PLY_BLOCK_ROWS;
+    const int batch = max(1, omp_get_max_threads());
+    vector<vector<unsigned char>> buffers(batch);
+    size_t written = 0;
+
+    for (int b_start=0; b_start<num_blocks; b_start+=batch) {
+        const int b_end = min(b_start + batch, num_blocks);
+
+        #pragma omp parallel for schedule(dynamic)
+        for (int b=b_start; b<b_end; ++b) {
+            const int r_start = b * PLY_BLOCK_ROWS;
+            const int r_end = min(r_start + PLY_BLOCK_ROWS, rows);
+
+            encode_block(depth_map, image, conf_map, T, r_start, r_end, vertex_size, buffers[b-b_start]);
+        }
+
+        for (int b=b_start; b<b_end; ++b) {
+            const vector<unsigned char> &buffer = buffers[b-b_start];
+
+            if (fwrite(buffer.data(), 1, buffer.size(), fp) != buffer.size()) {
+                fprintf(stderr, "Error: could not write file %s.\n", filename.c_str());
+                fclose(fp);
+                return false;
+            }
+            written += buffer.size() / vertex_size;
+        }
+    }
+
+    const bool closed = (fclose(fp) == 0);
+    const bool ok = closed && (written == count);
+    if (!ok) {
+        fprintf(stderr, "Error: could not write file %s.\n", filename.c_str());
+    }
+
+    return ok;
+}
@@ -0,0 +1,26 @@
+#ifndef _PLY_WRITER_H_
+#define _PLY_WRITER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string>
+
+using namespace std;
+using namespace cv;
+
+// rows of the depth map back-projected and encoded per block
+#define PLY_BLOCK_ROWS 32
+
+/*
+ * Binary PLY export of a depth map.
+ *
+ * The points are back-projected and encoded in parallel, one block of rows per thread, and
+ * the encoded blocks are streamed to the file in row order; at most one block per thread is
+ * held in memory. The color (from a CV_32FC3 BGR image) and confidence properties are
+ * optional: pass an empty Mat to omit them.
+ */
+void write_ply_header(FILE *fp, const size_t count, const bool color, const bool confidence);
+bool write_ply(const Mat &depth_map, const Mat &K, const Mat &P, const string filename, const Mat &image, const Mat &conf_map);
+
+#endif
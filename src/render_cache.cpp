@@ -0,0 +1,234 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <omp.h>
+
+#include "geometry.h"
+#include "map_precision.h"
+#include "render_cache.h"
+
+/*
+ * @brief Creates an empty cache
+ *
+ * @param budget_bytes  - The maximum number of bytes held by the cached entries
+ *
+ */
+RenderCache::RenderCache(const size_t budget_bytes) :
+    budget_bytes(budget_bytes)
+{
+    counters.hits = 0;
+    counters.misses = 0;
+    counters.evictions = 0;
+    counters.resident_bytes = 0;
+    counters.peak_bytes = 0;
+}
+
+/*
+ * @brief Returns the back-projected points of a source view, computing them on a miss
+ *
+ * @param view          - The absolute index of the source view
+ * @param depth_map     - The depth map of the source view
+ * @param conf_map      - The confidence map of the source view
+ * @param quant         - The quantization of a 16-bit depth map (NULL for floating-point maps)
+ * @param K             - The intrinsics of the source view
+ * @param P             - The extrinsics of the source view
+ * @param conf_pre_filt - The pre-fusion confidence filter applied to the source pixels
+ *
+ * @return Returns the (shared, read-only) back-projected points of the source view
+ *
+ */
+shared_ptr<const SourcePoints> RenderCache::acquire(
+        const int view,
+        const Mat &depth_map,
+        const Mat &conf_map,
+        const DepthQuant *quant,
+        const Mat &K,
+        const Mat &P,
+        const float conf_pre_filt)
+{
+    {
+        lock_guard<mutex> guard(lock);
+
+        unordered_map<int, Entry>::iterator it = entries.find(view);
+        if (it != entries.end()) {
+            // move the entry to the front of the LRU list
+            lru.splice(lru.begin(), lru, it->second.lru_pos);
+            ++counters.hits;
+            return it->second.points;
+        }
+
+        ++counters.misses;
+    }
+
+    // compute outside of the lock so that other views can be served meanwhile
+    shared_ptr<const SourcePoints> points = backproject_source(depth_map, conf_map, quant, K, P, conf_pre_filt);
+
+    {
+        lock_guard<mutex> guard(lock);
+        insert(view, points);
+    }
+
+    return points;
+}
+
+/*
+ * @brief Inserts an entry, evicting the least recently used entries to stay within budget
+ *
+ * Must be called with the lock held. Entries larger than the whole budget are not cached.
+ *
+ * @param view          - The absolute index of the source view
+ * @param points        - The back-projected points of the source view
+ *
+ */
+void RenderCache::insert(const int view, const shared_ptr<const SourcePoints> &points) {
+    const size_t bytes = points->bytes();
+
+    // another worker may have computed the same view concurrently
+    if (entries.count(view) > 0 || bytes > budget_bytes) {
+        return;
+    }
+
+    while (counters.resident_bytes + bytes > budget_bytes && !lru.empty()) {
+        const int victim = lru.back();
+        counters.resident_bytes -= entries[victim].points->bytes();
+        entries.erase(victim);
+        lru.pop_back();
+        ++counters.evictions;
+    }
+
+    lru.push_front(view);
+    Entry entry;
+    entry.points = points;
+    entry.lru_pos = lru.begin();
+    entries[view] = entry;
+
+    counters.resident_bytes += bytes;
+    counters.peak_bytes = max(counters.peak_bytes, counters.resident_bytes);
+}
+
+/*
+ * @brief Returns a snapshot of the cache counters
+ *
+ */
+RenderCacheStats RenderCache::stats() const {
+    lock_guard<mutex> guard(lock);
+    return counters;
+}
+
+/*
+ * @brief Prints the cache counters
+ *
+ */
+void RenderCache::print_stats() const {
+    RenderCacheStats s = stats();
+    size_t lookups = s.hits + s.misses;
+
+    printf("Render cache: %zu hits, %zu misses (%.1f%% hit rate), %zu evictions, %.1f MB peak of %.1f MB budget\n",
+            s.hits,
+            s.misses,
+            (lookups > 0) ? (100.0 * s.hits / lookups) : 0.0,
+            s.evictions,
+            s.peak_bytes / (1024.0*1024.0),
+            budget_bytes / (1024.0*1024.0));
+}
+
+/*
+ * @brief Back-projects the confident pixels of a source view into world coordinates
+ *
+ * Rows are processed in parallel. Each row is first counted and then written to its own
+ * slice of the output, so the points are stored in row-major pixel order.
+ *
+ * @param depth_map     - The depth map of the source view
+ * @param conf_map      - The confidence map of the source view
+ * @param quant         - The quantization of a 16-bit depth map (NULL for floating-point maps)
+ * @param K             - The intrinsics of the source view
+ * @param P             - The extrinsics of the source view
+ * @param conf_pre_filt - Pixels with confidence less than this value are skipped
+ *
+ * @return Returns the back-projected points
+ *
+ */
+shared_ptr<SourcePoints> backproject_source(const Mat &depth_map, const Mat &conf_map, const DepthQuant *quant, const Mat &K, const Mat &P, const float conf_pre_filt) {
+    const int rows = depth_map.rows;
+    const int cols = depth_map.cols;
+    const Matx34f T = backprojection_transform(K, P);
+
+    // count the confident pixels of each row
+    vector<size_t> offsets(rows+1, 0);
+
+#pragma omp parallel
+{
+    vector<float> conf_buffer(cols);
+
+    #pragma omp for
+    for (int r=0; r<rows; ++r) {
+        const float *conf_row = widen_row(conf_map, NULL, r, 0, cols, conf_buffer.data());
+        size_t count = 0;
+
+        for (int c=0; c<cols; ++c) {
+            if (conf_row[c] >= conf_pre_filt) {
+                ++count;
+            }
+        }
+        offsets[r+1] = count;
+    }
+} //omp parallel
+
+    for (int r=0; r<rows; ++r) {
+        offsets[r+1] += offsets[r];
+    }
+
+    shared_ptr<SourcePoints> source(new SourcePoints());
+    source->points.resize(offsets[rows]);
+
+#pragma omp parallel
+{
+    vector<float> depth_buffer(cols);
+    vector<float> conf_buffer(cols);
+
+    #pragma omp for
+    for (int r=0; r<rows; ++r) {
+        // rows held in reduced precision are widened on the fly
+        const float *depth_row = widen_row(depth_map, quant, r, 0, cols, depth_buffer.data());
+        const float *conf_row = widen_row(conf_map, NULL, r, 0, cols, conf_buffer.data());
+        Vec4f *out = source->points.data() + offsets[r];
+
+        for (int c=0; c<cols; ++c) {
+            if (!(conf_row[c] >= conf_pre_filt)) {
+                continue;
+            }
+
+            Vec3f X_world = transform_pixel(T, c, r, depth_row[c]);
+            *out++ = Vec4f(X_world[0], X_world[1], X_world[2], conf_row[c]);
+        }
+    }
+} //omp parallel
+
+    // bounding box of every chunk of points, so that tiled rendering can cull whole chunks
+    const long num_points = (long) source->points.size();
+    const long num_chunks = (num_points + SOURCE_CHUNK_POINTS - 1) / SOURCE_CHUNK_POINTS;
+    source->bounds.resize(num_chunks);
+
+    #pragma omp parallel for
+    for (long k=0; k<num_chunks; ++k) {
+        const long end = min(num_points, (k+1) * SOURCE_CHUNK_POINTS);
+        Vec6f box(HUGE_VALF, HUGE_VALF, HUGE_VALF, -HUGE_VALF, -HUGE_VALF, -HUGE_VALF);
+
+        for (long i=k*SOURCE_CHUNK_POINTS; i<end; ++i) {
+            const Vec4f &X = source->points[i];
+
+            for (int a=0; a<3; ++a) {
+                if (!isfinite(X[a])) {
+                    box[a] = -HUGE_VALF;
+                    box[a+3] = HUGE_VALF;
+                } else {
+                    box[a] = min(box[a], X[a]);
+                    box[a+3] = max(box[a+3], X[a]);
+                }
+            }
+        }
+        source->bounds[k] = box;
+    }
+
+    return source;
+}
@@ -0,0 +1,77 @@
+#ifndef _RENDER_CACHE_H_
+#define _RENDER_CACHE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+
+struct DepthQuant;
+
+// number of consecutive source points sharing a world bounding box
+#define SOURCE_CHUNK_POINTS 1024
+
+// the pixels of a source view that passed the pre-fusion confidence filter, back-projected into world coordinates
+struct SourcePoints {
+    std::vector<cv::Vec4f> points;   // (X, Y, Z, confidence)
+    std::vector<cv::Vec6f> bounds;   // (min X, Y, Z, max X, Y, Z) of every chunk of SOURCE_CHUNK_POINTS points (infinite if a point is not finite)
+
+    size_t bytes() const { return points.capacity() * sizeof(cv::Vec4f) + bounds.capacity() * sizeof(cv::Vec6f); }
+};
+
+// structure to hold the counters of a render cache
+struct RenderCacheStats {
+    size_t hits;
+    size_t misses;
+    size_t evictions;
+    size_t resident_bytes;
+    size_t peak_bytes;
+};
+
+/*
+ * Memory-bounded, least-recently-used cache of back-projected source views.
+ *
+ * A source view is rendered into every reference view that lists it as a supporting view,
+ * and neighbouring reference views share most of their supporting views. The back-projection
+ * of a source view does not depend on the reference view, so it is computed once and reused
+ * until the byte budget forces it out. Entries are handed out as shared pointers, so evicting
+ * an entry never invalidates a render that is still using it.
+ */
+class RenderCache {
+    public:
+        RenderCache(const size_t budget_bytes);
+
+        std::shared_ptr<const SourcePoints> acquire(
+                const int view,
+                const cv::Mat &depth_map,
+                const cv::Mat &conf_map,
+                const DepthQuant *quant,
+                const cv::Mat &K,
+                const cv::Mat &P,
+                const float conf_pre_filt);
+
+        RenderCacheStats stats() const;
+        void print_stats() const;
+
+    private:
+        struct Entry {
+            std::shared_ptr<const SourcePoints> points;
+            std::list<int>::iterator lru_pos;
+        };
+
+        size_t budget_bytes;
+        mutable std::mutex lock;
+        std::list<int> lru;          // most recently used view at the front
+        std::unordered_map<int, Entry> entries;
+        RenderCacheStats counters;
+
+        void insert(const int view, const std::shared_ptr<const SourcePoints> &points);
+};
+
+std::shared_ptr<SourcePoints> backproject_source(const cv::Mat &depth_map, const cv::Mat &conf_map, const DepthQuant *quant, const cv::Mat &K, const cv::Mat &P, const float conf_pre_filt);
+
+#endif
@@ -0,0 +1,213 @@
+#include "opencv2/core/core.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+#include <omp.h>
+
+#include "util.h"
+#include "scene_loader.h"
+
+/*
+ * @brief Lists the files of a scene
+ *
+ * Every directory is scanned once. Empty paths are skipped.
+ *
+ * @param depth_path    - The directory holding the '<view>_depth.pfm' files
+ * @param conf_path     - The directory holding the '<view>_conf.pfm' files
+ * @param image_path    - The directory holding the '<view>.png' files
+ * @param camera_path   - The directory holding the '<view>_cam.txt' files
+ *
+ * @return Returns the files of the scene, sorted by view
+ *
+ */
+SceneFiles discover_scene(const string depth_path, const string conf_path, const string image_path, const string camera_path) {
+    SceneFiles files;
+
+    if (!depth_path.empty()) {
+        files.depth_files = list_files(depth_path, "_depth.pfm");
+    }
+    if (!conf_path.empty()) {
+        files.conf_files = list_files(conf_path, "_conf.pfm");
+    }
+    if (!image_path.empty()) {
+        files.image_files = list_files(image_path, ".png");
+    }
+    if (!camera_path.empty()) {
+        files.camera_files = list_files(camera_path, "_cam.txt");
+    }
+
+    return files;
+}
+
+/*
+ * @brief Decodes a list of load jobs concurrently
+ *
+ * The jobs are decoded by a team of threads with dynamic scheduling, so a few large maps do
+ * not hold up the small camera files. The outputs are indexed by view regardless of the order
+ * in which the files finish.
+ *
+ * @param files         - The files of the scene
+ * @param jobs          - The kind and view of every file to be loaded
+ * @param scene         - The container (sized for the selected kinds) to be populated with the loaded data and per-file timings
+ * @param num_threads   - The number of loading threads (0 = OpenMP default)
+ *
+ * @return Returns false if a camera file could not be loaded
+ *
+ */
+static bool run_load_jobs(const SceneFiles &files, const vector<pair<LoadKind, int>> &jobs, SceneData *scene, const int num_threads) {
+    const int threads = (num_threads > 0) ? num_threads : omp_get_max_threads();
+    vector<LoadTiming> timings(jobs.size());
+    bool ok = true;
+
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for (size_t j=0; j<jobs.size(); ++j) {
+        const LoadKind kind = jobs[j].first;
+        const int i = jobs[j].second;
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        string file;
+
+        switch (kind) {
+            case LOAD_DEPTH:
+                file = files.depth_files[i];
+                scene->depth_maps[i] = load_pfm(file);
+                break;
+            case LOAD_CONF:
+                file = files.conf_files[i];
+                scene->conf_maps[i] = load_pfm(file);
+                break;
+            case LOAD_IMAGES:
+                file = files.image_files[i];
+                scene->images[i] = imread(file, IMREAD_COLOR);
+                scene->images[i].convertTo(scene->images[i], CV_32F);
+                break;
+            case LOAD_CAMERAS:
+                file = files.camera_files[i];
+                if (!load_camera_file(file, &scene->K[i], &scene->P[i], &scene->bounds[i])) {
+                    fprintf(stderr, "Error: could not load camera file %s.\n", file.c_str());
+                    #pragma omp atomic write
+                    ok = false;
+                }
+                break;
+        }
+
+        timings[j].kind = kind;
+        timings[j].file = file;
+        timings[j].msec = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    scene->timings.insert(scene->timings.end(), timings.begin(), timings.end());
+
+    return ok;
+}
+
+/*
+ * @brief Loads the selected files of a scene concurrently
+ *
+ * All selected files form a single list of jobs, decoded by one team of threads.
+ *
+ * @param files         - The files of the scene
+ * @param kinds         - The kinds of files to be loaded (bit mask of LoadKind)
+ * @param scene         - The container to be populated with the loaded data and per-file timings
+ * @param num_threads   - The number of loading threads (0 = OpenMP default)
+ *
+ * @return Returns false if a camera file could not be loaded (the other files are still loaded)
+ *
+ */
+bool load_scene(const SceneFiles &files, const int kinds, SceneData *scene, const int num_threads) {
+    vector<pair<LoadKind, int>> jobs;
+
+    if (kinds & LOAD_DEPTH) {
+        scene->depth_maps.assign(files.depth_files.size(), Mat());
+        for (size_t i=0; i<files.depth_files.size(); ++i) {
+            jobs.push_back(make_pair(LOAD_DEPTH, (int) i));
+        }
+    }
+    if (kinds & LOAD_CONF) {
+        scene->conf_maps.assign(files.conf_files.size(), Mat());
+        for (size_t i=0; i<files.conf_files.size(); ++i) {
+            jobs.push_back(make_pair(LOAD_CONF, (int) i));
+        }
+    }
+    if (kinds & LOAD_IMAGES) {
+        scene->images.assign(files.image_files.size(), Mat());
+        for (size_t i=0; i<files.image_files.size(); ++i) {
+            jobs.push_back(make_pair(LOAD_IMAGES, (int) i));
+        }
+    }
+    if (kinds & LOAD_CAMERAS) {
+        scene->K.assign(files.camera_files.size(), Mat());
+        scene->P.assign(files.camera_files.size(), Mat());
+        scene->bounds.assign(files.camera_files.size(), Bounds());
+        for (size_t i=0; i<files.camera_files.size(); ++i) {
+            jobs.push_back(make_pair(LOAD_CAMERAS, (int) i));
+        }
+    }
+
+    return run_load_jobs(files, jobs, scene, num_threads);
+}
+
+/*
+ * @brief Loads the depth and confidence maps of some views of a scene concurrently
+ *
+ * Used by the map store to load the maps of a reference view on demand, through the same
+ * jobs (and per-file timings) as load_scene(). The maps are indexed by view; the maps of the
+ * other views are left empty.
+ *
+ * @param files         - The files of the scene
+ * @param views         - The views whose maps are loaded
+ * @param scene         - The container to be populated with the loaded maps and per-file timings
+ * @param num_threads   - The number of loading threads (0 = OpenMP default)
+ *
+ */
+void load_scene_maps(const SceneFiles &files, const vector<int> &views, SceneData *scene, const int num_threads) {
+    vector<pair<LoadKind, int>> jobs;
+
+    scene->depth_maps.assign(files.depth_files.size(), Mat());
+    scene->conf_maps.assign(files.conf_files.size(), Mat());
+    for (int v : views) {
+        jobs.push_back(make_pair(LOAD_DEPTH, v));
+        jobs.push_back(make_pair(LOAD_CONF, v));
+    }
+
+    run_load_jobs(files, jobs, scene, num_threads);
+}
+
+/*
+ * @brief Prints a summary of the per-file load timings
+ *
+ * For every kind of file, the count, total and mean time are printed, followed by the
+ * slowest files overall.
+ *
+ * @param timings       - The per-file load timings
+ *
+ */
+void print_load_timings(const vector<LoadTiming> &timings) {
+    const LoadKind kinds[] = { LOAD_DEPTH, LOAD_CONF, LOAD_IMAGES, LOAD_CAMERAS };
+    const char *names[] = { "depth maps", "confidence maps", "images", "cameras" };
+
+    for (int k=0; k<4; ++k) {
+        size_t count = 0;
+        double total = 0.0;
+
+        for (size_t i=0; i<timings.size(); ++i) {
+            if (timings[i].kind == kinds[k]) {
+                ++count;
+                total += timings[i].msec;
+            }
+        }
+
+        if (count > 0) {
+            printf("Loaded %zu %s: %.1f ms total, %.2f ms per file\n", count, names[k], total, total / count);
+        }
+    }
+
+    // slowest files
+    vector<LoadTiming> sorted(timings);
+    sort(sorted.begin(), sorted.end(), [](const LoadTiming &a, const LoadTiming &b) { return a.msec > b.msec; });
+
+    for (size_t i=0; i<sorted.size() && i<5; ++i) {
+        printf("\t%.2f ms  %s\n", sorted[i].msec, sorted[i].file.c_str());
+    }
+}
@@ -0,0 +1,53 @@
+#ifndef _SCENE_LOADER_H_
+#define _SCENE_LOADER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <string>
+#include <vector>
+
+#include "util.h"
+
+using namespace std;
+using namespace cv;
+
+// kinds of scene files (combined as a bit mask when selecting what to load)
+enum LoadKind {
+    LOAD_DEPTH = 1,
+    LOAD_CONF = 2,
+    LOAD_IMAGES = 4,
+    LOAD_CAMERAS = 8
+};
+
+// structure to hold the files of a scene, sorted by view
+struct SceneFiles {
+    vector<string> depth_files;
+    vector<string> conf_files;
+    vector<string> image_files;
+    vector<string> camera_files;
+};
+
+// structure to hold the time spent loading a single file
+struct LoadTiming {
+    LoadKind kind;
+    string file;
+    double msec;
+};
+
+// structure to hold the loaded contents of a scene, indexed by view
+struct SceneData {
+    vector<Mat> depth_maps;
+    vector<Mat> conf_maps;
+    vector<Mat> images;
+    vector<Mat> K;
+    vector<Mat> P;
+    vector<Bounds> bounds;
+    vector<LoadTiming> timings;
+};
+
+SceneFiles discover_scene(const string depth_path, const string conf_path, const string image_path, const string camera_path);
+bool load_scene(const SceneFiles &files, const int kinds, SceneData *scene, const int num_threads);
+void load_scene_maps(const SceneFiles &files, const vector<int> &views, SceneData *scene, const int num_threads);
+void print_load_timings(const vector<LoadTiming> &timings);
+
+#endif
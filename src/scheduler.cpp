@@ -0,0 +1,137 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <omp.h>
+
+#include "scheduler.h"
+
+/*
+ * @brief Splits the available threads between reference views and the passes inside each view
+ *
+ * Independent reference views are the coarsest (and cheapest to synchronize) unit of work, so
+ * threads are first given to concurrent views. Threads that are left over when a scene has
+ * fewer views than cores are used inside each view, but only as long as every inner thread
+ * gets at least MIN_PIXELS_PER_THREAD pixels of work.
+ *
+ * @param num_threads   - The total number of worker threads (0 = all available cores)
+ * @param num_refs      - The number of reference views to be fused
+ * @param size          - The size of the depth maps
+ *
+ * @return Returns the number of concurrent views and the number of threads within each view
+ *
+ */
+Schedule plan_schedule(const int num_threads, const int num_refs, const Size size) {
+    const int total = (num_threads > 0) ? num_threads : omp_get_max_threads();
+    const int max_inner = max(1, (int) (((long) size.width * size.height) / MIN_PIXELS_PER_THREAD));
+
+    Schedule schedule;
+    schedule.view_workers = max(1, min(total, num_refs));
+    schedule.inner_threads = max(1, min(total / schedule.view_workers, max_inner));
+
+    return schedule;
+}
+
+/*
+ * @brief Caps the threads inside each view so that the concurrent stage workers do not
+ *          oversubscribe the cores
+ *
+ * The render and fuse stages each run their own workers, so a single concurrent view still
+ * occupies one render and one fuse worker; together they must not run more threads than the run has.
+ *
+ * @param schedule      - The schedule (its inner threads are reduced if needed)
+ * @param num_threads   - The total number of worker threads (0 = all available cores)
+ * @param stage_workers - The render and fuse workers running concurrently
+ *
+ */
+void fit_stage_workers(Schedule *schedule, const int num_threads, const int stage_workers) {
+    const int total = (num_threads > 0) ? num_threads : omp_get_max_threads();
+
+    schedule->inner_threads = max(1, min(schedule->inner_threads, total / max(1, stage_workers)));
+}
+
+/*
+ * @brief Prints the thread layout chosen for a fusion run
+ *
+ * @param schedule      - The schedule to be printed
+ * @param num_refs      - The number of reference views to be fused
+ *
+ */
+void print_schedule(const Schedule &schedule, const int num_refs) {
+    printf("Fusing %d views with %d concurrent view(s) x %d thread(s)...\n",
+            num_refs, schedule.view_workers, schedule.inner_threads);
+}
+
+/*
+ * @brief Orders the reference views so that consecutive views share supporting views
+ *
+ * Starting from the first of the given views, the next view is always the remaining view that
+ * shares the most supporting views with the current one (ties go to the earlier view). Fusing
+ * views in this order keeps the back-projected supporting views in the render cache hot.
+ *
+ * @param views         - The supporting views of every reference view
+ * @param refs          - The reference views to be fused
+ *
+ * @return Returns the reference views in processing order
+ *
+ */
+vector<int> plan_view_order(const vector<vector<int>> &views, const vector<int> &refs) {
+    vector<int> order;
+    vector<bool> visited(refs.size(), false);
+
+    if (refs.empty()) {
+        return order;
+    }
+
+    int curr = refs[0];
+    visited[0] = true;
+    order.push_back(curr);
+
+    for (size_t n=1; n<refs.size(); ++n) {
+        int best = -1;
+        int best_shared = -1;
+
+        for (size_t i=0; i<refs.size(); ++i) {
+            if (visited[i]) {
+                continue;
+            }
+
+            int shared = 0;
+            for (int a : views[curr]) {
+                if (find(views[refs[i]].begin(), views[refs[i]].end(), a) != views[refs[i]].end()) {
+                    ++shared;
+                }
+            }
+
+            if (shared > best_shared) {
+                best = i;
+                best_shared = shared;
+            }
+        }
+
+        visited[best] = true;
+        curr = refs[best];
+        order.push_back(curr);
+    }
+
+    return order;
+}
+
+/*
+ * @brief Orders a range of reference views so that consecutive views share supporting views
+ *
+ * @param views         - The supporting views of every reference view
+ * @param start_ind     - The first reference view to be fused
+ * @param end_ind       - One past the last reference view to be fused
+ *
+ * @return Returns the reference views in processing order
+ *
+ */
+vector<int> plan_view_order(const vector<vector<int>> &views, const int start_ind, const int end_ind) {
+    vector<int> refs;
+    for (int i=start_ind; i<end_ind; ++i) {
+        refs.push_back(i);
+    }
+
+    return plan_view_order(views, refs);
+}
@@ -0,0 +1,26 @@
+#ifndef _SCHEDULER_H_
+#define _SCHEDULER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+// minimum number of reference pixels that justifies an extra thread inside a single view
+#define MIN_PIXELS_PER_THREAD (256*1024)
+
+// structure describing how the worker threads are split between and within reference views
+struct Schedule {
+    int view_workers;       // reference views fused concurrently
+    int inner_threads;      // threads used inside the render and consensus passes of each view
+};
+
+Schedule plan_schedule(const int num_threads, const int num_refs, const Size size);
+void fit_stage_workers(Schedule *schedule, const int num_threads, const int stage_workers);
+void print_schedule(const Schedule &schedule, const int num_refs);
+vector<int> plan_view_order(const vector<vector<int>> &views, const vector<int> &refs);
+vector<int> plan_view_order(const vector<vector<int>> &views, const int start_ind, const int end_ind);
+
+#endif
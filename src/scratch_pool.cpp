@@ -0,0 +1,142 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+
+#include "scratch_pool.h"
+
+/*
+ * @brief Creates an empty pool
+ *
+ */
+ScratchPool::ScratchPool() :
+    scratch_reuses(0),
+    output_pairs(0),
+    output_reuses(0),
+    output_bytes(0)
+{}
+
+/*
+ * @brief Frees every scratch set (all of them must have been released)
+ *
+ */
+ScratchPool::~ScratchPool() {
+    for (size_t i=0; i<all_scratch.size(); ++i) {
+        delete all_scratch[i];
+    }
+}
+
+/*
+ * @brief Returns an idle scratch set, or a new one if none is idle
+ *
+ */
+FusionScratch *ScratchPool::acquire_scratch() {
+    lock_guard<mutex> guard(lock);
+
+    if (!idle_scratch.empty()) {
+        FusionScratch *scratch = idle_scratch.back();
+        idle_scratch.pop_back();
+        ++scratch_reuses;
+        return scratch;
+    }
+
+    FusionScratch *scratch = new FusionScratch();
+    all_scratch.push_back(scratch);
+    return scratch;
+}
+
+/*
+ * @brief Returns a scratch set to the pool
+ *
+ * Maps rendered into the scratch must no longer be used afterwards.
+ *
+ * @param scratch       - The scratch set
+ *
+ */
+void ScratchPool::release_scratch(FusionScratch *scratch) {
+    lock_guard<mutex> guard(lock);
+    idle_scratch.push_back(scratch);
+}
+
+/*
+ * @brief Provides a pair of fused output maps of the given size
+ *
+ * @param size          - The size of the reference view
+ * @param fused_map     - The container to be populated with the depth output map
+ * @param fused_conf    - The container to be populated with the confidence output map
+ *
+ */
+void ScratchPool::acquire_output(const Size size, Mat &fused_map, Mat &fused_conf) {
+    {
+        lock_guard<mutex> guard(lock);
+
+        for (size_t i=0; i<idle_outputs.size(); ++i) {
+            if (idle_outputs[i].first.size() == size) {
+                fused_map = idle_outputs[i].first;
+                fused_conf = idle_outputs[i].second;
+                idle_outputs.erase(idle_outputs.begin() + i);
+                ++output_reuses;
+                return;
+            }
+        }
+
+        ++output_pairs;
+        output_bytes += 2 * (size_t) size.area() * sizeof(float);
+    }
+
+    fused_map.create(size, CV_32F);
+    fused_conf.create(size, CV_32F);
+}
+
+/*
+ * @brief Returns a pair of fused output maps to the pool once they are written
+ *
+ * @param fused_map     - The depth output map
+ * @param fused_conf    - The confidence output map
+ *
+ */
+void ScratchPool::release_output(Mat &fused_map, Mat &fused_conf) {
+    lock_guard<mutex> guard(lock);
+
+    idle_outputs.push_back(make_pair(fused_map, fused_conf));
+    fused_map = Mat();
+    fused_conf = Mat();
+}
+
+/*
+ * @brief Returns the counters of the pool (once no scratch set is in use)
+ *
+ */
+ScratchPoolStats ScratchPool::stats() const {
+    lock_guard<mutex> guard(lock);
+    ScratchPoolStats s;
+
+    s.scratch_sets = all_scratch.size();
+    s.scratch_reuses = scratch_reuses;
+    s.buffer_allocations = 0;
+    s.output_pairs = output_pairs;
+    s.output_reuses = output_reuses;
+    s.held_bytes = output_bytes;
+
+    for (size_t i=0; i<all_scratch.size(); ++i) {
+        s.buffer_allocations += all_scratch[i]->allocations;
+        s.held_bytes += all_scratch[i]->bytes();
+    }
+
+    return s;
+}
+
+/*
+ * @brief Prints the counters of the pool
+ *
+ */
+void ScratchPool::print_stats() const {
+    const ScratchPoolStats s = stats();
+
+    printf("Scratch pool: %zu scratch set(s) (%zu buffer allocations, %zu reuses), %zu output pair(s) (%zu reuses), %.1f MB held\n",
+            s.scratch_sets,
+            s.buffer_allocations,
+            s.scratch_reuses,
+            s.output_pairs,
+            s.output_reuses,
+            s.held_bytes / (1024.0 * 1024.0));
+}
@@ -0,0 +1,62 @@
+#ifndef _SCRATCH_POOL_H_
+#define _SCRATCH_POOL_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <mutex>
+#include <vector>
+
+#include "depth_fusion.h"
+
+using namespace std;
+using namespace cv;
+
+// structure to hold the counters of a scratch pool
+struct ScratchPoolStats {
+    size_t scratch_sets;        // render/consensus scratch sets created
+    size_t scratch_reuses;      // acquisitions served by a recycled scratch set
+    size_t buffer_allocations;  // stacks and z-buffers (re)allocated inside the scratch sets
+    size_t output_pairs;        // fused output map pairs created
+    size_t output_reuses;       // acquisitions served by a recycled output pair
+    size_t held_bytes;          // memory held by the pool (idle and in use)
+};
+
+/*
+ * Pool of the per-reference-view working memory of the pipeline.
+ *
+ * Every reference view needs a scratch set (the stacks its supporting views are rendered
+ * into, the z-buffer, the pair transforms and ray tables of the consensus) and a pair of
+ * fused output maps. Instead of allocating (and page-faulting) them for every view, the
+ * pipeline acquires them here and hands them back when the view is fused (scratch) or
+ * written (outputs). Recycled buffers are not cleared: the render pass overwrites every
+ * pixel of the stacks, clears the z-buffer in bulk before each supporting view, and the
+ * consensus writes every output pixel. The pool grows to the number of views in flight.
+ */
+class ScratchPool {
+    public:
+        ScratchPool();
+        ~ScratchPool();
+
+        FusionScratch *acquire_scratch();
+        void release_scratch(FusionScratch *scratch);
+
+        void acquire_output(const Size size, Mat &fused_map, Mat &fused_conf);
+        void release_output(Mat &fused_map, Mat &fused_conf);
+
+        ScratchPoolStats stats() const;
+        void print_stats() const;
+
+    private:
+        mutable mutex lock;
+
+        vector<FusionScratch *> all_scratch;
+        vector<FusionScratch *> idle_scratch;
+        vector<pair<Mat, Mat>> idle_outputs;
+
+        size_t scratch_reuses;
+        size_t output_pairs;
+        size_t output_reuses;
+        size_t output_bytes;
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+
+#include "util.h"
+#include "mapped_pfm.h"
+#include "output_archive.h"
+#include "shard.h"
+
+/*
+ * @brief Lists the views whose maps a range of reference views reads
+ *
+ * @param views         - The supporting views of every reference view
+ * @param start         - The first reference view
+ * @param end           - One past the last reference view
+ *
+ * @return Returns the union of the pair lists of the range, sorted
+ *
+ */
+static vector<int> shard_inputs(const vector<vector<int>> &views, const int start, const int end) {
+    vector<int> inputs;
+
+    for (int index=start; index<end; ++index) {
+        inputs.insert(inputs.end(), views[index].begin(), views[index].end());
+    }
+    sort(inputs.begin(), inputs.end());
+    inputs.erase(unique(inputs.begin(), inputs.end()), inputs.end());
+
+    return inputs;
+}
+
+/*
+ * @brief Splits the reference views of a scene into contiguous shards
+ *
+ * Neighbouring views share most of their supporting views, so contiguous ranges keep the
+ * inputs of each shard small. The ranges differ in size by at most one view.
+ *
+ * @param scene         - The name of the scene
+ * @param views         - The supporting views of every reference view
+ * @param total_views   - The number of reference views
+ * @param num_shards    - The number of shards (capped at the number of views)
+ *
+ * @return Returns the manifest of the shards
+ *
+ */
+ShardManifest plan_shards(const string scene, const vector<vector<int>> &views, const int total_views, const int num_shards) {
+    ShardManifest manifest;
+    manifest.scene = scene;
+    manifest.total_views = total_views;
+
+    const int n = max(1, min(num_shards, total_views));
+
+    for (int k=0; k<n; ++k) {
+        ShardRange shard;
+        shard.start = (int) ((long) k * total_views / n);
+        shard.end = (int) ((long) (k+1) * total_views / n);
+
+        shard.inputs = shard_inputs(views, shard.start, shard.end);
+
+        manifest.shards.push_back(shard);
+    }
+
+    return manifest;
+}
+
+/*
+ * @brief Checks that the pair lists a worker reads are the ones its shard was planned with
+ *
+ * A pair.txt or view count that changed since the manifest was written would make the
+ * worker read other views than planned, and its maps would not match an unsharded run.
+ *
+ * @param manifest      - The manifest
+ * @param shard         - The shard of the worker
+ * @param views         - The supporting views of every reference view, as the worker reads them
+ *
+ * @return Returns true if the shard reads the planned views; false otherwise
+ *
+ */
+bool check_shard_inputs(const ShardManifest &manifest, const int shard, const vector<vector<int>> &views) {
+    const ShardRange &range = manifest.shards[shard];
+
+    if ((int) views.size() < manifest.total_views) {
+        fprintf(stderr, "Error: found %zu pair lists, but the work manifest has %d views.\n", views.size(), manifest.total_views);
+        return false;
+    }
+
+    if (shard_inputs(views, range.start, range.end) != range.inputs) {
+        fprintf(stderr, "Error: the pair lists of shard %d differ from the work manifest; plan the shards again.\n", shard);
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Writes the work manifest of a sharded scene
+ *
+ * The manifest lists the scene, the number of reference views and, for every shard, its
+ * range of reference views followed by the views whose maps it reads:
+ *
+ *     scene <scene>
+ *     views <total_views>
+ *     shard <k> <start> <end> <num_inputs> <input> <input> ...
+ *
+ * @param manifest      - The manifest
+ * @param path          - The file to be written
+ *
+ * @return Returns true if the file was written successfully; false otherwise
+ *
+ */
+bool write_shard_manifest(const ShardManifest &manifest, const string path) {
+    ofstream file(path);
+
+    if (!file) {
+        fprintf(stderr, "Error: could not open file %s.\n", path.c_str());
+        return false;
+    }
+
+    file << "scene " << manifest.scene << "\n";
+    file << "views " << manifest.total_views << "\n";
+
+    for (size_t k=0; k<manifest.shards.size(); ++k) {
+        const ShardRange &shard = manifest.shards[k];
+
+        file << "shard " << k << " " << shard.start << " " << shard.end << " " << shard.inputs.size();
+        for (size_t i=0; i<shard.inputs.size(); ++i) {
+            file << " " << shard.inputs[i];
+        }
+        file << "\n";
+    }
+
+    return (bool) file;
+}
+
+/*
+ * @brief Reads the work manifest of a sharded scene
+ *
+ * @param path          - The manifest written by write_shard_manifest()
+ * @param manifest      - The container to be populated with the manifest
+ *
+ * @return Returns false if the file cannot be read or is malformed
+ *
+ */
+bool read_shard_manifest(const string path, ShardManifest *manifest) {
+    ifstream file(path);
+
+    if (!file) {
+        fprintf(stderr, "Error: could not open file %s.\n", path.c_str());
+        return false;
+    }
+
+    manifest->scene.clear();
+    manifest->total_views = -1;
+    manifest->shards.clear();
+
+    string line;
+    while (getline(file, line)) {
+        istringstream fields(line);
+        string key;
+
+        if (!(fields >> key)) {
+            continue;
+        }
+
+        bool ok = true;
+        if (key == "scene") {
+            ok = (bool) (fields >> manifest->scene);
+        } else if (key == "views") {
+            ok = (bool) (fields >> manifest->total_views);
+        } else if (key == "shard") {
+            size_t k, num_inputs;
+            ShardRange shard;
+
+            ok = (fields >> k >> shard.start >> shard.end >> num_inputs) && k == manifest->shards.size();
+            shard.inputs.resize(ok ? num_inputs : 0);
+            for (size_t i=0; ok && i<num_inputs; ++i) {
+                ok = (bool) (fields >> shard.inputs[i]);
+            }
+            manifest->shards.push_back(shard);
+        }
+
+        if (!ok) {
+            fprintf(stderr, "Error: malformed line '%s' in %s.\n", line.c_str(), path.c_str());
+            return false;
+        }
+    }
+
+    if (manifest->total_views < 0 || manifest->shards.empty()) {
+        fprintf(stderr, "Error: %s is not a shard manifest.\n", path.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Returns the path of the marker written by a worker once its shard is complete
+ *
+ * @param output_path   - The output path of the scene (with a trailing '/')
+ * @param shard         - The shard
+ *
+ */
+string shard_marker_path(const string output_path, const int shard) {
+    return output_path + "shard_" + to_string(shard) + ".done";
+}
+
+/*
+ * @brief Returns the path of the archive of the fused maps (of a shard, each worker writing its own)
+ *
+ * @param output_path   - The output path of the scene (with a trailing '/')
+ * @param shard         - The shard (-1 = the whole scene)
+ *
+ */
+string archive_path(const string output_path, const int shard) {
+    if (shard < 0) {
+        return output_path + ARCHIVE_FILE_NAME;
+    }
+
+    return output_path + "fused_views_shard" + to_string(shard) + ".far";
+}
+
+/*
+ * @brief Marks a shard as complete
+ *
+ * @param output_path   - The output path of the scene (with a trailing '/')
+ * @param shard         - The shard
+ *
+ * @return Returns true if the marker was written successfully; false otherwise
+ *
+ */
+bool write_shard_marker(const string output_path, const int shard) {
+    const string path = shard_marker_path(output_path, shard);
+    ofstream file(path);
+
+    if (!file) {
+        fprintf(stderr, "Error: could not open file %s.\n", path.c_str());
+        return false;
+    }
+
+    file << "done\n";
+    return (bool) file;
+}
+
+/*
+ * @brief Checks that every shard of a scene is marked complete and every reference view has
+ *          complete fused depth and confidence maps
+ *
+ * The maps are checked by mapping them: a missing or truncated file fails the check. With
+ * archives, a view must have both maps in the archive of one of the shards. Every missing
+ * shard and view is reported.
+ *
+ * @param manifest      - The manifest of the scene
+ * @param output_path   - The output path of the scene (with a trailing '/')
+ * @param archive       - The shards wrote their maps into archives instead of PFM files
+ *
+ * @return Returns true if the scene is complete
+ *
+ */
+bool verify_shards(const ShardManifest &manifest, const string output_path, const bool archive) {
+    size_t missing_shards = 0;
+    size_t missing_views = 0;
+    vector<bool> archived(manifest.total_views, false);
+
+    for (size_t k=0; k<manifest.shards.size(); ++k) {
+        ifstream marker(shard_marker_path(output_path, k));
+        if (!marker) {
+            printf("Shard %zu (views %d-%d) is not marked complete\n", k, manifest.shards[k].start, manifest.shards[k].end-1);
+            ++missing_shards;
+        }
+
+        ArchiveReader reader;
+        if (archive && reader.open(archive_path(output_path, k))) {
+            const vector<int> views = reader.list_views();
+            for (size_t i=0; i<views.size(); ++i) {
+                if (views[i] >= 0 && views[i] < manifest.total_views) {
+                    archived[views[i]] = true;
+                }
+            }
+        }
+    }
+
+    for (int index=0; index<manifest.total_views; ++index) {
+        if (archive) {
+            if (!archived[index]) {
+                printf("View %d is missing or incomplete\n", index);
+                ++missing_views;
+            }
+            continue;
+        }
+
+        string index_str = to_string(index);
+        pad(index_str, 8, '0');
+
+        MappedPfm depth(output_path + "depths/" + index_str + "_depth.pfm");
+        MappedPfm conf(output_path + "confs/" + index_str + "_conf.pfm");
+
+        if (!depth.is_open() || !conf.is_open() || depth.rows() != conf.rows() || depth.cols() != conf.cols()) {
+            printf("View %d is missing or incomplete\n", index);
+            ++missing_views;
+        }
+    }
+
+    printf("Verified %zu shard(s) and %d view(s) of scene %s: %zu shard(s) and %zu view(s) missing\n",
+            manifest.shards.size(),
+            manifest.total_views,
+            manifest.scene.c_str(),
+            missing_shards,
+            missing_views);
+
+    return missing_shards == 0 && missing_views == 0;
+}
+
+/*
+ * @brief Combines the archives of the shards of a verified scene into the archive of the scene
+ *
+ * Every view of every shard archive is read and appended to '<output-path>fused_views.far',
+ * so that readers of the scene archive (such as scripts/evaluate.py) see the sharded run
+ * as a single one. The shard archives are kept.
+ *
+ * @param manifest      - The manifest
+ * @param output_path   - The output path of the scene
+ *
+ * @return Returns true if every view was copied and the archive was closed successfully
+ *
+ */
+bool merge_shard_archives(const ShardManifest &manifest, const string output_path) {
+    const string path = archive_path(output_path, -1);
+    ArchiveWriter writer;
+    size_t copied = 0;
+    bool ok = writer.open(path, false);
+
+    for (size_t k=0; ok && k<manifest.shards.size(); ++k) {
+        ArchiveReader reader;
+        if (!reader.open(archive_path(output_path, k))) {
+            fprintf(stderr, "Error: could not open file %s.\n", archive_path(output_path, k).c_str());
+            ok = false;
+            break;
+        }
+
+        const vector<int> views = reader.list_views();
+        for (size_t i=0; ok && i<views.size(); ++i) {
+            Mat depth;
+            Mat conf;
+            if (!reader.read(views[i], ARCHIVE_DEPTH, &depth) || !reader.read(views[i], ARCHIVE_CONF, &conf)) {
+                fprintf(stderr, "Error: view %d of %s is corrupt.\n", views[i], archive_path(output_path, k).c_str());
+                ok = false;
+                break;
+            }
+            ok = writer.add(views[i], depth, conf);
+            ++copied;
+        }
+    }
+
+    ok = writer.close() && ok;
+    if (ok) {
+        printf("Merged %zu view(s) of %zu shard archive(s) into %s\n", copied, manifest.shards.size(), path.c_str());
+    }
+
+    return ok;
+}
@@ -0,0 +1,36 @@
+#ifndef _SHARD_H_
+#define _SHARD_H_
+
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// structure to hold a shard: a contiguous range of reference views and the views it reads
+struct ShardRange {
+    int start;                  // first reference view
+    int end;                    // one past the last reference view
+    vector<int> inputs;         // every view whose maps the shard reads (from the pair graph)
+};
+
+// structure to hold the work manifest of a sharded scene
+struct ShardManifest {
+    string scene;
+    int total_views;
+    vector<ShardRange> shards;
+};
+
+// coordinator
+ShardManifest plan_shards(const string scene, const vector<vector<int>> &views, const int total_views, const int num_shards);
+bool write_shard_manifest(const ShardManifest &manifest, const string path);
+bool read_shard_manifest(const string path, ShardManifest *manifest);
+
+// workers and verification
+string shard_marker_path(const string output_path, const int shard);
+string archive_path(const string output_path, const int shard);
+bool check_shard_inputs(const ShardManifest &manifest, const int shard, const vector<vector<int>> &views);
+bool write_shard_marker(const string output_path, const int shard);
+bool verify_shards(const ShardManifest &manifest, const string output_path, const bool archive);
+bool merge_shard_archives(const ShardManifest &manifest, const string output_path);
+
+#endif
@@ -0,0 +1,491 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <omp.h>
+
+#include "util.h"
+#include "stream_fusion.h"
+#include "bounded_queue.h"
+#include "fusion_engine.h"
+#include "consensus.h"
+#include "fusion_stats.h"
+#include "output_archive.h"
+#include "map_precision.h"
+#include "shard.h"
+
+/*
+ * @brief Constructs a closed source
+ *
+ */
+FrameSource::FrameSource() :
+    fd(-1),
+    listen_fd(-1),
+    reply_fd(-1),
+    eof(false)
+{}
+
+/*
+ * @brief Closes the source
+ *
+ */
+FrameSource::~FrameSource() {
+    close();
+}
+
+/*
+ * @brief Opens the channel the frames are read from
+ *
+ * For a Unix domain socket, blocks until the producer connects. Otherwise the replies keep
+ * the original stdout to themselves, and stdout is redirected to stderr.
+ *
+ * @param spec          - "-" (stdin), "unix:<path>" (a socket created at the path) or the path of a pipe or file
+ *
+ * @return Returns false if the channel could not be opened
+ *
+ */
+bool FrameSource::open(const string &spec) {
+    close();
+    buffer.clear();
+    eof = false;
+
+    if (spec.compare(0, 5, "unix:") != 0) {
+        fd = (spec == "-") ? STDIN_FILENO : ::open(spec.c_str(), O_RDONLY);
+        if (fd < 0) {
+            fprintf(stderr, "Error: could not open file %s.\n", spec.c_str());
+            return false;
+        }
+
+        fflush(stdout);
+        reply_fd = dup(STDOUT_FILENO);
+        if (reply_fd < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) {
+            fprintf(stderr, "Error: could not separate the replies from the status output.\n");
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    socket_path = spec.substr(5);
+
+    if (socket_path.empty() || socket_path.length() >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: invalid socket path '%s'.\n", socket_path.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path, socket_path.c_str());
+    unlink(socket_path.c_str());
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0 || bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) != 0 || listen(listen_fd, 1) != 0) {
+        fprintf(stderr, "Error: could not listen on %s.\n", socket_path.c_str());
+        close();
+        return false;
+    }
+
+    printf("Waiting for a producer on %s...\n", socket_path.c_str());
+    fflush(stdout);
+
+    fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+        fprintf(stderr, "Error: could not accept a connection on %s.\n", socket_path.c_str());
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Reads the next line (without its newline)
+ *
+ * @param line          - The line to be set
+ *
+ * @return Returns false at the end of the stream
+ *
+ */
+bool FrameSource::read_line(string *line) {
+    size_t newline;
+
+    while ((newline = buffer.find('\n')) == string::npos && !eof) {
+        char block[4096];
+        const ssize_t bytes = read(fd, block, sizeof(block));
+
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            eof = true;
+            break;
+        }
+        buffer.append(block, bytes);
+    }
+
+    if (newline == string::npos) {
+        // a last line without a newline
+        if (buffer.empty()) {
+            return false;
+        }
+        newline = buffer.length();
+    }
+
+    line->assign(buffer, 0, newline);
+    buffer.erase(0, newline+1);
+
+    return true;
+}
+
+/*
+ * @brief Sends a reply line to the producer (over the socket, or to the original stdout)
+ *
+ * @param line          - The line (without its newline)
+ *
+ */
+void FrameSource::reply(const string &line) {
+    // a producer that went away is not an error for the fusion
+    const string message = line + "\n";
+    size_t sent = 0;
+    while (sent < message.length()) {
+        const ssize_t bytes = (listen_fd < 0) ?
+            write(reply_fd, message.data() + sent, message.length() - sent) :
+            send(fd, message.data() + sent, message.length() - sent, MSG_NOSIGNAL);
+        if (bytes < 0 && errno == EINTR) {
+            continue;
+        }
+        if (bytes <= 0) {
+            break;
+        }
+        sent += bytes;
+    }
+}
+
+/*
+ * @brief Closes the channel (and removes the socket); stdout stays redirected to stderr
+ *
+ */
+void FrameSource::close() {
+    if (fd >= 0 && fd != STDIN_FILENO) {
+        ::close(fd);
+    }
+    fd = -1;
+
+    if (reply_fd >= 0) {
+        ::close(reply_fd);
+    }
+    reply_fd = -1;
+
+    if (listen_fd >= 0) {
+        ::close(listen_fd);
+        unlink(socket_path.c_str());
+    }
+    listen_fd = -1;
+}
+
+/*
+ * @brief Reads the frame commands of the stream and loads their maps and cameras
+ *
+ * Runs in its own thread, so that loading overlaps fusion. The frames are numbered in the
+ * order they are read; frames that could not be loaded are passed on with their error.
+ *
+ * @param source        - The channel
+ * @param frames        - The queue receiving the frames (closed at the end of the stream)
+ * @param received      - The number of frame commands read so far
+ *
+ */
+static void read_frames(FrameSource &source, BoundedQueue<StreamFrame> &frames, atomic<int> &received) {
+    string line;
+
+    while (source.read_line(&line)) {
+        istringstream fields(line);
+        string command;
+
+        if (!(fields >> command) || command[0] == '#') {
+            continue;
+        }
+        if (command == "end") {
+            break;
+        }
+        if (command != "frame") {
+            fprintf(stderr, "Error: unknown stream command '%s'.\n", command.c_str());
+            continue;
+        }
+
+        StreamFrame frame;
+        frame.arrival = chrono::steady_clock::now();
+        frame.seq = received++;
+
+        string depth_path;
+        string conf_path;
+        string camera_path;
+        Bounds bounds;
+
+        if (!(fields >> frame.id >> depth_path >> conf_path >> camera_path)) {
+            frame.error = "malformed frame command";
+        } else if ((frame.depth = load_pfm(depth_path)).empty() || (frame.conf = load_pfm(conf_path)).empty()) {
+            frame.error = "could not load the depth or confidence map";
+        } else if (frame.depth.size() != frame.conf.size()) {
+            frame.error = "depth and confidence maps differ in size";
+        } else if (!load_camera_file(camera_path, &frame.K, &frame.P, &bounds)) {
+            frame.error = "could not load the camera";
+        }
+
+        if (frame.id.empty()) {
+            frame.id = "-";
+        }
+
+        frames.push(frame);
+    }
+
+    frames.close();
+}
+
+/*
+ * @brief Returns the window of a frame: the first and last frame it is fused with
+ *
+ * @param seq           - The frame
+ * @param num_views     - The frames per window (including the frame)
+ * @param lookahead     - The frames after the frame in its window
+ * @param start         - Set to the first frame of the window
+ * @param end           - Set to the last frame of the window
+ *
+ */
+static void stream_window(const int seq, const int num_views, const int lookahead, int *start, int *end) {
+    *start = max(0, seq - (num_views-1-lookahead));
+    *end = *start + num_views-1;
+}
+
+/*
+ * @brief Returns the latency percentile of a sorted list (nearest rank)
+ *
+ */
+static double percentile(const vector<double> &sorted, const double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+
+    const size_t rank = (size_t) ceil(p / 100.0 * sorted.size());
+    return sorted[min(sorted.size(), max(rank, (size_t) 1)) - 1];
+}
+
+/*
+ * @brief Fuses a stream of frames as they arrive (see stream_fusion.h)
+ *
+ * @param opts          - The options of the run
+ * @param entry         - The scene (only its output path is used)
+ *
+ * @return Returns the exit status of the run
+ *
+ */
+int run_stream(const FusionOptions &opts, const SceneEntry &entry) {
+    const int num_views = opts.num_views;
+    const int lookahead = opts.stream_lookahead;
+
+    FrameSource source;
+    if (!source.open(opts.stream_source)) {
+        return EXIT_FAILURE;
+    }
+
+    // outputs: the PFM maps of every frame (no display images, to keep the latency down), or the archive
+    ArchiveWriter archive;
+    if (opts.archive) {
+        make_dirs(entry.output_path);
+        if (!archive.open(archive_path(entry.output_path, -1), false)) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        make_dirs(entry.output_path + "depths/");
+        make_dirs(entry.output_path + "confs/");
+    }
+
+    if (opts.num_threads > 0) {
+        omp_set_num_threads(opts.num_threads);
+    }
+
+    FusionParams params;
+    params.conf_pre_filt = opts.conf_pre_filt;
+    params.conf_post_filt = opts.conf_post_filt;
+    params.support_ratio = opts.support_ratio;
+    params.render_tile = opts.render_tile;
+
+    FusionStats stats;
+    stats.set_param("mode", "stream");
+    stats.set_param("num_views", to_string(num_views));
+    stats.set_param("lookahead", to_string(lookahead));
+    stats.set_param("max_lag", to_string(opts.stream_max_lag));
+    stats.set_param("kernel", consensus_kernel_name());
+    stats.set_param("map_precision", map_precision_name(MAP_FP32));
+
+    printf("Consensus kernel: %s\n", consensus_kernel_name());
+    printf("Streaming from %s: windows of %d frame(s), %d ahead%s\n",
+            opts.stream_source.c_str(), num_views, lookahead,
+            (opts.stream_max_lag > 0) ? (", dropping frames more than " + to_string(opts.stream_max_lag) + " behind").c_str() : "");
+    fflush(stdout);
+
+    // frames are loaded by the reader thread while earlier frames are fused
+    BoundedQueue<StreamFrame> frames(num_views + lookahead + 1);
+    atomic<int> received(0);
+    thread reader(read_frames, ref(source), ref(frames), ref(received));
+
+    // frames are registered with the engine in ring slots, so that its view tables stay the
+    // size of the frames held at once instead of growing with the stream; the frames after a
+    // window that are taken in to measure the lag are bounded by the slots as well
+    const int slots = num_views + lookahead + 1 + opts.stream_max_lag;
+
+    map<int, StreamFrame> window;       // frames still needed by a pending window
+    unique_ptr<FusionEngine> engine;
+    Mat fused_map;
+    Mat fused_conf;
+
+    int next = 0;                       // next frame to be emitted
+    int last = -1;                      // last frame received
+    bool ended = false;
+    size_t fused = 0;
+    size_t dropped = 0;
+    size_t failed = 0;
+    vector<double> latencies_ms;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    while (true) {
+        int first;
+        int end;
+        stream_window(next, num_views, lookahead, &first, &end);
+
+        // wait until the window of the next frame is complete (or the stream ended); with a
+        // maximum lag, every frame already read is taken in, so that the lag can be measured
+        if (!ended && (last < end || (opts.stream_max_lag > 0 && frames.size() > 0 && last+1 - first < slots))) {
+            StreamFrame frame;
+            if (!frames.pop(frame)) {
+                ended = true;
+                continue;
+            }
+
+            // the first loaded frame sets the size of the stream
+            if (frame.error.empty() && engine && frame.depth.size() != fused_map.size()) {
+                frame.error = "frame size differs from the first frame";
+            }
+            if (frame.error.empty() && !engine) {
+                engine.reset(new FusionEngine(params, frame.depth.rows, frame.depth.cols));
+                fused_map.create(frame.depth.size(), CV_32F);
+                fused_conf.create(frame.depth.size(), CV_32F);
+            }
+            if (frame.error.empty()) {
+                engine->set_view(frame.seq % slots, frame.depth.ptr<float>(0), frame.conf.ptr<float>(0), frame.K.ptr<float>(0), frame.P.ptr<float>(0));
+            }
+
+            last = frame.seq;
+            window[frame.seq] = frame;
+            continue;
+        }
+
+        if (next > last) {
+            break;
+        }
+
+        StreamFrame &frame = window[next];
+        ostringstream reply;
+
+        if (!frame.error.empty()) {
+            reply << "error " << frame.seq << " " << frame.id << " " << frame.error;
+            ++failed;
+        } else if (opts.stream_max_lag > 0 && received - 1 - next > opts.stream_max_lag) {
+            reply << "dropped " << frame.seq << " " << frame.id;
+            ++dropped;
+        } else {
+            // the loaded frames of the window support the frame
+            vector<int> support;
+            for (int s=first; s<=min(end, last); ++s) {
+                if (s != next && window[s].error.empty()) {
+                    support.push_back(s % slots);
+                }
+            }
+
+            ViewStats view_stats;
+            view_stats.index = next;
+
+            bool ok = engine->fuse(next % slots, support, fused_map.ptr<float>(0), fused_conf.ptr<float>(0), &view_stats);
+
+            chrono::steady_clock::time_point write_start = chrono::steady_clock::now();
+            if (ok && opts.archive) {
+                ok = archive.add(next, fused_map, fused_conf);
+            } else if (ok) {
+                string index_str = to_string(next);
+                pad(index_str, 8, '0');
+                ok = save_pfm(fused_map, entry.output_path + "depths/" + index_str + "_depth.pfm");
+                ok = save_pfm(fused_conf, entry.output_path + "confs/" + index_str + "_conf.pfm") && ok;
+            }
+            view_stats.write_sec = chrono::duration<double>(chrono::steady_clock::now() - write_start).count();
+
+            if (ok) {
+                const double latency_ms = chrono::duration<double, milli>(chrono::steady_clock::now() - frame.arrival).count();
+                latencies_ms.push_back(latency_ms);
+                stats.add_view(view_stats);
+                reply << "fused " << frame.seq << " " << frame.id << " " << latency_ms;
+                ++fused;
+            } else {
+                reply << "error " << frame.seq << " " << frame.id << " could not fuse or write the frame";
+                ++failed;
+            }
+        }
+        source.reply(reply.str());
+
+        // release the frames that no later window includes
+        ++next;
+        stream_window(next, num_views, lookahead, &first, &end);
+        while (!window.empty() && window.begin()->first < first) {
+            if (engine) {
+                engine->clear_view(window.begin()->first % slots);
+            }
+            window.erase(window.begin());
+        }
+    }
+
+    reader.join();
+    source.close();
+
+    if (opts.archive) {
+        archive.close();
+    }
+
+    const double wall_sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    sort(latencies_ms.begin(), latencies_ms.end());
+    const double p50 = percentile(latencies_ms, 50.0);
+    const double p90 = percentile(latencies_ms, 90.0);
+    const double p99 = percentile(latencies_ms, 99.0);
+    const double max_ms = latencies_ms.empty() ? 0.0 : latencies_ms.back();
+
+    printf("Stream: %zu frame(s) fused, %zu dropped, %zu failed in %.2f s (%.1f frames/s)\n",
+            fused, dropped, failed, wall_sec, (wall_sec > 0.0) ? fused / wall_sec : 0.0);
+    printf("Frame latency: p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms\n", p50, p90, p99, max_ms);
+    stats.print_summary();
+
+    stats.set_timer("wall", wall_sec);
+    stats.set_param("frames_fused", to_string(fused));
+    stats.set_param("frames_dropped", to_string(dropped));
+    stats.set_param("frames_failed", to_string(failed));
+    stats.set_param("latency_p50_ms", to_string(p50));
+    stats.set_param("latency_p90_ms", to_string(p90));
+    stats.set_param("latency_p99_ms", to_string(p99));
+    stats.set_param("latency_max_ms", to_string(max_ms));
+
+    const string stats_path = opts.stats_path.empty() ? entry.output_path + "fusion_stats.json" : opts.stats_path;
+    if (stats.write_json(stats_path)) {
+        printf("Statistics written to %s\n", stats_path.c_str());
+    }
+
+    return (failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
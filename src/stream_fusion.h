@@ -0,0 +1,76 @@
+#ifndef _STREAM_FUSION_H_
+#define _STREAM_FUSION_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <chrono>
+#include <string>
+
+#include "options.h"
+
+using namespace std;
+using namespace cv;
+
+// structure to hold a frame of a stream
+struct StreamFrame {
+    int seq = -1;                       // position in the stream (the view index of the frame)
+    string id;                          // label given by the producer
+    Mat depth;
+    Mat conf;
+    Mat K;
+    Mat P;
+    chrono::steady_clock::time_point arrival;   // when the frame command was read
+    string error;                       // why the frame could not be loaded (empty = loaded)
+};
+
+/*
+ * Line-oriented channel the frames are read from: stdin ("-"), a named pipe or file (its
+ * path) or a Unix domain socket ("unix:<path>", which accepts a single producer). Replies
+ * go back to the producer over the socket, and to stdout otherwise; stdout then carries the
+ * replies only, and the status output of the rest of the run goes to stderr.
+ */
+class FrameSource {
+    public:
+        FrameSource();
+        ~FrameSource();
+
+        bool open(const string &spec);
+        bool read_line(string *line);
+        void reply(const string &line);
+        void close();
+
+    private:
+        FrameSource(const FrameSource &);
+        FrameSource &operator=(const FrameSource &);
+
+        int fd;
+        int listen_fd;
+        int reply_fd;           // the original stdout, when the replies are written there
+        string socket_path;
+        string buffer;
+        bool eof;
+};
+
+/*
+ * Online fusion of a stream of frames.
+ *
+ * Every frame is fused with the num_views-1 frames around it in the stream: the
+ * 'lookahead' frames after it and the others before it (the window extends forward at the
+ * start of the stream). A frame is fused and emitted as soon as the
+ * last frame of its window has arrived; frames that fall out of every pending window are
+ * released, so the memory is bounded by the window. Without a maximum lag, a producer that
+ * outpaces fusion is slowed down by the bounded frame queue. With a maximum lag, frames
+ * that are more than that many frames behind the newest frame when their turn comes are
+ * dropped instead of fused, which bounds the latency instead.
+ *
+ * The producer sends one command per line:
+ *
+ *     frame <id> <depth.pfm> <conf.pfm> <camera.txt>
+ *     end
+ *
+ * and receives 'fused <seq> <id> <latency-ms>', 'dropped <seq> <id>' or
+ * 'error <seq> <id> <reason>' for every frame, in stream order.
+ */
+int run_stream(const FusionOptions &opts, const SceneEntry &entry);
+
+#endif
@@ -0,0 +1,274 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <random>
+
+#include "util.h"
+#include "synthetic_scene.h"
+
+// scene geometry (millimetres, similar to the DTU depth range)
+#define SCENE_CAMERA_DISTANCE   700.0f
+#define SCENE_CAMERA_ELEVATION  0.5f        // radians above the ground plane
+#define SCENE_CAMERA_ARC        1.2f        // radians spanned by the cameras
+#define SCENE_SPHERE_RADIUS     120.0f
+
+/*
+ * @brief Returns the default parameters of a synthetic scene
+ *
+ */
+SyntheticSceneParams default_scene_params() {
+    SyntheticSceneParams params;
+
+    params.width = 640;
+    params.height = 512;
+    params.total_views = 16;
+    params.pair_views = 10;
+    params.noise = 0.002f;
+    params.outliers = 0.02f;
+    params.seed = 1;
+
+    return params;
+}
+
+/*
+ * @brief Builds the camera of a view looking at the origin from the given azimuth
+ *
+ * @param params        - The scene parameters
+ * @param azimuth       - The azimuth of the camera (radians)
+ * @param K             - The 4x4 intrinsic matrix to be populated
+ * @param P             - The 4x4 extrinsic matrix to be populated
+ *
+ */
+static void build_camera(const SyntheticSceneParams &params, const float azimuth, Mat &K, Mat &P) {
+    const float focal = 1.2f * params.width;
+
+    K = Mat::zeros(4, 4, CV_32F);
+    K.at<float>(0,0) = focal;
+    K.at<float>(1,1) = focal;
+    K.at<float>(0,2) = 0.5f * params.width;
+    K.at<float>(1,2) = 0.5f * params.height;
+    K.at<float>(2,2) = 1.0f;
+    K.at<float>(3,3) = 1.0f;
+
+    // camera centre on a ring above the ground plane, looking at the origin (z is up)
+    const Vec3f center(
+            SCENE_CAMERA_DISTANCE * cos(SCENE_CAMERA_ELEVATION) * cos(azimuth),
+            SCENE_CAMERA_DISTANCE * cos(SCENE_CAMERA_ELEVATION) * sin(azimuth),
+            SCENE_CAMERA_DISTANCE * sin(SCENE_CAMERA_ELEVATION));
+    const Vec3f forward = normalize(-center);
+    const Vec3f right = normalize(forward.cross(Vec3f(0, 0, 1)));
+    const Vec3f down = forward.cross(right);
+
+    // rows of the rotation are the camera axes (x right, y down, z forward)
+    P = Mat::zeros(4, 4, CV_32F);
+    for (int i=0; i<3; ++i) {
+        P.at<float>(0,i) = right[i];
+        P.at<float>(1,i) = down[i];
+        P.at<float>(2,i) = forward[i];
+    }
+    P.at<float>(0,3) = -right.dot(center);
+    P.at<float>(1,3) = -down.dot(center);
+    P.at<float>(2,3) = -forward.dot(center);
+    P.at<float>(3,3) = 1.0f;
+}
+
+/*
+ * @brief Casts the ray of a pixel into the scene (a sphere resting on the ground plane)
+ *
+ * @param center        - The camera centre
+ * @param ray           - The ray direction (with unit depth along the optical axis)
+ * @param depth         - The depth of the closest hit
+ * @param shade         - The cosine between the ray and the surface normal at the hit
+ *
+ * @return Returns false if the ray hits nothing
+ *
+ */
+static bool cast_ray(const Vec3f &center, const Vec3f &ray, float &depth, float &shade) {
+    const Vec3f sphere(0, 0, SCENE_SPHERE_RADIUS);
+    depth = -1.0f;
+
+    // ground plane (z = 0)
+    if (ray[2] < 0) {
+        depth = -center[2] / ray[2];
+        shade = -ray[2] / norm(ray);
+    }
+
+    // sphere
+    const Vec3f oc = center - sphere;
+    const float a = ray.dot(ray);
+    const float b = 2.0f * oc.dot(ray);
+    const float c = oc.dot(oc) - SCENE_SPHERE_RADIUS*SCENE_SPHERE_RADIUS;
+    const float disc = b*b - 4*a*c;
+
+    if (disc >= 0) {
+        const float t = (-b - sqrt(disc)) / (2*a);
+        if (t > 0 && (depth < 0 || t < depth)) {
+            const Vec3f normal = normalize(center + t*ray - sphere);
+            depth = t;
+            shade = -normal.dot(ray) / norm(ray);
+        }
+    }
+
+    return depth > 0;
+}
+
+/*
+ * @brief Generates a synthetic scene
+ *
+ * A ring of cameras looks at a sphere resting on a ground plane. The depth maps are
+ * ray-cast exactly, then perturbed by Gaussian noise and a fraction of low-confidence
+ * outliers. The confidence falls off with the viewing angle of the surface. The supporting
+ * views of every view are its nearest neighbours on the ring.
+ *
+ * @param params        - The scene parameters
+ * @param scene         - The container to be populated with the scene
+ *
+ */
+void generate_scene(const SyntheticSceneParams &params, SyntheticScene *scene) {
+    const int n = params.total_views;
+    const Size size(params.width, params.height);
+
+    scene->depth_maps.assign(n, Mat());
+    scene->conf_maps.assign(n, Mat());
+    scene->images.assign(n, Mat());
+    scene->K.assign(n, Mat());
+    scene->P.assign(n, Mat());
+    scene->views.assign(n, vector<int>());
+
+    for (int v=0; v<n; ++v) {
+        const float azimuth = (n > 1) ? SCENE_CAMERA_ARC * v / (n-1) : 0.0f;
+        build_camera(params, azimuth, scene->K[v], scene->P[v]);
+    }
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int v=0; v<n; ++v) {
+        mt19937 rng(params.seed * 7919 + v);
+        normal_distribution<float> noise(0.0f, params.noise);
+        uniform_real_distribution<float> uniform(0.0f, 1.0f);
+
+        Mat depth_map(size, CV_32F);
+        Mat conf_map(size, CV_32F);
+        Mat image(size, CV_32FC3);
+
+        // camera centre and the pixel-to-ray transform
+        Matx33f R, K_inv;
+        Vec3f t;
+        for (int i=0; i<3; ++i) {
+            for (int j=0; j<3; ++j) {
+                R(i,j) = scene->P[v].at<float>(i,j);
+                K_inv(i,j) = scene->K[v].at<float>(i,j);
+            }
+            t[i] = scene->P[v].at<float>(i,3);
+        }
+        K_inv = K_inv.inv();
+        const Vec3f center = -(R.t() * t);
+        const Matx33f pixel_to_ray = R.t() * K_inv;
+
+        for (int r=0; r<size.height; ++r) {
+            for (int c=0; c<size.width; ++c) {
+                const Vec3f ray = pixel_to_ray * Vec3f(c, r, 1);
+                float depth, shade;
+
+                if (!cast_ray(center, ray, depth, shade)) {
+                    depth_map.at<float>(r,c) = 0.0f;
+                    conf_map.at<float>(r,c) = 0.0f;
+                    image.at<Vec3f>(r,c) = Vec3f(0, 0, 0);
+                    continue;
+                }
+
+                float conf = min(1.0f, max(0.0f, shade));
+
+                if (uniform(rng) < params.outliers) {
+                    depth *= 0.5f + uniform(rng);
+                    conf *= 0.3f * uniform(rng);
+                } else {
+                    depth *= 1.0f + noise(rng);
+                }
+
+                depth_map.at<float>(r,c) = depth;
+                conf_map.at<float>(r,c) = conf;
+                image.at<Vec3f>(r,c) = Vec3f(255*shade, 255*shade, 255*shade);
+            }
+        }
+
+        scene->depth_maps[v] = depth_map;
+        scene->conf_maps[v] = conf_map;
+        scene->images[v] = image;
+
+        // supporting views: the nearest views on the ring
+        vector<int> others;
+        for (int u=0; u<n; ++u) {
+            if (u != v) {
+                others.push_back(u);
+            }
+        }
+        stable_sort(others.begin(), others.end(), [v](int a, int b) { return abs(a-v) < abs(b-v); });
+
+        scene->views[v].push_back(v);
+        for (int i=0; i<(int) others.size() && i<params.pair_views; ++i) {
+            scene->views[v].push_back(others[i]);
+        }
+    }
+}
+
+/*
+ * @brief Writes a synthetic scene in the layout read by depth_fusion
+ *
+ * The maps are written to '<data_path>Depths/<scene>/' and '<data_path>Confs/<scene>/',
+ * the cameras and 'pair.txt' to '<data_path>Cameras/'.
+ *
+ * @param scene         - The scene to be written
+ * @param data_path     - The root path of the data (with a trailing '/')
+ * @param scene_name    - The name of the scene
+ * @param pair_views    - The number of supporting views listed per view in pair.txt
+ *
+ */
+void write_scene(const SyntheticScene &scene, const string data_path, const string scene_name, const int pair_views) {
+    const string depth_path = data_path + "Depths/" + scene_name + "/";
+    const string conf_path = data_path + "Confs/" + scene_name + "/";
+    const string cam_path = data_path + "Cameras/";
+    const int n = scene.depth_maps.size();
+
+    make_dirs(depth_path);
+    make_dirs(conf_path);
+    make_dirs(cam_path);
+
+    #pragma omp parallel for schedule(dynamic)
+    for (int v=0; v<n; ++v) {
+        string index_str = to_string(v);
+        pad(index_str, 8, '0');
+
+        save_pfm(scene.depth_maps[v], depth_path + index_str + "_depth.pfm");
+        save_pfm(scene.conf_maps[v], conf_path + index_str + "_conf.pfm");
+
+        ofstream cam_file(cam_path + index_str + "_cam.txt");
+        cam_file << setprecision(9);
+        cam_file << "extrinsic\n";
+        for (int i=0; i<4; ++i) {
+            cam_file << scene.P[v].at<float>(i,0) << " " << scene.P[v].at<float>(i,1) << " " << scene.P[v].at<float>(i,2) << " " << scene.P[v].at<float>(i,3) << "\n";
+        }
+        cam_file << "\nintrinsic\n";
+        for (int i=0; i<3; ++i) {
+            cam_file << scene.K[v].at<float>(i,0) << " " << scene.K[v].at<float>(i,1) << " " << scene.K[v].at<float>(i,2) << "\n";
+        }
+        cam_file << "\n" << SCENE_CAMERA_DISTANCE - 2*SCENE_SPHERE_RADIUS << " 2.5\n";
+    }
+
+    // pair.txt: the number of views, then the view number and its '<count> <view> <score> ...' line
+    ofstream pair_file(cam_path + "pair.txt");
+    pair_file << n << "\n";
+    for (int v=0; v<n; ++v) {
+        const int count = min(pair_views, (int) scene.views[v].size() - 1);
+
+        pair_file << v << "\n" << count;
+        for (int i=1; i<=count; ++i) {
+            pair_file << " " << scene.views[v][i] << " " << 1.0f / i;
+        }
+        pair_file << "\n";
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef _SYNTHETIC_SCENE_H_
+#define _SYNTHETIC_SCENE_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+// structure to hold the parameters of a synthetic scene
+struct SyntheticSceneParams {
+    int width;              // resolution of every view
+    int height;
+    int total_views;        // number of cameras in the scene
+    int pair_views;         // supporting views listed per view in pair.txt
+    float noise;            // standard deviation of the depth noise, relative to the depth
+    float outliers;         // fraction of pixels replaced by low-confidence outliers
+    unsigned int seed;
+};
+
+// structure to hold a synthetic scene (same layout as the data loaded for a real scene)
+struct SyntheticScene {
+    vector<Mat> depth_maps;
+    vector<Mat> conf_maps;
+    vector<Mat> images;
+    vector<Mat> K;
+    vector<Mat> P;
+    vector<vector<int>> views;  // views[i][0] == i, followed by the supporting views
+};
+
+SyntheticSceneParams default_scene_params();
+void generate_scene(const SyntheticSceneParams &params, SyntheticScene *scene);
+void write_scene(const SyntheticScene &scene, const string data_path, const string scene_name, const int pair_views);
+
+#endif
@@ -0,0 +1,403 @@
+#include "opencv2/core/core.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <omp.h>
+
+#include "geometry.h"
+#include "fusion_stats.h"
+#include "map_precision.h"
+#include "tiled_render.h"
+
+// relative tolerances of the culling test, keeping it conservative under float rounding
+#define CULL_DEPTH_EPS 1e-4f
+#define CULL_PIXEL_MARGIN 1.0f
+
+// structure to hold the render counters of a tiled render, summed over the threads
+struct TiledCounts {
+    size_t pre_filtered = 0;
+    size_t out_of_frame = 0;
+    size_t culled = 0;
+    size_t writes = 0;
+    size_t overwrites = 0;
+    size_t rejects = 0;
+};
+
+/*
+ * @brief Returns the memory held by the bins
+ *
+ */
+size_t RenderBins::bytes() const {
+    size_t total = (offsets.capacity() + tile_start.capacity()) * sizeof(size_t);
+
+    total += binned.capacity() * sizeof(BinnedSample);
+    for (size_t t=0; t<thread_samples.size(); ++t) {
+        total += thread_samples[t].capacity() * sizeof(BinnedSample);
+    }
+
+    return total;
+}
+
+/*
+ * @brief Checks whether the convex hull of a set of points, transformed into the reference
+ *          camera, can be seen by the reference view
+ *
+ * Points in front of the camera project into the bounding box of the projected corners, so
+ * the hull misses the view if that box does. A hull entirely behind the camera is never
+ * rendered. Hulls straddling the camera plane (or not finite) are never culled.
+ *
+ * @param corners       - The corners of the hull, in reference camera coordinates
+ * @param count         - The number of corners
+ * @param size          - The size of the reference view
+ *
+ * @return Returns true if no point of the hull can be rendered into the reference view
+ *
+ */
+static bool hull_misses_view(const Vec3f *corners, const int count, const Size &size) {
+    float z_min = HUGE_VALF;
+    float z_max = -HUGE_VALF;
+
+    for (int i=0; i<count; ++i) {
+        if (!isfinite(corners[i][0]) || !isfinite(corners[i][1]) || !isfinite(corners[i][2])) {
+            return false;
+        }
+        z_min = min(z_min, corners[i][2]);
+        z_max = max(z_max, corners[i][2]);
+    }
+
+    const float z_eps = CULL_DEPTH_EPS * max(fabs(z_min), fabs(z_max));
+
+    if (z_max < -z_eps) {
+        return true;
+    }
+    if (z_min <= z_eps) {
+        return false;
+    }
+
+    float u_min = HUGE_VALF, u_max = -HUGE_VALF;
+    float v_min = HUGE_VALF, v_max = -HUGE_VALF;
+
+    for (int i=0; i<count; ++i) {
+        const float u = corners[i][0] / corners[i][2];
+        const float v = corners[i][1] / corners[i][2];
+
+        u_min = min(u_min, u);
+        u_max = max(u_max, u);
+        v_min = min(v_min, v);
+        v_max = max(v_max, v);
+    }
+
+    const float u_margin = CULL_PIXEL_MARGIN + CULL_DEPTH_EPS * max(fabs(u_min), fabs(u_max));
+    const float v_margin = CULL_PIXEL_MARGIN + CULL_DEPTH_EPS * max(fabs(v_min), fabs(v_max));
+
+    return u_max < -u_margin || u_min >= size.width + u_margin ||
+           v_max < -v_margin || v_min >= size.height + v_margin;
+}
+
+/*
+ * @brief Projects a set of work items into bins by reference tile, then applies the depth
+ *          test of every tile
+ *
+ * @param num_items     - The number of work items (source blocks or point chunks)
+ * @param project       - Projects the samples of an item:
+ *                          project(item, samples, counts) appends the in-frame samples
+ * @param tile_size     - The edge length of the tiles of the reference view
+ * @param zbuffer       - The depth buffer of the reference view
+ * @param bins          - The bins, reused across calls
+ * @param totals        - The counters to be updated
+ *
+ */
+template <class Project>
+static void render_binned(const long num_items, Project project, const int tile_size, ZBuffer &zbuffer, RenderBins &bins, TiledCounts &totals) {
+    const Size size = zbuffer.get_size();
+    const int tiles_x = (size.width + tile_size - 1) / tile_size;
+    const int tiles_y = (size.height + tile_size - 1) / tile_size;
+    const int num_tiles = tiles_x * tiles_y;
+    const int max_threads = omp_get_max_threads();
+
+    if ((int) bins.thread_samples.size() < max_threads) {
+        bins.thread_samples.resize(max_threads);
+    }
+    bins.offsets.resize((size_t) max_threads * num_tiles);
+    bins.tile_start.resize(num_tiles + 1);
+
+    size_t pre_filtered = 0;
+    size_t out_of_frame = 0;
+    size_t culled = 0;
+    size_t writes = 0;
+    size_t overwrites = 0;
+    size_t rejects = 0;
+
+#pragma omp parallel num_threads(max_threads) reduction(+:pre_filtered,out_of_frame,culled,writes,overwrites,rejects)
+{
+    const int t = omp_get_thread_num();
+    const int num_threads = omp_get_num_threads();
+    vector<BinnedSample> &samples = bins.thread_samples[t];
+    size_t *offsets = &bins.offsets[(size_t) t*num_tiles];
+    TiledCounts counts;
+
+    // project the samples of the items
+    samples.clear();
+    #pragma omp for schedule(dynamic) nowait
+    for (long i=0; i<num_items; ++i) {
+        project(i, samples, counts);
+    }
+
+    pre_filtered += counts.pre_filtered;
+    out_of_frame += counts.out_of_frame;
+    culled += counts.culled;
+
+    // count the samples of the thread in every tile
+    fill(offsets, offsets + num_tiles, 0);
+    for (size_t j=0; j<samples.size(); ++j) {
+        ++offsets[samples[j].tile];
+    }
+
+    #pragma omp barrier
+    #pragma omp single
+    {
+        // the slots of every tile, split between the threads
+        size_t total = 0;
+        for (int tile=0; tile<num_tiles; ++tile) {
+            bins.tile_start[tile] = total;
+
+            for (int u=0; u<num_threads; ++u) {
+                const size_t n = bins.offsets[(size_t) u*num_tiles + tile];
+                bins.offsets[(size_t) u*num_tiles + tile] = total;
+                total += n;
+            }
+        }
+        bins.tile_start[num_tiles] = total;
+
+        if (bins.binned.size() < total) {
+            bins.binned.resize(total);
+        }
+    }
+
+    // sort the samples of the thread into their tiles
+    for (size_t j=0; j<samples.size(); ++j) {
+        bins.binned[offsets[samples[j].tile]++] = samples[j];
+    }
+
+    #pragma omp barrier
+
+    // depth test one tile at a time: each thread updates a small, cache-resident part of the buffer
+    #pragma omp for schedule(dynamic)
+    for (int tile=0; tile<num_tiles; ++tile) {
+        for (size_t j=bins.tile_start[tile]; j<bins.tile_start[tile+1]; ++j) {
+            const BinnedSample &s = bins.binned[j];
+
+            switch (zbuffer.update_cell(s.cell, s.depth, s.conf)) {
+                case ZBUFFER_INVALID:       ++out_of_frame; break;
+                case ZBUFFER_REJECTED:      ++rejects; break;
+                case ZBUFFER_WRITTEN:       ++writes; break;
+                case ZBUFFER_OVERWRITTEN:   ++overwrites; break;
+            }
+        }
+    }
+} //omp parallel
+
+    totals.pre_filtered += pre_filtered;
+    totals.out_of_frame += out_of_frame;
+    totals.culled += culled;
+    totals.writes += writes;
+    totals.overwrites += overwrites;
+    totals.rejects += rejects;
+}
+
+/*
+ * @brief Bins a projected sample by the tile of the reference view it falls into
+ *
+ * Samples the z-buffer would reject as invalid (behind the camera) are counted out of frame.
+ *
+ */
+static inline void bin_sample(const Vec3f &x_2, const float conf, const Size &size, const int tile_size, const int tiles_x, vector<BinnedSample> &samples, TiledCounts &counts) {
+    int r_p, c_p;
+    float proj_depth;
+
+    if (!to_pixel(x_2, size, r_p, c_p, proj_depth) || !(proj_depth > 0.0f) || proj_depth == HUGE_VALF) {
+        ++counts.out_of_frame;
+        return;
+    }
+
+    BinnedSample s;
+    s.cell = (uint32_t) ((size_t) r_p*size.width + c_p);
+    s.tile = (uint32_t) ((r_p / tile_size) * tiles_x + c_p / tile_size);
+    s.depth = proj_depth;
+    s.conf = conf;
+    samples.push_back(s);
+}
+
+/*
+ * @brief Renders the pixels of a supporting view into the reference view, tile by tile
+ *
+ * The source view is processed in bands of RENDER_BAND_ROWS rows, split into blocks of
+ * RENDER_BLOCK_SIZE pixels. A block is culled if the frustum spanned by its pixels and the
+ * depth range of its rendered pixels misses the reference view (pixels with non-finite
+ * depths are still projected one by one).
+ *
+ * @param depth_map         - The depth map of the supporting view.
+ * @param conf_map          - The confidence map of the supporting view.
+ * @param quant             - The quantization of a 16-bit depth map (NULL for floating-point maps).
+ * @param T                 - The supporting-to-reference reprojection transform.
+ * @param conf_pre_filt     - Pixels with confidence less than this value are not rendered.
+ * @param tile_size         - The edge length (in pixels) of the tiles of the reference view.
+ * @param zbuffer           - The depth buffer of the reference view.
+ * @param stats             - The render counters to be updated.
+ * @param bins              - The bins, reused across supporting views.
+ *
+ */
+void render_pixels_tiled(const Mat &depth_map, const Mat &conf_map, const DepthQuant *quant, const Matx34f &T, const float conf_pre_filt, const int tile_size, ZBuffer &zbuffer, ViewStats &stats, RenderBins &bins) {
+    const Size size = zbuffer.get_size();
+    const int rows = depth_map.rows;
+    const int cols = depth_map.cols;
+    const int tiles_x = (size.width + tile_size - 1) / tile_size;
+    const int blocks_x = (cols + RENDER_BLOCK_SIZE - 1) / RENDER_BLOCK_SIZE;
+    TiledCounts counts;
+
+    for (int band_start=0; band_start<rows; band_start+=RENDER_BAND_ROWS) {
+        const int band_end = min(rows, band_start + RENDER_BAND_ROWS);
+        const int blocks_y = (band_end - band_start + RENDER_BLOCK_SIZE - 1) / RENDER_BLOCK_SIZE;
+
+        render_binned((long) blocks_x * blocks_y, [&](const long block, vector<BinnedSample> &samples, TiledCounts &block_counts) {
+            const int r0 = band_start + (int) (block / blocks_x) * RENDER_BLOCK_SIZE;
+            const int r1 = min(band_end, r0 + RENDER_BLOCK_SIZE);
+            const int c0 = (int) (block % blocks_x) * RENDER_BLOCK_SIZE;
+            const int c1 = min(cols, c0 + RENDER_BLOCK_SIZE);
+
+            // the rows of the block, widened if the maps are held in reduced precision
+            float depth_buffer[RENDER_BLOCK_SIZE * RENDER_BLOCK_SIZE];
+            float conf_buffer[RENDER_BLOCK_SIZE * RENDER_BLOCK_SIZE];
+            const float *depth_rows[RENDER_BLOCK_SIZE];
+            const float *conf_rows[RENDER_BLOCK_SIZE];
+            for (int r=r0; r<r1; ++r) {
+                depth_rows[r-r0] = widen_row(depth_map, quant, r, c0, c1, &depth_buffer[(r-r0) * RENDER_BLOCK_SIZE]);
+                conf_rows[r-r0] = widen_row(conf_map, NULL, r, c0, c1, &conf_buffer[(r-r0) * RENDER_BLOCK_SIZE]);
+            }
+
+            // depth range of the rendered pixels of the block (pixels with non-finite depths are not bounded by it)
+            float d_min = HUGE_VALF;
+            float d_max = -HUGE_VALF;
+            size_t rendered = 0;
+            size_t unbounded = 0;
+
+            for (int r=r0; r<r1; ++r) {
+                const float *depth_row = depth_rows[r-r0];
+                const float *conf_row = conf_rows[r-r0];
+
+                for (int c=0; c<c1-c0; ++c) {
+                    if (conf_row[c] < conf_pre_filt) {
+                        ++block_counts.pre_filtered;
+                        continue;
+                    }
+
+                    ++rendered;
+                    if (!isfinite(depth_row[c])) {
+                        ++unbounded;
+                        continue;
+                    }
+                    d_min = min(d_min, depth_row[c]);
+                    d_max = max(d_max, depth_row[c]);
+                }
+            }
+
+            // every bounded pixel of the block lies in the frustum spanned by its corners and depth range
+            bool culled = false;
+            if (rendered > unbounded) {
+                Vec3f corners[8];
+                for (int i=0; i<8; ++i) {
+                    corners[i] = transform_pixel(T, (i & 1) ? c1-1 : c0, (i & 2) ? r1-1 : r0, (i & 4) ? d_max : d_min);
+                }
+
+                culled = hull_misses_view(corners, 8, size);
+            }
+
+            if (culled) {
+                block_counts.out_of_frame += rendered - unbounded;
+                block_counts.culled += rendered - unbounded;
+            }
+
+            if (culled && unbounded == 0) {
+                return;
+            }
+
+            for (int r=r0; r<r1; ++r) {
+                const float *depth_row = depth_rows[r-r0];
+                const float *conf_row = conf_rows[r-r0];
+
+                for (int c=c0; c<c1; ++c) {
+                    if (conf_row[c-c0] < conf_pre_filt || (culled && isfinite(depth_row[c-c0]))) {
+                        continue;
+                    }
+
+                    bin_sample(transform_pixel(T, c, r, depth_row[c-c0]), conf_row[c-c0], size, tile_size, tiles_x, samples, block_counts);
+                }
+            }
+        }, tile_size, zbuffer, bins, counts);
+    }
+
+    stats.source_pixels += (size_t) rows*cols;
+    stats.pre_filtered += counts.pre_filtered;
+    stats.out_of_frame += counts.out_of_frame;
+    stats.frustum_culled += counts.culled;
+    stats.zbuffer_writes += counts.writes;
+    stats.zbuffer_overwrites += counts.overwrites;
+    stats.zbuffer_rejects += counts.rejects;
+}
+
+/*
+ * @brief Renders the back-projected points of a supporting view into the reference view, tile by tile
+ *
+ * The points are processed in bands of about RENDER_BAND_ROWS source rows. A chunk of
+ * SOURCE_CHUNK_POINTS points is culled if its world bounding box misses the reference view.
+ *
+ * @param source            - The world points (and confidences) of the supporting view.
+ * @param T                 - The world-to-reference projection transform.
+ * @param tile_size         - The edge length (in pixels) of the tiles of the reference view.
+ * @param zbuffer           - The depth buffer of the reference view.
+ * @param stats             - The render counters to be updated (pre-filtered pixels are not part of the source).
+ * @param bins              - The bins, reused across supporting views.
+ *
+ */
+void render_points_tiled(const SourcePoints &source, const Matx34f &T, const int tile_size, ZBuffer &zbuffer, ViewStats &stats, RenderBins &bins) {
+    const Size size = zbuffer.get_size();
+    const int tiles_x = (size.width + tile_size - 1) / tile_size;
+    const long num_points = (long) source.points.size();
+    const long num_chunks = (long) source.bounds.size();
+    const long band_chunks = max(1L, (long) RENDER_BAND_ROWS * size.width / SOURCE_CHUNK_POINTS);
+    TiledCounts counts;
+
+    for (long band_start=0; band_start<num_chunks; band_start+=band_chunks) {
+        const long band_end = min(num_chunks, band_start + band_chunks);
+
+        render_binned(band_end - band_start, [&](const long item, vector<BinnedSample> &samples, TiledCounts &chunk_counts) {
+            const long chunk = band_start + item;
+            const long begin = chunk * SOURCE_CHUNK_POINTS;
+            const long end = min(num_points, begin + SOURCE_CHUNK_POINTS);
+            const Vec6f &box = source.bounds[chunk];
+
+            // every point of the chunk lies in its bounding box
+            Vec3f corners[8];
+            for (int i=0; i<8; ++i) {
+                corners[i] = transform_point(T, box[(i & 1) ? 3 : 0], box[(i & 2) ? 4 : 1], box[(i & 4) ? 5 : 2]);
+            }
+
+            if (hull_misses_view(corners, 8, size)) {
+                chunk_counts.out_of_frame += end - begin;
+                chunk_counts.culled += end - begin;
+                return;
+            }
+
+            for (long i=begin; i<end; ++i) {
+                const Vec4f &X = source.points[i];
+                bin_sample(transform_point(T, X[0], X[1], X[2]), X[3], size, tile_size, tiles_x, samples, chunk_counts);
+            }
+        }, tile_size, zbuffer, bins, counts);
+    }
+
+    stats.out_of_frame += counts.out_of_frame;
+    stats.frustum_culled += counts.culled;
+    stats.zbuffer_writes += counts.writes;
+    stats.zbuffer_overwrites += counts.overwrites;
+    stats.zbuffer_rejects += counts.rejects;
+}
@@ -0,0 +1,57 @@
+#ifndef _TILED_RENDER_H_
+#define _TILED_RENDER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <stdint.h>
+#include <vector>
+
+#include "zbuffer.h"
+#include "render_cache.h"
+
+
+struct ViewStats;
+struct DepthQuant;
+
+// edge length (in pixels) of the blocks of a source view that are culled against the reference view
+#define RENDER_BLOCK_SIZE 32
+
+// source rows projected and binned at once (bounds the memory of the bins)
+#define RENDER_BAND_ROWS 256
+
+// a projected source sample, binned by the tile of the reference view it falls into
+struct BinnedSample {
+    uint32_t cell;          // row-major pixel index in the reference view
+    uint32_t tile;          // tile of the reference view
+    float depth;
+    float conf;
+};
+
+// structure to hold the bins of the tiled renderer, reused across supporting views
+struct RenderBins {
+    std::vector<std::vector<BinnedSample>> thread_samples; // the samples projected by each thread, unsorted
+    std::vector<size_t> offsets;                           // [thread][tile] next slot of the thread in the tile
+    std::vector<size_t> tile_start;                        // first slot of every tile (and one past the last)
+    std::vector<BinnedSample> binned;                      // the samples sorted by tile
+
+    size_t bytes() const;
+};
+
+/*
+ * Tiled renderer of supporting views.
+ *
+ * Scattering every source sample straight into the z-buffer of the reference view touches
+ * the whole buffer in random order, which thrashes the caches once the reference view no
+ * longer fits in them (4K and larger). The tiled renderer first projects a band of source
+ * rows, binning the samples by the square tile of the reference view they fall into, and
+ * then applies the depth test one tile at a time, so that every thread updates a small,
+ * cache-resident part of the buffer. Blocks of source pixels (or chunks of cached points)
+ * whose projected bounding frustum misses the reference view are culled before any of
+ * their samples is projected.
+ *
+ * The rendered maps are identical to those of the scattering renderer.
+ */
+void render_pixels_tiled(const cv::Mat &depth_map, const cv::Mat &conf_map, const DepthQuant *quant, const cv::Matx34f &T, const float conf_pre_filt, const int tile_size, ZBuffer &zbuffer, ViewStats &stats, RenderBins &bins);
+void render_points_tiled(const SourcePoints &source, const cv::Matx34f &T, const int tile_size, ZBuffer &zbuffer, ViewStats &stats, RenderBins &bins);
+
+#endif
@@ -2,6 +2,8 @@
 #include <stdio.h>
 #include <vector>
 #include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <iomanip>
 #include <fstream>
@@ -11,52 +13,61 @@
 #include "opencv2/highgui/highgui.hpp"
 
 #include "util.h"
+#include "mapped_pfm.h"
+#include "scene_loader.h"
 
 /*
- * @brief Loads in all the confidence maps for a scene
+ * @brief Lists the files in a directory that end in the given suffix
  *
- * @param conf_maps     - The container to store the loaded confidence maps
- * @param data_path     - The relative path to the base directory for the data
+ * Only files named as an 8-digit view index followed by the suffix are listed
+ * (for example '00000012_depth.pfm').
+ *
+ * @param data_path     - The directory to be listed (with a trailing '/')
+ * @param suffix        - The suffix following the view index
+ *
+ * @return Returns the full paths of the matching files, sorted by name (none if the directory cannot be opened)
  *
  */
-void load_conf_maps(vector<Mat> *conf_maps, string data_path) {
-    cout << "Loading confidence maps..." << endl;
+vector<string> list_files(const string data_path, const string suffix) {
     DIR *dir;
     struct dirent *ent;
-    char conf_path[256];
-    vector<char*> conf_files;
-
-    // load confidence maps
-    strcpy(conf_path,data_path.c_str());
+    vector<string> files;
 
-    if((dir = opendir(conf_path)) == NULL) {
-        fprintf(stderr,"Error: Cannot open directory %s.\n",conf_path);
-        exit(EXIT_FAILURE);
+    // a missing directory lists no files; callers report the inconsistent scene
+    if((dir = opendir(data_path.c_str())) == NULL) {
+        fprintf(stderr,"Error: Cannot open directory %s.\n",data_path.c_str());
+        return files;
     }
 
     while((ent = readdir(dir)) != NULL) {
         if ((ent->d_name[0] != '.') && (ent->d_type != DT_DIR)) {
-			if (strcmp(ent->d_name + 8, "_conf.pfm") == 0) {
-				char *conf_filename = (char*) malloc(sizeof(char) * 256);
-
-				strcpy(conf_filename,conf_path);
-				strcat(conf_filename,ent->d_name);
-
-				conf_files.push_back(conf_filename);
+			if (strlen(ent->d_name) > 8 && suffix.compare(ent->d_name + 8) == 0) {
+				files.push_back(data_path + ent->d_name);
 			}
         }
     }
 
+    closedir(dir);
+
     // sort files by name
-    sort(conf_files.begin(), conf_files.end(), comp);
+    sort(files.begin(), files.end());
 
-    int conf_count = conf_files.size();
+    return files;
+}
 
-    for (int i=0; i<conf_count; ++i) {
-        Mat map = load_pfm(conf_files[i]);
-        conf_maps->push_back(map);
-    }
+/*
+ * @brief Loads in all the confidence maps for a scene
+ *
+ * @param conf_maps     - The container to store the loaded confidence maps
+ * @param data_path     - The relative path to the base directory for the data
+ *
+ */
+void load_conf_maps(vector<Mat> *conf_maps, string data_path) {
+    cout << "Loading confidence maps..." << endl;
+    SceneData scene;
+    load_scene(discover_scene("", data_path, "", ""), LOAD_CONF, &scene, 0);
 
+    conf_maps->insert(conf_maps->end(), scene.conf_maps.begin(), scene.conf_maps.end());
 }
 
 /*
@@ -68,41 +79,10 @@ void load_conf_maps(vector<Mat> *conf_maps, string data_path) {
  */
 void load_depth_maps(vector<Mat> *depth_maps, string data_path) {
     cout << "Loading depth maps..." << endl;
-    DIR *dir;
-    struct dirent *ent;
-    char depth_path[256];
-    vector<char*> depth_files;
-
-    // load images
-    strcpy(depth_path,data_path.c_str());
-
-    if((dir = opendir(depth_path)) == NULL) {
-        fprintf(stderr,"Error: Cannot open directory %s.\n",depth_path);
-        exit(EXIT_FAILURE);
-    }
-
-    while((ent = readdir(dir)) != NULL) {
-        if ((ent->d_name[0] != '.') && (ent->d_type != DT_DIR)) {
-			if (strcmp(ent->d_name + 8, "_depth.pfm") == 0) {
-				char *depth_filename = (char*) malloc(sizeof(char) * 256);
-
-				strcpy(depth_filename,depth_path);
-				strcat(depth_filename,ent->d_name);
+    SceneData scene;
+    load_scene(discover_scene(data_path, "", "", ""), LOAD_DEPTH, &scene, 0);
 
-				depth_files.push_back(depth_filename);
-			}
-        }
-    }
-
-    // sort files by name
-    sort(depth_files.begin(), depth_files.end(), comp);
-
-    int depth_count = depth_files.size();
-
-    for (int i=0; i<depth_count; ++i) {
-        Mat map = load_pfm(depth_files[i]);
-        depth_maps->push_back(map);
-    }
+    depth_maps->insert(depth_maps->end(), scene.depth_maps.begin(), scene.depth_maps.end());
 }
 
 /*
@@ -114,43 +94,10 @@ void load_depth_maps(vector<Mat> *depth_maps, string data_path) {
  */
 void load_images(vector<Mat> *images, string data_path) {
     cout << "Loading images..." << endl;
-    DIR *dir;
-    struct dirent *ent;
-    char img_path[256];
-    vector<char*> img_files;
-
-    // load images
-    strcpy(img_path,data_path.c_str());
-    strcat(img_path,"images/");
+    SceneData scene;
+    load_scene(discover_scene("", "", data_path + "images/", ""), LOAD_IMAGES, &scene, 0);
 
-    if((dir = opendir(img_path)) == NULL) {
-        fprintf(stderr,"Error: Cannot open directory %s.\n",img_path);
-        exit(EXIT_FAILURE);
-    }
-
-    while((ent = readdir(dir)) != NULL) {
-        if ((ent->d_name[0] != '.') && (ent->d_type != DT_DIR)) {
-			if (strcmp(ent->d_name + 8, ".png") == 0) {
-				char *img_filename = (char*) malloc(sizeof(char) * 256);
-
-				strcpy(img_filename,img_path);
-				strcat(img_filename,ent->d_name);
-
-				img_files.push_back(img_filename);
-			}
-        }
-    }
-
-    // sort files by name
-    sort(img_files.begin(), img_files.end(), comp);
-
-    int img_count = img_files.size();
-
-    for (int i=0; i<img_count; ++i) {
-        Mat img = imread(img_files[i], IMREAD_COLOR);
-        img.convertTo(img,CV_32F);
-        images->push_back(img);
-    }
+    images->insert(images->end(), scene.images.begin(), scene.images.end());
 }
 
 
@@ -161,18 +108,18 @@ void load_images(vector<Mat> *images, string data_path) {
  * @param num_views - The number of suporting views being used for fusion.
  * @param data_path - The path to the base directory for the data.
  *
+ * @return Returns false if pair.txt is missing or truncated
+ *
  */
-void load_views(vector<vector<int>> *views, const int num_views, string data_path) {
+bool load_views(vector<vector<int>> *views, const int num_views, string data_path) {
     cout << "Loading views..." << endl;
-    DIR *dir;
-    struct dirent *ent;
     char view_path[256];
 
     FILE *fp;
     char *line=NULL;
     size_t n = 128;
-    ssize_t bytes_read;
     char *ptr = NULL;
+    bool ok = true;
 
     // load views
     strcpy(view_path,data_path.c_str());
@@ -180,13 +127,16 @@ void load_views(vector<vector<int>> *views, const int num_views, string data_pat
 
     if ((fp = fopen(view_path,"r")) == NULL) {
         fprintf(stderr,"Error: could not open file %s.\n", view_path);
-        exit(EXIT_FAILURE);
+        return false;
     }
 
     // grab total number of views...
-    bytes_read = getline(&line, &n, fp);
-    ptr = strstr(line,"\n");
-    strncpy(ptr,"\0",1);
+    if (getline(&line, &n, fp) == -1) {
+        fprintf(stderr, "Error: could not read line from %s.\n",view_path);
+        free(line);
+        fclose(fp);
+        return false;
+    }
     int total_views = atoi(line);
 
     // load views
@@ -194,17 +144,20 @@ void load_views(vector<vector<int>> *views, const int num_views, string data_pat
         vector<int> v_i;
 
         // throw away view number...
-        bytes_read = getline(&line, &n, fp);
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
+        if (getline(&line, &n, fp) == -1) {
+            ok = false;
+            break;
+        }
 		v_i.push_back(atoi(line));
 
-        if ((bytes_read = getline(&line, &n, fp)) == -1) {
-            fprintf(stderr, "Error: could not read line from %s.\n",view_path);
+        if (getline(&line, &n, fp) == -1) {
+            ok = false;
+            break;
         }
 
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
+        if ((ptr = strstr(line,"\n")) != NULL) {
+            strncpy(ptr,"\0",1);
+        }
         
         char *token = strtok(line," ");
         int ind=0;
@@ -218,6 +171,15 @@ void load_views(vector<vector<int>> *views, const int num_views, string data_pat
         }
         views->push_back(v_i);
     }
+
+    if (!ok) {
+        fprintf(stderr, "Error: could not read line from %s.\n",view_path);
+    }
+
+    free(line);
+    fclose(fp);
+
+    return ok;
 }
 
 
@@ -226,136 +188,84 @@ void load_views(vector<vector<int>> *views, const int num_views, string data_pat
  *
  * @param K         - The container to be populated with the intrinsic matrices for the images
  * @param P         - The container to be populated with the extrinsic matrices for the images
- * @param bounds    - The container to be populated with the bounds for the images
+ * @param bounds    - The container to be populated with the bounds for the images (of the last view)
  * @param data_path - The relative path to the base directory for the data
  *
  */
 void load_camera_params(vector<Mat> *K, vector<Mat> *P, Bounds *bounds, string data_path) {
     cout << "Loading camera parameters..." << endl;
-    DIR *dir;
-    struct dirent *ent;
-    char camera_path[256];
-    vector<char*> camera_files;
-
-    FILE *fp;
-    char *line=NULL;
-    size_t n = 128;
-    ssize_t bytes_read;
-    char *ptr = NULL;
-
-    // load intrinsics
-    strcpy(camera_path,data_path.c_str());
-
-    if((dir = opendir(camera_path)) == NULL) {
-        fprintf(stderr,"Error: Cannot open directory %s.\n",camera_path);
+    SceneData scene;
+    if (!load_scene(discover_scene("", "", "", data_path), LOAD_CAMERAS, &scene, 0)) {
         exit(EXIT_FAILURE);
     }
 
-    while((ent = readdir(dir)) != NULL) {
-        if ((ent->d_name[0] != '.') && (ent->d_type != DT_DIR)) {
-			if (strcmp(ent->d_name + 8, "_cam.txt") == 0) {
-				char *camera_filename = (char*) malloc(sizeof(char) * 256);
+    K->insert(K->end(), scene.K.begin(), scene.K.end());
+    P->insert(P->end(), scene.P.begin(), scene.P.end());
 
-				strcpy(camera_filename,camera_path);
-				strcat(camera_filename,ent->d_name);
-
-				camera_files.push_back(camera_filename);
-			}
-        }
+    if (!scene.bounds.empty()) {
+        *bounds = scene.bounds.back();
     }
+}
 
-    // sort files by name
-    sort(camera_files.begin(), camera_files.end(), comp);
+/*
+ * @brief Loads the intrinsics, extrinsics, and bounds of a single camera file
+ *
+ * The file holds the 'extrinsic' tag and a 4x4 matrix, the 'intrinsic' tag and a 3x3
+ * matrix, followed by the minimum depth and the depth increment. The parser keeps no
+ * state between calls, so several files may be loaded concurrently.
+ *
+ * @param filename  - The camera file to be loaded
+ * @param K         - The 4x4 intrinsic matrix to be populated
+ * @param P         - The 4x4 extrinsic matrix to be populated
+ * @param bounds    - The bounds to be populated
+ *
+ * @return Returns true if the file was parsed successfully; false otherwise
+ *
+ */
+bool load_camera_file(const string filename, Mat *K, Mat *P, Bounds *bounds) {
+    ifstream cam_file(filename.c_str());
+    string tag;
 
-    int camera_count = camera_files.size();
+    if (!cam_file) {
+        return false;
+    }
 
-    for (int i=0; i<camera_count; ++i) {
-        if ((fp = fopen(camera_files[i],"r")) == NULL) {
-            fprintf(stderr,"Error: could not open file %s.\n", camera_files[i]);
-            exit(EXIT_FAILURE);
+    // load P matrix
+    Mat P_i(4,4,CV_32F);
+    cam_file >> tag;
+    for (int j=0; j<4; ++j) {
+        for (int i=0; i<4; ++i) {
+            cam_file >> P_i.at<float>(j,i);
         }
+    }
 
-        // throw away 'extrinsic' tag...
-        bytes_read = getline(&line, &n, fp);
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
-
-        // load P matrix
-        Mat P_i(4,4,CV_32F);
-        for (int j=0; j<4; ++j) {
-            if ((bytes_read = getline(&line, &n, fp)) == -1) {
-                fprintf(stderr, "Error: could not read line from %s.\n",camera_files[i]);
-            }
-
-            ptr = strstr(line,"\n");
-            strncpy(ptr,"\0",1);
-            
-            char *token = strtok(line," ");
-            int ind = 0;
-            while (token != NULL) {
-                P_i.at<float>(j,ind) = atof(token);
-
-                token = strtok(NULL," ");
-                ind++;
-            }
-        }
-
-        P->push_back(P_i);
-
-        // throw away empty line and 'intrinsic' tag...
-        bytes_read = getline(&line, &n, fp);
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
-        bytes_read = getline(&line, &n, fp);
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
-
-        // load K matrix
-        Mat K_i(4,4,CV_32F);
-        for (int j=0; j<3; ++j) {
-            if ((bytes_read = getline(&line, &n, fp)) == -1) {
-                fprintf(stderr, "Error: could not read line from %s.\n",camera_files[i]);
-            }
-
-            ptr = strstr(line,"\n");
-            strncpy(ptr,"\0",1);
-            
-            char *token = strtok(line," ");
-            int ind = 0;
-            while (token != NULL) {
-                K_i.at<float>(j,ind) = atof(token);
-
-                token = strtok(NULL," ");
-                ind++;
-            }
+    // load K matrix (the unused entries must be zero for the 4x4 projection math)
+    Mat K_i = Mat::zeros(4,4,CV_32F);
+    cam_file >> tag;
+    for (int j=0; j<3; ++j) {
+        for (int i=0; i<3; ++i) {
+            cam_file >> K_i.at<float>(j,i);
         }
+    }
 
-		K_i.at<float>(2,2) = 1.0;
-		K_i.at<float>(3,3) = 1.0;
-        K->push_back(K_i);
+    K_i.at<float>(2,2) = 1.0;
+    K_i.at<float>(3,3) = 1.0;
 
-        // throw away empty line...
-        bytes_read = getline(&line, &n, fp);
-        ptr = strstr(line,"\n");
-        strncpy(ptr,"\0",1);
+    if (!cam_file) {
+        return false;
+    }
 
-        // load Bounds
-        if ((bytes_read = getline(&line, &n, fp)) == -1) {
-            fprintf(stderr, "Error: could not read line from %s.\n",camera_files[i]);
-        }
+    // load Bounds
+    cam_file >> bounds->min_dist >> bounds->increment;
 
-        //ptr = strstr(line,"\n");
-        //strncpy(ptr,"\0",1);
-        
-        char *token = strtok(line," ");
-        int ind = 0;
+    if (!cam_file) {
+        return false;
+    }
 
-        bounds->min_dist = atof(token);
-        token = strtok(NULL," ");
-        bounds->increment = atof(token);
+    *K = K_i;
+    *P = P_i;
 
-        fclose(fp);
-    }
+    return true;
 }
 
 /*
@@ -426,83 +336,24 @@ float mean_filt(const Mat &patch, int filter_width, int num_inliers) {
 }
 
 /*
- * @brief Stores the given depth map as a point cloud
+ * @brief Creates a directory (and its parents) if it does not exist
  *
- * @param depth_map     - The depth map to be stored
- * @param K             - The intrinsic camera parameters for the view corresponding to the given map
- * @param P             - The extrinsic camera parameters for the view corresponding to the given map
- * @param filename      - The filename where the map will be stored
- * @param iamge         - The image of the view in order to color the points
+ * @param path          - The directory to be created
  *
  */
-void write_ply(const Mat &depth_map, const Mat &K, const Mat &P, const string filename, const Mat &image) {
-    Size size = depth_map.size();
-
-    int crop_val = 0;
-
-    int rows = size.height;
-    int cols = size.width;
-
-    vector<Mat> ply_points;
-
-    for (int r=crop_val; r<rows-(crop_val*2); ++r) {
-        for (int c=crop_val; c<cols-(crop_val*2); ++c) {
-            float depth = depth_map.at<float>(r,c);
-
-            if (depth <= 0) {
-                continue;
-            }
-
-            // compute corresponding (x,y) locations
-            Mat x_1(4,1,CV_32F);
-            x_1.at<float>(0,0) = c;
-            x_1.at<float>(1,0) = r;
-            x_1.at<float>(2,0) = 1;
-            x_1.at<float>(3,0) = 1/depth;
-
-            // find 3D world coord of back projection
-            Mat cam_coords = K.inv() * x_1;
-            Mat X_world = P.inv() * cam_coords;
-            X_world.at<float>(0,0) = X_world.at<float>(0,0) / X_world.at<float>(0,3);
-            X_world.at<float>(0,1) = X_world.at<float>(0,1) / X_world.at<float>(0,3);
-            X_world.at<float>(0,2) = X_world.at<float>(0,2) / X_world.at<float>(0,3);
-            X_world.at<float>(0,3) = X_world.at<float>(0,3) / X_world.at<float>(0,3);
+void make_dirs(const string path) {
+    for (size_t pos = path.find('/', 1); ; pos = path.find('/', pos+1)) {
+        const string dir = path.substr(0, pos);
 
-            Mat ply_point = Mat::zeros(1,6,CV_32F);
-
-            ply_point.at<float>(0,0) = X_world.at<float>(0,0);
-            ply_point.at<float>(0,1) = X_world.at<float>(0,1);
-            ply_point.at<float>(0,2) = X_world.at<float>(0,2);
-
-            ply_point.at<float>(0,3) = image.at<Vec3f>(r,c)[0];
-            ply_point.at<float>(0,4) = image.at<Vec3f>(r,c)[1];
-            ply_point.at<float>(0,5) = image.at<Vec3f>(r,c)[2];
-
-            ply_points.push_back(ply_point);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST) {
+            fprintf(stderr, "Error: could not create directory %s.\n", dir.c_str());
+            exit(EXIT_FAILURE);
         }
-    }
 
-    ofstream ply_file;
-    ply_file.open(filename);
-    ply_file << "ply\n";
-    ply_file << "format ascii 1.0\n";
-    ply_file << "element vertex " << ply_points.size() << "\n";
-    ply_file << "property float x\n";
-    ply_file << "property float y\n";
-    ply_file << "property float z\n";
-    ply_file << "property uchar red\n";
-    ply_file << "property uchar green\n";
-    ply_file << "property uchar blue\n";
-    ply_file << "element face 0\n";
-    ply_file << "end_header\n";
-
-    vector<Mat>::iterator pt(ply_points.begin());
-    for (; pt != ply_points.end(); ++pt) {
-        ply_file << pt->at<float>(0,0) << " " << pt->at<float>(0,1) << " " << pt->at<float>(0,2) << " " << pt->at<float>(0,3) << " " << pt->at<float>(0,4) << " " << pt->at<float>(0,5) << "\n";
+        if (pos == string::npos) {
+            break;
+        }
     }
-
-    ply_file.close();
-
 }
 
 /*
@@ -511,8 +362,10 @@ void write_ply(const Mat &depth_map, const Mat &K, const Mat &P, const string fi
  * @param map           - The depth map to display
  * @param filename      - The file name to save the map
  *
+ * @return Returns true if the image was written successfully; false otherwise
+ *
  */
-void display_depth(const Mat map, string filename) {
+bool display_depth(const Mat map, string filename) {
     Size size = map.size();
     // crop 20 pixels
     Mat cropped = map(Rect(0,0,size.width-1,size.height-1));
@@ -520,10 +373,11 @@ void display_depth(const Mat map, string filename) {
     int min = 425;
     int max = 937;
 
-    cropped = (cropped-min) * 255 / (max-min);
+    // scale into a new matrix ('cropped' shares its data with the input map)
+    Mat scaled = (cropped-min) * 255 / (max-min);
     Mat output;
-    threshold(cropped, output,0, 255, THRESH_TOZERO);
-    imwrite(filename, output);
+    threshold(scaled, output,0, 255, THRESH_TOZERO);
+    return imwrite(filename, output);
 }
 
 /*
@@ -532,9 +386,11 @@ void display_depth(const Mat map, string filename) {
  * @param map           - The confidence map to display
  * @param filename      - The file name to save the map
  *
+ * @return Returns true if the image was written successfully; false otherwise
+ *
  */
 
-void display_conf(const Mat map, string filename) {
+bool display_conf(const Mat map, string filename) {
     Size size = map.size();
     // crop 20 pixels
     Mat cropped = map(Rect(0,0,size.width-1,size.height-1));
@@ -542,106 +398,43 @@ void display_conf(const Mat map, string filename) {
     int min = 0;
     int max = 1;
 
-    cropped = (cropped-min) * 255 / (max-min);
+    // scale into a new matrix ('cropped' shares its data with the input map)
+    Mat scaled = (cropped-min) * 255 / (max-min);
     Mat output;
-    threshold(cropped, output,0, 255, THRESH_TOZERO);
-    imwrite(filename, output);
+    threshold(scaled, output,0, 255, THRESH_TOZERO);
+    return imwrite(filename, output);
 }
 
 /*
  * @brief Loads data from a PFM file
  *
+ * The file is memory-mapped and its header parsed once; the payload is copied
+ * into the output one row at a time (flipping the bottom-up row order and
+ * swapping the byte order if the file was written on a different endianness).
+ *
  * @param filePath - The file path of the PFM to be loaded
  * @return Returns the cv::Mat with the data from the file
  *
  */
 Mat load_pfm(const string filePath)
 {
+    MappedPfm pfm(filePath);
 
-    //Open binary file
-    ifstream file(filePath.c_str(),  ios::in | ios::binary);
-
-    Mat imagePFM;
-
-    //If file correctly openened
-    if(file)
-    {
-        //Read the type of file plus the 0x0a UNIX return character at the end
-        char type[3];
-        file.read(type, 3*sizeof(char));
-
-        //Read the width and height
-        unsigned int width(0), height(0);
-        file >> width >> height;
-
-        //Read the 0x0a UNIX return character at the end
-        char endOfLine;
-        file.read(&endOfLine, sizeof(char));
-
-        int numberOfComponents(0);
-        //The type gets the number of color channels
-        if(type[1] == 'F')
-        {
-            imagePFM = Mat(height, width, CV_32FC3);
-            numberOfComponents = 3;
-        }
-        else if(type[1] == 'f')
-        {
-            imagePFM = Mat(height, width, CV_32FC1);
-            numberOfComponents = 1;
-        }
-
-        //Read the endianness plus the 0x0a UNIX return character at the end
-        //Byte Order contains -1.0 or 1.0
-        char byteOrder[4];
-        file.read(byteOrder, 4*sizeof(char));
-
-        //Find the last line return 0x0a before the pixels of the image
-        char findReturn = ' ';
-        while(findReturn != 0x0a)
-        {
-          file.read(&findReturn, sizeof(char));
-        }
-
-        //Read each RGB colors as 3 floats and store it in the image.
-        float *color = new float[numberOfComponents];
-        for(unsigned int i = 0 ; i<height ; ++i)
-        {
-            for(unsigned int j = 0 ; j<width ; ++j)
-            {
-                file.read((char*) color, numberOfComponents*sizeof(float));
-
-                //In the PFM format the image is upside down
-                if(numberOfComponents == 3)
-                {
-                    //OpenCV stores the color as BGR
-                    imagePFM.at<Vec3f>(height-1-i,j) = Vec3f(color[2], color[1], color[0]);
-                }
-                else if(numberOfComponents == 1)
-                {
-                    //OpenCV stores the color as BGR
-                    imagePFM.at<float>(height-1-i,j) = color[0];
-                }
-            }
-        }
-
-        delete[] color;
-
-        //Close file
-        file.close();
-    }
-    else
+    if(!pfm.is_open())
     {
         cerr << "Could not open the file : " << filePath << endl;
+        return Mat();
     }
 
-    return imagePFM;
+    return pfm.to_mat();
 }
 
 
 /*
  * @brief Writes a matrix to a PFM file
  *
+ * The header is followed by the whole (flipped) payload in a single write.
+ *
  * @param image         - The cv::Mat of data to be stored in the PFM file
  * @param filePath      - The file path to store the data
  *
@@ -690,35 +483,29 @@ bool save_pfm(const cv::Mat image, const std::string filePath)
         }
 
         //Store the floating points RGB color upside down, left to right
-        float* buffer = new float[numberOfComponents];
-
-        for(int i = 0 ; i<height ; ++i)
+        //OpenCV stores as BGR
+        Mat rgb;
+        if(numberOfComponents == 3)
         {
-            for(int j = 0 ; j<width ; ++j)
-            {
-                if(numberOfComponents == 1)
-                {
-                    buffer[0] = image.at<float>(height-1-i,j);
-                }
-                else
-                {
-                    Vec3f color = image.at<Vec3f>(height-1-i,j);
-
-                   //OpenCV stores as BGR
-                    buffer[0] = color.val[2];
-                    buffer[1] = color.val[1];
-                    buffer[2] = color.val[0];
-                }
-
-                //Write the values
-                imageFile.write((char *) buffer, numberOfComponents*sizeof(float));
-
-            }
+            cvtColor(image, rgb, COLOR_BGR2RGB);
+        }
+        else
+        {
+            rgb = image;
         }
 
-        delete[] buffer;
+        //The flipped copy is continuous, so the whole payload is written in a single call
+        Mat flipped;
+        flip(rgb, flipped, 0);
+        imageFile.write((const char *) flipped.ptr(), flipped.total() * flipped.elemSize());
 
+        //A full disk or an I/O error shows up in the stream state, possibly only once it is flushed
         imageFile.close();
+        if(!imageFile)
+        {
+            cerr << "Could not write the file : " << filePath << endl;
+            return false;
+        }
     }
     else
     {
@@ -0,0 +1,259 @@
+#include "opencv2/core/core.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <omp.h>
+
+#include "geometry.h"
+#include "ply_writer.h"
+#include "voxel_cloud.h"
+
+// rows of a fused view binned per block before merging into the stripes
+#define VOXEL_BLOCK_ROWS 16
+
+// points encoded per write when storing the cloud
+#define VOXEL_WRITE_CHUNK 65536
+
+/*
+ * @brief Adds the running sums of a voxel to another
+ *
+ * @param sum           - The voxel to be updated
+ * @param point         - The voxel (or single point) to be added
+ *
+ */
+static inline void accumulate(VoxelPoint &sum, const VoxelPoint &point) {
+    sum.x += point.x;
+    sum.y += point.y;
+    sum.z += point.z;
+    sum.red += point.red;
+    sum.green += point.green;
+    sum.blue += point.blue;
+    sum.conf += point.conf;
+    sum.count += point.count;
+}
+
+/*
+ * @brief Creates an empty cloud
+ *
+ * @param voxel_size    - The edge length of a voxel (same unit as the depth maps)
+ * @param color         - Whether the points are colored (every view is then added with its image)
+ *
+ */
+VoxelCloud::VoxelCloud(const float voxel_size, const bool color) :
+    voxel_size(voxel_size),
+    color(color),
+    stripes(VOXEL_STRIPES),
+    locks(VOXEL_STRIPES),
+    input_points(0),
+    input_views(0)
+{}
+
+/*
+ * @brief Back-projects a fused view and merges its points into the cloud
+ *
+ * Safe to call from several threads at once. Pixels without a depth estimate and pixels
+ * dropped by the fusion (negative confidence) are skipped.
+ *
+ * @param depth_map     - The fused depth map
+ * @param conf_map      - The fused confidence map
+ * @param K             - The intrinsic camera parameters of the view
+ * @param P             - The extrinsic camera parameters of the view
+ * @param image         - The image of the view (CV_32FC3 BGR; only used if the cloud is colored)
+ *
+ */
+void VoxelCloud::add_view(const Mat &depth_map, const Mat &conf_map, const Mat &K, const Mat &P, const Mat &image) {
+    const int rows = depth_map.rows;
+    const int cols = depth_map.cols;
+    const int num_blocks = (rows + VOXEL_BLOCK_ROWS - 1) / VOXEL_BLOCK_ROWS;
+    const float scale = 1.0f / voxel_size;
+    const VoxelKeyHash hash;
+
+    if (color && (image.size() != depth_map.size() || image.type() != CV_32FC3)) {
+        fprintf(stderr, "Error: the image of a colored cloud must match the depth map.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // pixel-to-world transform, shared by every pixel of the map
+    const Matx34f T = backprojection_transform(K, P);
+    size_t points = 0;
+
+#pragma omp parallel reduction(+:points)
+{
+    // points of the current block, binned by stripe
+    vector<vector<pair<VoxelKey, VoxelPoint>>> bins(VOXEL_STRIPES);
+
+    #pragma omp for schedule(dynamic)
+    for (int b=0; b<num_blocks; ++b) {
+        const int r_end = min((b+1) * VOXEL_BLOCK_ROWS, rows);
+
+        for (int r=b*VOXEL_BLOCK_ROWS; r<r_end; ++r) {
+            const float *depth_row = depth_map.ptr<float>(r);
+            const float *conf_row = conf_map.ptr<float>(r);
+            const Vec3f *image_row = color ? image.ptr<Vec3f>(r) : NULL;
+
+            for (int c=0; c<cols; ++c) {
+                if (!(depth_row[c] > 0) || conf_row[c] < 0) {
+                    continue;
+                }
+
+                const Vec3f X = transform_pixel(T, c, r, depth_row[c]);
+                const float vx = floor(X[0] * scale);
+                const float vy = floor(X[1] * scale);
+                const float vz = floor(X[2] * scale);
+
+                // ignore points whose voxel cannot be indexed
+                if (!(fabs(vx) < 2e9f && fabs(vy) < 2e9f && fabs(vz) < 2e9f)) {
+                    continue;
+                }
+
+                VoxelKey key;
+                key.x = (int) vx;
+                key.y = (int) vy;
+                key.z = (int) vz;
+
+                VoxelPoint point;
+                point.x = X[0];
+                point.y = X[1];
+                point.z = X[2];
+                if (image_row != NULL) {
+                    point.red = image_row[c][2];
+                    point.green = image_row[c][1];
+                    point.blue = image_row[c][0];
+                }
+                point.conf = conf_row[c];
+                point.count = 1;
+
+                bins[hash(key) % VOXEL_STRIPES].push_back(make_pair(key, point));
+                ++points;
+            }
+        }
+
+        // merge the block, one lock acquisition per stripe
+        for (int s=0; s<VOXEL_STRIPES; ++s) {
+            if (bins[s].empty()) {
+                continue;
+            }
+
+            lock_guard<mutex> guard(locks[s]);
+            for (size_t i=0; i<bins[s].size(); ++i) {
+                accumulate(stripes[s][bins[s][i].first], bins[s][i].second);
+            }
+            bins[s].clear();
+        }
+    }
+} //omp parallel
+
+    input_points += points;
+    ++input_views;
+}
+
+/*
+ * @brief Returns the number of points (occupied voxels) of the cloud
+ *
+ */
+size_t VoxelCloud::size() const {
+    size_t count = 0;
+
+    for (int s=0; s<VOXEL_STRIPES; ++s) {
+        lock_guard<mutex> guard(locks[s]);
+        count += stripes[s].size();
+    }
+
+    return count;
+}
+
+/*
+ * @brief Stores the merged cloud as a binary PLY point cloud
+ *
+ * Every voxel is written as the average of its points (position, color and confidence).
+ * The voxels are sorted by their coordinates so the output does not depend on the order
+ * in which the views were added.
+ *
+ * @param filename      - The filename where the cloud will be stored
+ *
+ * @return Returns true if the file was written successfully; false otherwise
+ *
+ */
+bool VoxelCloud::write_ply(const string &filename) const {
+    vector<pair<VoxelKey, const VoxelPoint *>> voxels;
+
+    for (int s=0; s<VOXEL_STRIPES; ++s) {
+        lock_guard<mutex> guard(locks[s]);
+
+        for (Stripe::const_iterator it = stripes[s].begin(); it != stripes[s].end(); ++it) {
+            voxels.push_back(make_pair(it->first, &it->second));
+        }
+    }
+
+    sort(voxels.begin(), voxels.end(), [](const pair<VoxelKey, const VoxelPoint *> &a, const pair<VoxelKey, const VoxelPoint *> &b) {
+        if (a.first.x != b.first.x) return a.first.x < b.first.x;
+        if (a.first.y != b.first.y) return a.first.y < b.first.y;
+        return a.first.z < b.first.z;
+    });
+
+    FILE *fp = fopen(filename.c_str(), "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "Error: could not open file %s.\n", filename.c_str());
+        return false;
+    }
+
+    write_ply_header(fp, voxels.size(), color, true);
+
+    const size_t vertex_size = 4*sizeof(float) + (color ? 3 : 0);
+    vector<unsigned char> buffer(VOXEL_WRITE_CHUNK * vertex_size);
+
+    for (size_t start=0; start<voxels.size(); start+=VOXEL_WRITE_CHUNK) {
+        const size_t end = min(start + VOXEL_WRITE_CHUNK, voxels.size());
+        unsigned char *out = buffer.data();
+
+        for (size_t i=start; i<end; ++i) {
+            const VoxelPoint &v = *voxels[i].second;
+            const float xyz[3] = { (float) (v.x / v.count), (float) (v.y / v.count), (float) (v.z / v.count) };
+            const float conf = v.conf / v.count;
+
+            memcpy(out, xyz, 3*sizeof(float));
+            out += 3*sizeof(float);
+
+            if (color) {
+                out[0] = saturate_cast<unsigned char>(v.red / v.count);
+                out[1] = saturate_cast<unsigned char>(v.green / v.count);
+                out[2] = saturate_cast<unsigned char>(v.blue / v.count);
+                out += 3;
+            }
+
+            memcpy(out, &conf, sizeof(float));
+            out += sizeof(float);
+        }
+
+        const size_t bytes = out - buffer.data();
+        if (fwrite(buffer.data(), 1, bytes, fp) != bytes) {
+            fprintf(stderr, "Error: could not write file %s.\n", filename.c_str());
+            fclose(fp);
+            return false;
+        }
+    }
+
+    if (fclose(fp) != 0) {
+        fprintf(stderr, "Error: could not write file %s.\n", filename.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+/*
+ * @brief Prints the size of the merged cloud against the points that were added
+ *
+ */
+void VoxelCloud::print_stats() const {
+    const size_t points = size();
+
+    printf("Merged cloud: %zu points from %zu points of %zu view(s) (voxel size %g, %.1fx reduction)\n",
+            points,
+            (size_t) input_points,
+            (size_t) input_views,
+            voxel_size,
+            (points > 0) ? (double) input_points / points : 0.0);
+}
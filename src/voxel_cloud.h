@@ -0,0 +1,79 @@
+#ifndef _VOXEL_CLOUD_H_
+#define _VOXEL_CLOUD_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+// number of independently locked stripes of the voxel hash
+#define VOXEL_STRIPES 256
+
+// integer coordinates of a voxel
+struct VoxelKey {
+    int x;
+    int y;
+    int z;
+
+    bool operator==(const VoxelKey &other) const {
+        return x == other.x && y == other.y && z == other.z;
+    }
+};
+
+struct VoxelKeyHash {
+    size_t operator()(const VoxelKey &key) const {
+        // spatial hash (Teschner et al.)
+        return ((size_t) key.x * 73856093u) ^ ((size_t) key.y * 19349663u) ^ ((size_t) key.z * 83492791u);
+    }
+};
+
+// structure to hold the running sums of the points falling into a voxel
+struct VoxelPoint {
+    double x = 0.0;
+    double y = 0.0;
+    double z = 0.0;
+    float red = 0.0f;
+    float green = 0.0f;
+    float blue = 0.0f;
+    float conf = 0.0f;
+    unsigned int count = 0;
+};
+
+/*
+ * Scene-level point cloud merged in a concurrent voxel hash.
+ *
+ * Every fused view is back-projected into world space and each point is averaged into the
+ * voxel it falls in, so overlapping views collapse into a single point per voxel. The hash
+ * is split into VOXEL_STRIPES stripes with their own lock; threads bin a block of rows by
+ * stripe first and then merge every bin under a single lock acquisition, so views (and the
+ * rows of a view) can be added concurrently.
+ */
+class VoxelCloud {
+    public:
+        VoxelCloud(const float voxel_size, const bool color);
+
+        void add_view(const Mat &depth_map, const Mat &conf_map, const Mat &K, const Mat &P, const Mat &image);
+        bool write_ply(const string &filename) const;
+        size_t size() const;
+        void print_stats() const;
+
+    private:
+        typedef unordered_map<VoxelKey, VoxelPoint, VoxelKeyHash> Stripe;
+
+        const float voxel_size;
+        const bool color;
+
+        vector<Stripe> stripes;
+        mutable vector<mutex> locks;
+
+        atomic<size_t> input_points;
+        atomic<size_t> input_views;
+};
+
+#endif
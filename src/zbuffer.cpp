@@ -0,0 +1,66 @@
+#include "opencv2/core/core.hpp"
+
+#include <omp.h>
+
+#include "zbuffer.h"
+
+using namespace std;
+using namespace cv;
+
+/*
+ * @brief Allocates an empty depth buffer
+ *
+ * @param size          - The size of the reference view being rendered into
+ *
+ */
+ZBuffer::ZBuffer(const Size size) :
+    size(size),
+    cells(new atomic<uint64_t>[(size_t) size.width * size.height])
+{
+    clear();
+}
+
+/*
+ * @brief Marks every pixel of the buffer as empty
+ *
+ */
+void ZBuffer::clear() {
+    const long count = (long) size.width * size.height;
+
+    #pragma omp parallel for
+    for (long i=0; i<count; ++i) {
+        cells[i].store(EMPTY, memory_order_relaxed);
+    }
+}
+
+/*
+ * @brief Copies the buffer contents into a depth map and confidence map
+ *
+ * Empty pixels are written as zero depth and zero confidence.
+ *
+ * @param depth_map     - The CV_32F map to be populated with the closest projection depths
+ * @param conf_map      - The CV_32F map to be populated with the confidence of those projections
+ *
+ */
+void ZBuffer::resolve(Mat &depth_map, Mat &conf_map) const {
+    depth_map.create(size, CV_32F);
+    conf_map.create(size, CV_32F);
+
+    #pragma omp parallel for
+    for (int r=0; r<size.height; ++r) {
+        float *depth_row = depth_map.ptr<float>(r);
+        float *conf_row = conf_map.ptr<float>(r);
+        const atomic<uint64_t> *cell_row = &cells[(size_t) r*size.width];
+
+        for (int c=0; c<size.width; ++c) {
+            const uint64_t key = cell_row[c].load(memory_order_relaxed);
+
+            if (key == EMPTY) {
+                depth_row[c] = 0.0f;
+                conf_row[c] = 0.0f;
+            } else {
+                unpack(key, depth_row[c], conf_row[c]);
+            }
+        }
+    }
+}
@@ -0,0 +1,99 @@
+#ifndef _ZBUFFER_H_
+#define _ZBUFFER_H_
+
+#include "opencv2/core/core.hpp"
+
+#include <atomic>
+#include <memory>
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+
+
+// outcomes of a z-buffer update
+enum ZBufferUpdate {
+    ZBUFFER_INVALID,        // the depth is not positive and finite (behind the camera)
+    ZBUFFER_REJECTED,       // a closer (or equally close and more confident) estimate is stored
+    ZBUFFER_WRITTEN,        // the estimate was stored in an empty pixel
+    ZBUFFER_OVERWRITTEN     // the estimate replaced a stored one
+};
+
+/*
+ * Lock-free depth buffer used to render supporting views into the reference view.
+ *
+ * Every pixel holds a single 64-bit word: the bits of the (positive) projection depth in the
+ * high half and the bit-inverted, order-preserving bits of the confidence in the low half.
+ * Because positive IEEE floats order like their bit patterns, keeping the minimum word keeps
+ * the closest depth, and among equal depths the highest confidence. The minimum does not
+ * depend on the order in which threads arrive, so the rendered maps are deterministic.
+ */
+class ZBuffer {
+    public:
+        ZBuffer(const cv::Size size);
+
+        void clear();
+        void resolve(cv::Mat &depth_map, cv::Mat &conf_map) const;
+
+        cv::Size get_size() const { return size; }
+
+        // offers a projected estimate to the buffer
+        inline ZBufferUpdate update(const int r, const int c, const float depth, const float conf) {
+            return update_cell((size_t) r*size.width + c, depth, conf);
+        }
+
+        // offers a projected estimate to the pixel with the given row-major index
+        inline ZBufferUpdate update_cell(const size_t index, const float depth, const float conf) {
+            // points behind (or on) the reference camera plane never occlude anything
+            if (!(depth > 0.0f) || depth == HUGE_VALF) {
+                return ZBUFFER_INVALID;
+            }
+
+            const uint64_t key = pack(depth, conf);
+            std::atomic<uint64_t> &cell = cells[index];
+            uint64_t curr = cell.load(std::memory_order_relaxed);
+
+            while (key < curr) {
+                if (cell.compare_exchange_weak(curr, key, std::memory_order_relaxed)) {
+                    return (curr == EMPTY) ? ZBUFFER_WRITTEN : ZBUFFER_OVERWRITTEN;
+                }
+            }
+
+            return ZBUFFER_REJECTED;
+        }
+
+    private:
+        static const uint64_t EMPTY = ~((uint64_t) 0);
+
+        cv::Size size;
+        std::unique_ptr<std::atomic<uint64_t>[]> cells;
+
+        static inline uint32_t float_bits(const float v) {
+            uint32_t bits;
+            memcpy(&bits, &v, sizeof(bits));
+            return bits;
+        }
+
+        static inline float bits_float(const uint32_t bits) {
+            float v;
+            memcpy(&v, &bits, sizeof(v));
+            return v;
+        }
+
+        static inline uint64_t pack(const float depth, const float conf) {
+            // map the confidence to an unsigned key that orders like the float, then invert it
+            uint32_t c = float_bits(conf);
+            c = (c & 0x80000000u) ? ~c : (c | 0x80000000u);
+
+            return ((uint64_t) float_bits(depth) << 32) | (uint32_t) ~c;
+        }
+
+        static inline void unpack(const uint64_t key, float &depth, float &conf) {
+            uint32_t c = ~((uint32_t) key);
+            c = (c & 0x80000000u) ? (c & 0x7FFFFFFFu) : ~c;
+
+            depth = bits_float((uint32_t) (key >> 32));
+            conf = bits_float(c);
+        }
+};
+
+#endif